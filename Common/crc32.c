@@ -0,0 +1,169 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared CRC-32
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#include "crc32.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_CLMUL 1
+#endif
+
+// Constants
+#define CRC32_POLYNOMIAL 0xEDB88320U // reflected IEEE polynomial
+#define CLMUL_MIN_LENGTH 64 // shorter buffers aren't worth the setup
+
+// Slicing-by-8 tables: TABLES[k][b] is the CRC of byte b followed by k zero
+// bytes, so eight input bytes are folded with eight lookups
+static uint32_t TABLES[8][256];
+static int tablesReady; // 0 untouched, 1 building, 2 ready
+
+static void buildTables(void) {
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? crc >> 1 ^ CRC32_POLYNOMIAL : crc >> 1;
+        }
+        TABLES[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; ++b) {
+        for (int k = 1; k < 8; ++k) {
+            TABLES[k][b] =
+                TABLES[k - 1][b] >> 8 ^ TABLES[0][TABLES[k - 1][b] & 0xFF];
+        }
+    }
+}
+
+// Build the tables once, whichever thread gets here first
+static void ensureTables(void) {
+    if (__atomic_load_n(&tablesReady, __ATOMIC_ACQUIRE) == 2) {
+        return;
+    }
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&tablesReady, &expected, 1, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        buildTables();
+        __atomic_store_n(&tablesReady, 2, __ATOMIC_RELEASE);
+        return;
+    }
+    while (__atomic_load_n(&tablesReady, __ATOMIC_ACQUIRE) != 2) {
+    }
+}
+
+// Raw (uninverted) CRC state over `length` bytes, eight at a time
+static uint32_t crcSlicing(uint32_t crc, const unsigned char *p,
+                           size_t length) {
+    while (length >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 |
+                      (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = TABLES[7][lo & 0xFF] ^ TABLES[6][lo >> 8 & 0xFF] ^
+              TABLES[5][lo >> 16 & 0xFF] ^ TABLES[4][lo >> 24] ^
+              TABLES[3][hi & 0xFF] ^ TABLES[2][hi >> 8 & 0xFF] ^
+              TABLES[1][hi >> 16 & 0xFF] ^ TABLES[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = crc >> 8 ^ TABLES[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32_CLMUL
+// Carry-less multiply folding (Intel, "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ"). Folds 64-byte blocks into four 128-bit
+// accumulators, folds those into one, then Barrett-reduces to 32 bits.
+// `length` must be a non-zero multiple of 64. Returns the raw CRC state.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t
+crcCLMUL(uint32_t crc, const unsigned char *p, size_t length) {
+    // x^(4*128+32) and x^(4*128-32) mod P, for folding across 64 bytes
+    const __m128i k1k2 = _mm_set_epi64x(0x1C6E41596LL, 0x154442BD4LL);
+    // x^(128+32) and x^(128-32) mod P, for folding across 16 bytes
+    const __m128i k3k4 = _mm_set_epi64x(0x0CCAA009ELL, 0x1751997D0LL);
+    // x^64 mod P, for the 64 to 32 bit fold
+    const __m128i k5 = _mm_set_epi64x(0, 0x163CD6124LL);
+    // Barrett constants: P and floor(x^64 / P)
+    const __m128i poly = _mm_set_epi64x(0x1F7011641LL, 0x1DB710641LL);
+    const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i *)p);
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i *)(p + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    p += 64;
+    length -= 64;
+
+    // Fold four lanes forward 64 bytes at a time
+#define FOLD(x, k, next)                                                       \
+    _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),              \
+                                _mm_clmulepi64_si128(x, k, 0x11)),             \
+                  next)
+    while (length >= 64) {
+        x1 = FOLD(x1, k1k2, _mm_loadu_si128((const __m128i *)p));
+        x2 = FOLD(x2, k1k2, _mm_loadu_si128((const __m128i *)(p + 16)));
+        x3 = FOLD(x3, k1k2, _mm_loadu_si128((const __m128i *)(p + 32)));
+        x4 = FOLD(x4, k1k2, _mm_loadu_si128((const __m128i *)(p + 48)));
+        p += 64;
+        length -= 64;
+    }
+
+    // Four lanes into one
+    x1 = FOLD(x1, k3k4, x2);
+    x1 = FOLD(x1, k3k4, x3);
+    x1 = FOLD(x1, k3k4, x4);
+#undef FOLD
+
+    // 128 to 64 bits, appending 32 zero bits
+    __m128i t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+
+    // 64 to 32 bits
+    t = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+
+    // Barrett reduction
+    t = x1;
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static bool haveCLMUL(void) {
+    static int cached = -1;
+    int have = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    if (have < 0) {
+        __builtin_cpu_init();
+        have = __builtin_cpu_supports("pclmul") &&
+               __builtin_cpu_supports("sse4.1");
+        __atomic_store_n(&cached, have, __ATOMIC_RELAXED);
+    }
+    return have;
+}
+#endif
+
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+    crc = ~crc;
+#ifdef CRC32_CLMUL
+    if (length >= CLMUL_MIN_LENGTH && haveCLMUL()) {
+        size_t bulk = length & ~(size_t)63;
+        crc = crcCLMUL(crc, p, bulk);
+        p += bulk;
+        length -= bulk;
+    }
+#endif
+    if (length > 0) {
+        ensureTables();
+        crc = crcSlicing(crc, p, length);
+    }
+    return ~crc;
+}
@@ -0,0 +1,30 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared CRC-32
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// The IEEE 802.3 CRC-32 (reflected polynomial 0xEDB88320) used by GPT. On
+// x86 CPUs with PCLMULQDQ, long buffers are folded 64 bytes at a time with
+// carry-less multiplies; everything else goes through slicing-by-8 tables.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_CRC32_H_
+#define SUMMER_NTFS_PROJECT_COMMON_CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototypes
+
+// Continue a CRC over `length` more bytes. Start with 0; the result of one
+// call can be passed back in to checksum data in pieces.
+uint32_t crc32Update(uint32_t crc, const void *, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,793 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared device I/O
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
+#define _GNU_SOURCE          // O_DIRECT, preadv2, RWF_NOWAIT
+
+#include "devio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h> // BLKSSZGET
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+// Constants
+#define DEV_MAX_FDS 4096       // descriptors that can be opened for direct I/O
+#define DEV_POOL_CLASSES 24    // buffer size classes, DEV_DIRECT_ALIGN << n
+#define DEV_POOL_KEEP 8        // free buffers kept per size class
+#define DEV_THROTTLE_BURST 0.1 // seconds of tokens a bucket holds
+#define DEV_THROTTLE_SLICE 0.1 // longest sleep before rechecking limits
+#define DEV_CONTROL_POLL 1.0   // seconds between control file checks
+#define DEV_RING_RETRIES 8     // failed waits before a batch gives up
+
+// ioprio_set(2) has no libc wrapper; values from linux/ioprio.h
+#define DEV_IOPRIO_WHO_PROCESS 1
+#define DEV_IOPRIO_CLASS_SHIFT 13
+#define DEV_IOPRIO_CLASS_IDLE 3
+
+// Alignment direct reads on each descriptor need, or 0 for buffered ones.
+// Only written by `devOpen` and `devClose`, before and after the descriptor
+// is used
+static size_t directAlign[DEV_MAX_FDS];
+
+// Free buffers, by size class
+static struct {
+    void *Buffers[DEV_POOL_KEEP];
+    size_t Count;
+} pool[DEV_POOL_CLASSES];
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set once the kernel or the device refuses RWF_NOWAIT, so later reads skip
+// the page cache probe
+static int nowaitUnsupported;
+
+// io_uring instance, mapped once per thread and reused by every batch
+typedef struct {
+    int Fd; // -1 if io_uring is unavailable
+    unsigned *SQTail, *SQMask, *SQArray;
+    struct io_uring_sqe *SQEs;
+    unsigned *CQHead, *CQTail, *CQMask;
+    struct io_uring_cqe *CQEs;
+    void *SQRing, *CQRing;
+    size_t SQRingSize, CQRingSize, SQEsSize;
+} Ring;
+static pthread_key_t ringKey;
+static pthread_once_t ringOnce = PTHREAD_ONCE_INIT;
+
+// Throttle state, guarded by `throttleLock`. The buckets go negative when a
+// read takes more tokens than they hold, and readers wait until they're
+// paid back
+static pthread_mutex_t throttleLock = PTHREAD_MUTEX_INITIALIZER;
+static DevThrottle throttle;         // current settings
+static DevThrottle throttleBase;     // settings before the control file
+static double byteTokens, readTokens;
+static double lastRefill;            // seconds, monotonic
+static char *controlPath;            // watched control file, or NULL
+static struct timespec controlMTime; // its modification time when loaded
+static double lastControlCheck;      // seconds, monotonic
+static volatile sig_atomic_t controlSignalled; // SIGHUP since last check
+static int throttleActive;           // any limit or control file, atomic
+static unsigned priorityVersion;     // bumped on priority change, atomic
+static __thread unsigned threadPriorityVersion; // version this thread has
+
+// Opening
+
+// Direct I/O alignment of `fd`: the logical sector size of a block device,
+// DEV_DIRECT_ALIGN for files (filesystems want up to their block size)
+static size_t alignmentOf(int fd) {
+    struct stat st;
+    int sectorSize;
+    if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode) &&
+        ioctl(fd, BLKSSZGET, &sectorSize) == 0 && sectorSize > 0 &&
+        sectorSize <= DEV_DIRECT_ALIGN) {
+        return (size_t)sectorSize;
+    }
+    return DEV_DIRECT_ALIGN;
+}
+
+int devOpen(const char *path, bool direct) {
+#ifdef O_DIRECT
+    if (direct) {
+        int fd = open(path, O_RDONLY | O_DIRECT);
+        if (fd >= 0 && fd < DEV_MAX_FDS) {
+            directAlign[fd] = alignmentOf(fd);
+            return fd;
+        }
+        if (fd >= 0) {
+            close(fd); // can't track it, so read it buffered
+        } else if (errno != EINVAL) {
+            return -1;
+        }
+        // EINVAL: the filesystem doesn't do direct I/O (tmpfs, ...)
+    }
+#else
+    (void)direct;
+#endif
+    return open(path, O_RDONLY);
+}
+
+int devClose(int fd) {
+    if (fd >= 0 && fd < DEV_MAX_FDS) {
+        directAlign[fd] = 0;
+    }
+    return close(fd);
+}
+
+bool devIsDirect(int fd) {
+    return fd >= 0 && fd < DEV_MAX_FDS && directAlign[fd] != 0;
+}
+
+// Buffer pool
+
+// Size class holding `size` bytes, or DEV_POOL_CLASSES if none does
+static size_t sizeClass(size_t size) {
+    size_t n = 0;
+    while (n < DEV_POOL_CLASSES && ((size_t)DEV_DIRECT_ALIGN << n) < size) {
+        ++n;
+    }
+    return n;
+}
+
+void *devBufferAlloc(size_t size) {
+    size_t n = sizeClass(size);
+    void *buffer = NULL;
+    if (n < DEV_POOL_CLASSES) {
+        pthread_mutex_lock(&poolLock);
+        if (pool[n].Count > 0) {
+            buffer = pool[n].Buffers[--pool[n].Count];
+        }
+        pthread_mutex_unlock(&poolLock);
+        size = (size_t)DEV_DIRECT_ALIGN << n;
+    }
+    if (buffer == NULL && posix_memalign(&buffer, DEV_DIRECT_ALIGN, size)) {
+        buffer = NULL;
+    }
+    return buffer;
+}
+
+void devBufferFree(void *buffer, size_t size) {
+    size_t n = sizeClass(size);
+    if (buffer != NULL && n < DEV_POOL_CLASSES) {
+        pthread_mutex_lock(&poolLock);
+        if (pool[n].Count < DEV_POOL_KEEP) {
+            pool[n].Buffers[pool[n].Count++] = buffer;
+            buffer = NULL;
+        }
+        pthread_mutex_unlock(&poolLock);
+    }
+    free(buffer);
+}
+
+// Throttling
+
+static double monotonicNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void sleepFor(double seconds) {
+    struct timespec pause;
+    pause.tv_sec = (time_t)seconds;
+    pause.tv_nsec = (long)((seconds - (double)pause.tv_sec) * 1e9);
+    while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+    }
+}
+
+// Install `settings`. Caller holds `throttleLock`
+static void applyThrottle(const DevThrottle *settings) {
+    if (settings->Priority != throttle.Priority) {
+        __atomic_fetch_add(&priorityVersion, 1, __ATOMIC_RELEASE);
+    }
+    if (settings->BytesPerSecond != throttle.BytesPerSecond ||
+        settings->ReadsPerSecond != throttle.ReadsPerSecond) {
+        byteTokens = 0;
+        readTokens = 0;
+        lastRefill = monotonicNow();
+    }
+    throttle = *settings;
+    __atomic_store_n(&throttleActive,
+                     throttle.BytesPerSecond != 0 ||
+                         throttle.ReadsPerSecond != 0 || controlPath != NULL,
+                     __ATOMIC_RELEASE);
+}
+
+void devGetThrottle(DevThrottle *settings) {
+    pthread_mutex_lock(&throttleLock);
+    *settings = throttle;
+    pthread_mutex_unlock(&throttleLock);
+}
+
+void devSetThrottle(const DevThrottle *settings) {
+    pthread_mutex_lock(&throttleLock);
+    throttleBase = *settings;
+    applyThrottle(settings);
+    pthread_mutex_unlock(&throttleLock);
+}
+
+bool devParseThrottle(DevThrottle *settings, const char *key,
+                      const char *value) {
+    if (strcmp(key, "priority") == 0) {
+        if (strcmp(value, "idle") == 0) {
+            settings->Priority = DEV_PRIORITY_IDLE;
+        } else if (strcmp(value, "normal") == 0) {
+            settings->Priority = DEV_PRIORITY_NORMAL;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (strcmp(key, "rate") == 0) {
+        return devParseSize(value, &settings->BytesPerSecond);
+    }
+    char *end;
+    if (strcmp(key, "iops") != 0 || *value < '0' || *value > '9') {
+        return false;
+    }
+    errno = 0;
+    uint64_t n = strtoull(value, &end, 10);
+    if (errno != 0 || *end != '\0') {
+        return false;
+    }
+    settings->ReadsPerSecond = n;
+    return true;
+}
+
+bool devParseSize(const char *text, uint64_t *bytes) {
+    char *end;
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    errno = 0;
+    uint64_t n = strtoull(text, &end, 10);
+    if (errno != 0) {
+        return false;
+    }
+    int shift = 0;
+    switch (*end) {
+    case 'K':
+    case 'k':
+        shift = 10;
+        break;
+    case 'M':
+    case 'm':
+        shift = 20;
+        break;
+    case 'G':
+    case 'g':
+        shift = 30;
+        break;
+    }
+    if (shift != 0) {
+        ++end;
+    }
+    if (*end != '\0' || n > UINT64_MAX >> shift) {
+        return false;
+    }
+    *bytes = n << shift;
+    return true;
+}
+
+// Parse the control file over `throttleBase` into `settings`. Returns 1 if
+// it was read, 0 if it doesn't exist (or can't be opened) and -1 if it's
+// malformed
+static int readControl(const char *path, DevThrottle *settings,
+                       struct timespec *mtime) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0) {
+        *mtime = st.st_mtim;
+    }
+    *settings = throttleBase;
+    char *line = NULL;
+    size_t capacity = 0;
+    int result = 1;
+    while (result > 0 && getline(&line, &capacity, file) >= 0) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char key[16], value[64], extra[2];
+        int fields = sscanf(line, "%15s %63s %1s", key, value, extra);
+        if (fields == 2) {
+            result = devParseThrottle(settings, key, value) ? 1 : -1;
+        } else if (fields != EOF && fields != 0) {
+            result = -1;
+        }
+    }
+    free(line);
+    fclose(file);
+    return result;
+}
+
+// Reload the control file if it changed or SIGHUP arrived. Caller holds
+// `throttleLock`
+static void checkControl(double now) {
+    if (controlPath == NULL ||
+        (!controlSignalled && now - lastControlCheck < DEV_CONTROL_POLL)) {
+        return;
+    }
+    bool signalled = controlSignalled;
+    controlSignalled = 0;
+    lastControlCheck = now;
+
+    struct stat st;
+    bool exists = stat(controlPath, &st) == 0;
+    if (!signalled && exists &&
+        st.st_mtim.tv_sec == controlMTime.tv_sec &&
+        st.st_mtim.tv_nsec == controlMTime.tv_nsec) {
+        return;
+    }
+    DevThrottle settings;
+    struct timespec mtime = {0, 0};
+    int status = readControl(controlPath, &settings, &mtime);
+    controlMTime = mtime;
+    if (status > 0) {
+        applyThrottle(&settings);
+    } else if (status == 0) {
+        applyThrottle(&throttleBase); // file removed
+    }
+}
+
+static void onSIGHUP(int signal) {
+    (void)signal;
+    controlSignalled = 1;
+}
+
+bool devWatchThrottle(const char *path) {
+    size_t length = strlen(path);
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy, path, length + 1);
+
+    pthread_mutex_lock(&throttleLock);
+    DevThrottle settings;
+    int status = readControl(copy, &settings, &controlMTime);
+    if (status >= 0) {
+        free(controlPath);
+        controlPath = copy;
+        lastControlCheck = monotonicNow();
+        applyThrottle(status > 0 ? &settings : &throttleBase);
+    }
+    pthread_mutex_unlock(&throttleLock);
+    if (status < 0) {
+        free(copy);
+        return false;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSIGHUP;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGHUP, &action, NULL);
+    return true;
+}
+
+// Move this thread into the current I/O scheduling class if it changed.
+// ioprio is per thread, so every reader catches up on its next read
+static void applyPriority(void) {
+    unsigned version = __atomic_load_n(&priorityVersion, __ATOMIC_ACQUIRE);
+    if (version == threadPriorityVersion) {
+        return;
+    }
+    threadPriorityVersion = version;
+    pthread_mutex_lock(&throttleLock);
+    int priority = throttle.Priority;
+    pthread_mutex_unlock(&throttleLock);
+    int value = priority == DEV_PRIORITY_IDLE
+                    ? DEV_IOPRIO_CLASS_IDLE << DEV_IOPRIO_CLASS_SHIFT
+                    : 0;
+    syscall(__NR_ioprio_set, DEV_IOPRIO_WHO_PROCESS, 0, value);
+}
+
+// Wait until the buckets allow `reads` reads totalling `bytes`, then take
+// the tokens
+static void throttleReads(uint64_t bytes, uint64_t reads) {
+    applyPriority();
+    if (!__atomic_load_n(&throttleActive, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    METRICS_TIME_START(start);
+    bool waited = false;
+    pthread_mutex_lock(&throttleLock);
+    for (;;) {
+        double now = monotonicNow();
+        checkControl(now);
+        double elapsed = now - lastRefill;
+        lastRefill = now;
+        double byteRate = (double)throttle.BytesPerSecond;
+        double readRate = (double)throttle.ReadsPerSecond;
+        byteTokens += elapsed * byteRate;
+        if (byteTokens > byteRate * DEV_THROTTLE_BURST) {
+            byteTokens = byteRate * DEV_THROTTLE_BURST;
+        }
+        readTokens += elapsed * readRate;
+        if (readTokens > readRate * DEV_THROTTLE_BURST) {
+            readTokens = readRate * DEV_THROTTLE_BURST;
+        }
+
+        double wait = 0;
+        if (byteRate > 0 && byteTokens < 0) {
+            wait = -byteTokens / byteRate;
+        }
+        if (readRate > 0 && readTokens < 0 && -readTokens / readRate > wait) {
+            wait = -readTokens / readRate;
+        }
+        if (wait <= 0) {
+            break;
+        }
+        // Sleep in slices so new limits take effect promptly
+        wait = wait < DEV_THROTTLE_SLICE ? wait : DEV_THROTTLE_SLICE;
+        pthread_mutex_unlock(&throttleLock);
+        sleepFor(wait);
+        waited = true;
+        pthread_mutex_lock(&throttleLock);
+    }
+    if (throttle.BytesPerSecond != 0) {
+        byteTokens -= (double)bytes;
+    }
+    if (throttle.ReadsPerSecond != 0) {
+        readTokens -= (double)reads;
+    }
+    pthread_mutex_unlock(&throttleLock);
+    if (waited) {
+        METRICS_TIME_END(STAGE_THROTTLE, start);
+    }
+}
+
+// Reading
+
+// Unaligned read from a direct descriptor: read the aligned blocks covering
+// the request into a bounce buffer and copy the requested bytes out
+static ssize_t bouncePread(int fd, size_t align, unsigned char *buf,
+                           size_t length, off_t offset) {
+    size_t skip = (size_t)(offset % (off_t)align);
+    size_t span = (skip + length + align - 1) / align * align;
+    unsigned char *bounce = devBufferAlloc(span);
+    if (bounce == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ssize_t got = pread(fd, bounce, span, offset - (off_t)skip);
+    if (got >= 0) {
+        size_t n = (size_t)got > skip ? (size_t)got - skip : 0;
+        n = n < length ? n : length;
+        memcpy(buf, bounce + skip, n);
+        got = (ssize_t)n;
+    }
+    devBufferFree(bounce, span);
+    return got;
+}
+
+// Read from a direct descriptor. Aligned buffers at aligned offsets are read
+// in place, except for an unaligned tail
+static ssize_t directPread(int fd, size_t align, unsigned char *buf,
+                           size_t length, off_t offset) {
+    if ((uintptr_t)buf % align != 0 || offset % (off_t)align != 0) {
+        return bouncePread(fd, align, buf, length, offset);
+    }
+    size_t head = length - length % align;
+    ssize_t got = 0;
+    if (head > 0) {
+        got = pread(fd, buf, head, offset);
+        if (got < (ssize_t)head) {
+            return got; // error or end of device
+        }
+    }
+    if (head < length) {
+        ssize_t tail =
+            bouncePread(fd, align, buf + head, length - head, offset + head);
+        if (tail < 0) {
+            return head > 0 ? got : tail;
+        }
+        got += tail;
+    }
+    return got;
+}
+
+// Batches
+
+// Tear down `ring`, leaving Fd at -1 so the thread falls back to pread
+static void ringClose(Ring *ring) {
+    if (ring->Fd >= 0) {
+        munmap(ring->SQEs, ring->SQEsSize);
+        if (ring->CQRing != ring->SQRing) {
+            munmap(ring->CQRing, ring->CQRingSize);
+        }
+        munmap(ring->SQRing, ring->SQRingSize);
+        close(ring->Fd);
+        ring->Fd = -1;
+    }
+}
+
+static void ringFree(void *arg) {
+    ringClose((Ring *)arg);
+    free(arg);
+}
+
+static void ringKeyInit(void) { pthread_key_create(&ringKey, ringFree); }
+
+// Set up `ring`, leaving Fd at -1 if the kernel (or a seccomp filter)
+// refuses io_uring
+static void ringInit(Ring *ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->Fd = (int)syscall(__NR_io_uring_setup, DEV_BATCH_DEPTH, &params);
+    if (ring->Fd < 0) {
+        ring->Fd = -1;
+        return;
+    }
+
+    ring->SQRingSize =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->CQRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->CQRingSize > ring->SQRingSize) {
+        ring->SQRingSize = ring->CQRingSize;
+    }
+    ring->SQEsSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->SQRing = mmap(NULL, ring->SQRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->Fd, IORING_OFF_SQ_RING);
+    ring->CQRing = single ? ring->SQRing
+                          : mmap(NULL, ring->CQRingSize, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, ring->Fd,
+                                 IORING_OFF_CQ_RING);
+    ring->SQEs = mmap(NULL, ring->SQEsSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->Fd, IORING_OFF_SQES);
+    if (ring->SQRing == MAP_FAILED || ring->CQRing == MAP_FAILED ||
+        ring->SQEs == MAP_FAILED) {
+        if (ring->SQEs != MAP_FAILED) {
+            munmap(ring->SQEs, ring->SQEsSize);
+        }
+        if (ring->CQRing != MAP_FAILED && ring->CQRing != ring->SQRing) {
+            munmap(ring->CQRing, ring->CQRingSize);
+        }
+        if (ring->SQRing != MAP_FAILED) {
+            munmap(ring->SQRing, ring->SQRingSize);
+        }
+        close(ring->Fd);
+        ring->Fd = -1;
+        return;
+    }
+
+    unsigned char *sq = ring->SQRing;
+    unsigned char *cq = ring->CQRing;
+    ring->SQTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->SQMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->SQArray = (unsigned *)(sq + params.sq_off.array);
+    ring->CQHead = (unsigned *)(cq + params.cq_off.head);
+    ring->CQTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->CQMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->CQEs = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+}
+
+// This thread's ring, set up on first use. NULL if io_uring is unavailable
+static Ring *threadRing(void) {
+    pthread_once(&ringOnce, ringKeyInit);
+    Ring *ring = pthread_getspecific(ringKey);
+    if (ring == NULL) {
+        ring = malloc(sizeof(Ring));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ringInit(ring);
+        pthread_setspecific(ringKey, ring);
+    }
+    return ring->Fd >= 0 ? ring : NULL;
+}
+
+// Submit up to DEV_BATCH_DEPTH reads and wait for all of them. Returns false
+// if the ring refused the submission. If waiting keeps failing after part of
+// the batch went in, the reads not completed get -errno and the ring is shut,
+// since completions still in flight would be mistaken for a later batch's
+static bool ringReadBatch(Ring *ring, int fd, DevRead *reads, size_t count) {
+    struct iovec iovs[DEV_BATCH_DEPTH];
+    unsigned tail = *ring->SQTail; // only this thread produces
+    for (size_t i = 0; i < count; ++i) {
+        unsigned index = (tail + (unsigned)i) & *ring->SQMask;
+        struct io_uring_sqe *sqe = &ring->SQEs[index];
+        memset(sqe, 0, sizeof(*sqe));
+        iovs[i].iov_base = reads[i].Buffer;
+        iovs[i].iov_len = reads[i].Length;
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&iovs[i];
+        sqe->len = 1;
+        sqe->off = (uint64_t)reads[i].Offset;
+        sqe->user_data = i;
+        ring->SQArray[index] = index;
+    }
+    __atomic_store_n(ring->SQTail, tail + (unsigned)count, __ATOMIC_RELEASE);
+
+    size_t submitted = 0, done = 0;
+    bool completed[DEV_BATCH_DEPTH] = {false};
+    unsigned failures = 0;
+    while (done < count) {
+        long entered =
+            syscall(__NR_io_uring_enter, ring->Fd, count - submitted,
+                    count - done, IORING_ENTER_GETEVENTS, NULL, 0);
+        int error = entered < 0 ? errno : 0;
+        bool failed = entered < 0 && error != EINTR;
+        if (failed && submitted == 0) {
+            // Nothing reached the kernel: take the entries back
+            __atomic_store_n(ring->SQTail, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        if (entered > 0) {
+            submitted += (size_t)entered;
+        }
+
+        // Reap even after a failed wait, so the retry doesn't wait for
+        // completions that are already posted
+        unsigned head = *ring->CQHead;
+        unsigned ready = __atomic_load_n(ring->CQTail, __ATOMIC_ACQUIRE);
+        for (; head != ready; ++head, ++done) {
+            struct io_uring_cqe *cqe = &ring->CQEs[head & *ring->CQMask];
+            reads[cqe->user_data].Result = cqe->res;
+            completed[cqe->user_data] = true;
+        }
+        __atomic_store_n(ring->CQHead, head, __ATOMIC_RELEASE);
+
+        if (failed && done < count && ++failures == DEV_RING_RETRIES) {
+            for (size_t i = 0; i < count; ++i) {
+                if (!completed[i]) {
+                    reads[i].Result = -error;
+                }
+            }
+            ringClose(ring);
+            return true;
+        }
+    }
+    return true;
+}
+
+void devPreadBatch(int fd, DevRead *reads, size_t count) {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bytes += reads[i].Length;
+    }
+    throttleReads(bytes, count);
+    Ring *ring = devIsDirect(fd) ? NULL : threadRing();
+    METRICS_TIME_START(start);
+    for (size_t first = 0; first < count; first += DEV_BATCH_DEPTH) {
+        size_t n = count - first < DEV_BATCH_DEPTH ? count - first
+                                                   : DEV_BATCH_DEPTH;
+        if (ring == NULL || !ringReadBatch(ring, fd, reads + first, n)) {
+            for (size_t i = first; i < first + n; ++i) {
+                ssize_t got = devIsDirect(fd)
+                                  ? directPread(fd, directAlign[fd],
+                                                reads[i].Buffer,
+                                                reads[i].Length, reads[i].Offset)
+                                  : pread(fd, reads[i].Buffer, reads[i].Length,
+                                          reads[i].Offset);
+                reads[i].Result = got < 0 ? -errno : got;
+            }
+        }
+    }
+    METRICS_TIME_END(STAGE_READ, start);
+    METRICS_ADD(METRIC_READS, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (reads[i].Result > 0) {
+            METRICS_ADD(METRIC_BYTES_READ, (uint64_t)reads[i].Result);
+        }
+    }
+}
+
+// Read what the page cache already holds at `offset` (-1 for the current
+// position) without waiting on the device, counting a cache hit when that
+// is all of `length`. Returns the bytes read, or -1 when nothing was cached
+// or the probe is unavailable
+static ssize_t cachedRead(int fd, void *buf, size_t length, off_t offset) {
+#if !defined(NTFS_NO_METRICS) && defined(RWF_NOWAIT)
+    if (__atomic_load_n(&nowaitUnsupported, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    struct iovec iov = {buf, length};
+    ssize_t got = preadv2(fd, &iov, 1, offset, RWF_NOWAIT);
+    if (got < 0) {
+        if (errno == EOPNOTSUPP || errno == EINVAL || errno == ENOSYS) {
+            __atomic_store_n(&nowaitUnsupported, 1, __ATOMIC_RELAXED);
+        }
+        return -1;
+    }
+    if ((size_t)got == length) {
+        METRICS_ADD(METRIC_CACHE_HITS, 1);
+    }
+    return got;
+#else
+    (void)fd;
+    (void)buf;
+    (void)length;
+    (void)offset;
+    return -1;
+#endif
+}
+
+ssize_t devRead(int fd, void *buf, size_t length) {
+    if (devIsDirect(fd)) {
+        // Keep the file position moving as read() would
+        off_t position = lseek(fd, 0, SEEK_CUR);
+        if (position < 0) {
+            return -1;
+        }
+        ssize_t got = devPread(fd, buf, length, position);
+        if (got > 0) {
+            lseek(fd, position + got, SEEK_SET);
+        }
+        return got;
+    }
+    throttleReads(length, 1);
+    METRICS_TIME_START(start);
+    ssize_t got = cachedRead(fd, buf, length, -1);
+    if (got < 0) {
+        got = read(fd, buf, length);
+    } else if (got > 0 && (size_t)got < length) {
+        ssize_t rest = read(fd, (char *)buf + got, length - (size_t)got);
+        if (rest > 0) {
+            got += rest;
+        }
+    }
+    METRICS_TIME_END(STAGE_READ, start);
+    METRICS_ADD(METRIC_READS, 1);
+    if (got > 0) {
+        METRICS_ADD(METRIC_BYTES_READ, (uint64_t)got);
+    }
+    return got;
+}
+
+ssize_t devPread(int fd, void *buf, size_t length, off_t offset) {
+    throttleReads(length, 1);
+    METRICS_TIME_START(start);
+    ssize_t got;
+    if (devIsDirect(fd)) {
+        got = directPread(fd, directAlign[fd], buf, length, offset);
+    } else {
+        got = cachedRead(fd, buf, length, offset);
+        if (got < 0) {
+            got = pread(fd, buf, length, offset);
+        } else if (got > 0 && (size_t)got < length) {
+            ssize_t rest = pread(fd, (char *)buf + got, length - (size_t)got,
+                                 offset + got);
+            if (rest > 0) {
+                got += rest;
+            }
+        }
+    }
+    METRICS_TIME_END(STAGE_READ, start);
+    METRICS_ADD(METRIC_READS, 1);
+    if (got > 0) {
+        METRICS_ADD(METRIC_BYTES_READ, (uint64_t)got);
+    }
+    return got;
+}
+
+off_t devSeek(int fd, off_t offset, int whence) {
+    METRICS_ADD(METRIC_SEEKS, 1);
+    return lseek(fd, offset, whence);
+}
@@ -0,0 +1,106 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared device I/O
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++. Link
+// with -pthread.
+//
+// Every read and seek against the opened device goes through these
+// wrappers, so instrumentation (and anything else that has to see all
+// device I/O) lives in one place.
+//
+// Devices opened with `devOpen(path, true)` bypass the page cache
+// (O_DIRECT), so full-volume sweeps don't evict everything else cached on
+// the machine. Direct reads need aligned buffers, offsets and lengths:
+// reads through these wrappers that aren't aligned go through a bounce
+// buffer, so callers only have to align their bulk reads (with buffers from
+// `devBufferAlloc`) to avoid the copy.
+//
+// `devPreadBatch` issues many small reads at scattered offsets (boot sectors
+// of every partition, say) with one io_uring submission instead of one
+// syscall each, falling back to plain preads where io_uring isn't allowed.
+//
+// Reads can be throttled, for scans of disks that are still serving
+// traffic: every read first draws from process-wide token buckets of bytes
+// and reads per second, and can be put in the idle I/O scheduling class so
+// the kernel serves any other load on the disk first. The limits can be
+// changed while a scan runs through a control file.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_DEVIO_H_
+#define SUMMER_NTFS_PROJECT_COMMON_DEVIO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define DEV_DIRECT_ALIGN 4096 // buffer alignment; enough for any device
+#define DEV_BATCH_DEPTH 64    // reads in flight per batch submission
+#define DEV_PRIORITY_NORMAL 0 // scheduler's default for our nice level
+#define DEV_PRIORITY_IDLE 1   // served only when the disk is otherwise idle
+
+// Structures
+typedef struct {
+    void *Buffer;
+    size_t Length;
+    off_t Offset;
+    ssize_t Result; // bytes read, or -errno
+} DevRead;
+
+typedef struct {
+    uint64_t BytesPerSecond; // 0 for no limit
+    uint64_t ReadsPerSecond; // 0 for no limit
+    int Priority;            // DEV_PRIORITY_*
+} DevThrottle;
+
+// Function prototypes
+
+// Open a device read-only, bypassing the page cache if `direct` is set and
+// the device or filesystem supports it. Close with `devClose`
+int devOpen(const char *path, bool direct);
+int devClose(int fd);
+bool devIsDirect(int fd); // opened with O_DIRECT
+
+ssize_t devRead(int fd, void *, size_t);
+ssize_t devPread(int fd, void *, size_t, off_t);
+off_t devSeek(int fd, off_t, int whence);
+
+// Issue every read in `reads` at once. Each read's outcome lands in its
+// `Result`
+void devPreadBatch(int fd, DevRead *reads, size_t count);
+
+// Current throttle settings, and new ones, applied to every thread's next
+// read
+void devGetThrottle(DevThrottle *);
+void devSetThrottle(const DevThrottle *);
+
+// Set one throttle setting from text: "rate" (bytes per second, with an
+// optional K, M or G binary suffix), "iops" or "priority" ("idle" or
+// "normal"). Returns false if the key or value isn't valid
+bool devParseThrottle(DevThrottle *, const char *key, const char *value);
+
+// Byte count from text, with an optional K, M or G binary suffix. Returns
+// false if it isn't one
+bool devParseSize(const char *, uint64_t *);
+
+// Take throttle settings from `path`, one "key value" line each (see
+// `devParseThrottle`; # starts a comment), now and again whenever the file
+// changes or the process gets SIGHUP. Settings the file doesn't mention
+// keep the values they had when watching started. Returns false if the file
+// exists but is malformed; a malformed edit later on is ignored
+bool devWatchThrottle(const char *path);
+
+// Buffers aligned to DEV_DIRECT_ALIGN, recycled through a thread-safe pool.
+// `devBufferFree` takes the size the buffer was allocated with
+void *devBufferAlloc(size_t size);
+void devBufferFree(void *, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
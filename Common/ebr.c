@@ -0,0 +1,151 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared extended partition (EBR chain) walker
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
+#define _POSIX_C_SOURCE 200809L
+
+#include "ebr.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "devio.h"
+#include "metrics.h"
+
+// Constants
+#define EBR_TABLE_OFFSET 446
+#define EBR_TYPE_OFFSET 4
+#define EBR_START_OFFSET 8
+
+// Sectors read ahead of the chain, reused until a link leaves them
+typedef struct {
+    unsigned char Data[EBR_PREFETCH_SECTORS * EBR_SECTOR_SIZE];
+    uint64_t LBA;   // first sector held
+    size_t Sectors; // sectors held
+} Window;
+
+static uint32_t le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+// Sector `lba`, from the window if it's there, otherwise from a fresh read
+// that starts at `lba`. Returns NULL with `*status` set on failure
+static const unsigned char *sectorAt(int fd, Window *window, uint64_t lba,
+                                     int *status) {
+    if (lba < window->LBA || lba >= window->LBA + window->Sectors) {
+        ssize_t got = devPread(fd, window->Data, sizeof(window->Data),
+                               (off_t)(lba * EBR_SECTOR_SIZE));
+        window->LBA = lba;
+        window->Sectors = got > 0 ? (size_t)got / EBR_SECTOR_SIZE : 0;
+        if (got < 0) {
+            *status = EBR_READ_ERROR;
+            return NULL;
+        }
+        if (window->Sectors == 0) {
+            *status = EBR_OK; // past the end of the disk
+            return NULL;
+        }
+    } else {
+        METRICS_ADD(METRIC_CACHE_HITS, 1);
+    }
+    return window->Data + (lba - window->LBA) * EBR_SECTOR_SIZE;
+}
+
+static bool visited(const uint64_t *lbas, size_t count, uint64_t lba) {
+    for (size_t i = 0; i < count; ++i) {
+        if (lbas[i] == lba) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ebrWalk(int fd, uint64_t extendedLBA, EBRChain *chain) {
+    memset(chain, 0, sizeof(EBRChain));
+    Window *window = malloc(sizeof(Window));
+    uint64_t *links = malloc(sizeof(uint64_t) * EBR_MAX_LINKS);
+    chain->Entries = malloc(EBR_ENTRY_SIZE * EBR_MAX_LINKS);
+    chain->EBRLBAs = malloc(sizeof(uint64_t) * EBR_MAX_LINKS);
+    if (window == NULL || links == NULL || chain->Entries == NULL ||
+        chain->EBRLBAs == NULL) {
+        free(window);
+        free(links);
+        ebrFree(chain);
+        return EBR_READ_ERROR;
+    }
+    window->Sectors = 0;
+
+    int status = EBR_OK;
+    uint64_t lba = extendedLBA;
+    chain->End = EBR_END_TOO_LONG;
+    while (chain->Links < EBR_MAX_LINKS) {
+        if (visited(links, chain->Links, lba)) {
+            chain->End = EBR_END_LOOP;
+            break;
+        }
+        const unsigned char *ebr = sectorAt(fd, window, lba, &status);
+        if (ebr == NULL || ebr[510] != 0x55 || ebr[511] != 0xAA) {
+            chain->End = EBR_END_BAD_LINK;
+            break;
+        }
+        links[chain->Links++] = lba;
+
+        // First entry: the logical partition, relative to this EBR
+        const unsigned char *logical = ebr + EBR_TABLE_OFFSET;
+        uint64_t start = lba + le32(logical + EBR_START_OFFSET);
+        if (logical[EBR_TYPE_OFFSET] != 0x00 &&
+            !ebrIsExtendedType(logical[EBR_TYPE_OFFSET]) &&
+            start <= 0xFFFFFFFFU) {
+            unsigned char *entry = chain->Entries[chain->Count];
+            memcpy(entry, logical, EBR_ENTRY_SIZE);
+            entry[EBR_START_OFFSET] = (unsigned char)start;
+            entry[EBR_START_OFFSET + 1] = (unsigned char)(start >> 8);
+            entry[EBR_START_OFFSET + 2] = (unsigned char)(start >> 16);
+            entry[EBR_START_OFFSET + 3] = (unsigned char)(start >> 24);
+            chain->EBRLBAs[chain->Count++] = lba;
+        }
+
+        // Second entry: the next EBR, relative to the extended partition
+        const unsigned char *next = logical + EBR_ENTRY_SIZE;
+        if (!ebrIsExtendedType(next[EBR_TYPE_OFFSET])) {
+            chain->End = EBR_END_CHAIN;
+            break;
+        }
+        lba = extendedLBA + le32(next + EBR_START_OFFSET);
+    }
+
+    free(window);
+    free(links);
+    if (status != EBR_OK) {
+        ebrFree(chain);
+    }
+    return status;
+}
+
+void ebrFree(EBRChain *chain) {
+    free(chain->Entries);
+    free(chain->EBRLBAs);
+    chain->Entries = NULL;
+    chain->EBRLBAs = NULL;
+    chain->Count = 0;
+}
+
+bool ebrIsExtendedType(unsigned char type) {
+    return type == 0x05 || type == 0x0F || type == 0x85;
+}
+
+const char *ebrEndMessage(int end) {
+    switch (end) {
+    case EBR_END_CHAIN:
+        return "end of chain";
+    case EBR_END_LOOP:
+        return "loop detected";
+    case EBR_END_BAD_LINK:
+        return "link to an invalid EBR";
+    default:
+        return "too many links";
+    }
+}
@@ -0,0 +1,65 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared extended partition (EBR chain) walker
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// Logical partitions live in a linked list of extended boot records inside
+// an MBR extended partition. Each EBR holds one logical partition entry,
+// relative to the EBR itself, and a link to the next EBR, relative to the
+// start of the extended partition. Every link is a dependent read, so each
+// read fetches EBR_PREFETCH_SECTORS sectors and later links that land inside
+// that window are served from memory.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_EBR_H_
+#define SUMMER_NTFS_PROJECT_COMMON_EBR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define EBR_SECTOR_SIZE 512
+#define EBR_ENTRY_SIZE 16          // same layout as an MBR partition entry
+#define EBR_PREFETCH_SECTORS 64    // sectors fetched per read
+#define EBR_MAX_LINKS 4096         // longest chain followed
+
+// `ebrWalk` results
+#define EBR_OK 0
+#define EBR_READ_ERROR -1 // a read failed; errno is set
+
+// Why a walk stopped
+#define EBR_END_CHAIN 0    // last EBR had no link
+#define EBR_END_LOOP 1     // a link pointed back into the chain
+#define EBR_END_BAD_LINK 2 // a link led to something that isn't an EBR
+#define EBR_END_TOO_LONG 3 // EBR_MAX_LINKS reached
+
+// Structures
+typedef struct {
+    // Logical partition entries, rewritten so the starting sector (bytes
+    // 8-11) is absolute, like a primary entry's
+    unsigned char (*Entries)[EBR_ENTRY_SIZE];
+    uint64_t *EBRLBAs; // LBA of the EBR each entry came from
+    size_t Count;
+    size_t Links; // EBRs visited
+    int End;      // EBR_END_*
+} EBRChain;
+
+// Function prototypes
+
+// Walk the chain of the extended partition starting at `extendedLBA`. On
+// EBR_OK, free with `ebrFree`.
+int ebrWalk(int fd, uint64_t extendedLBA, EBRChain *);
+void ebrFree(EBRChain *);
+
+bool ebrIsExtendedType(unsigned char type); // 0x05, 0x0F or 0x85
+const char *ebrEndMessage(int end);         // "loop detected", ...
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,326 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared batch ("fleet") runner
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
+#define _POSIX_C_SOURCE 200809L
+
+#include "fleet.h"
+
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Constants
+#define FLEET_COPY_SIZE (1 << 16) // bytes moved per read when merging
+
+// Job states
+#define JOB_PENDING 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+
+// Structures
+typedef struct {
+    const char *Path;
+    size_t Device; // index into the device table
+    int State;     // JOB_*
+    int Status;    // work's return value
+    OutBuf *Outs;  // spill buffers, one per stream
+    FILE **Spills; // backing temp files, NULL where output stayed in memory
+} Job;
+
+typedef struct {
+    dev_t ID;
+    bool Known;      // false for paths that couldn't be stat'ed
+    unsigned Active; // jobs running against it
+} Device;
+
+typedef struct {
+    Job *Jobs;
+    size_t JobCount;
+    Device *Devices;
+    size_t DeviceCount;
+    size_t NextMerge; // first job not yet copied out; moved under both locks
+    const FleetOptions *Options;
+    FleetWork Work;
+    void *Context;
+    OutBuf *Outs;
+    size_t Streams;
+    pthread_mutex_t Lock;   // job states and device counts
+    pthread_mutex_t Merge;  // taken before Lock, held while copying output
+    pthread_cond_t Changed; // a job finished
+} Fleet;
+
+// Paths
+
+static bool addPath(FleetPaths *paths, const char *path) {
+    if (paths->Count == paths->Capacity) {
+        size_t capacity = paths->Capacity ? paths->Capacity * 2 : 16;
+        char **grown = realloc(paths->Paths, sizeof(char *) * capacity);
+        if (grown == NULL) {
+            return false;
+        }
+        paths->Paths = grown;
+        paths->Capacity = capacity;
+    }
+    size_t length = strlen(path);
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy, path, length + 1);
+    paths->Paths[paths->Count++] = copy;
+    return true;
+}
+
+bool fleetAddPattern(FleetPaths *paths, const char *pattern) {
+    glob_t matches;
+    if (glob(pattern, GLOB_NOCHECK, NULL, &matches) != 0) {
+        return addPath(paths, pattern);
+    }
+    bool ok = true;
+    for (size_t i = 0; i < matches.gl_pathc && ok; ++i) {
+        ok = addPath(paths, matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+    return ok;
+}
+
+bool fleetAddList(FleetPaths *paths, const char *file) {
+    FILE *list = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+    if (list == NULL) {
+        return false;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    bool ok = true;
+    while (ok && (length = getline(&line, &capacity, list)) >= 0) {
+        while (length > 0 &&
+               (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0) {
+            ok = fleetAddPattern(paths, line);
+        }
+    }
+    free(line);
+    if (list != stdin) {
+        fclose(list);
+    }
+    return ok;
+}
+
+void fleetFreePaths(FleetPaths *paths) {
+    for (size_t i = 0; i < paths->Count; ++i) {
+        free(paths->Paths[i]);
+    }
+    free(paths->Paths);
+    paths->Paths = NULL;
+    paths->Count = 0;
+    paths->Capacity = 0;
+}
+
+// Scheduling
+
+// Device table slot for `path`: the block device itself, or the device of
+// the filesystem an image file lives on
+static size_t deviceOf(Fleet *fleet, const char *path) {
+    struct stat st;
+    Device device = {0, false, 0};
+    if (stat(path, &st) == 0) {
+        device.ID = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+        device.Known = true;
+        for (size_t i = 0; i < fleet->DeviceCount; ++i) {
+            if (fleet->Devices[i].Known && fleet->Devices[i].ID == device.ID) {
+                return i;
+            }
+        }
+    }
+    fleet->Devices[fleet->DeviceCount] = device;
+    return fleet->DeviceCount++;
+}
+
+// First pending job whose device has room, or NULL. `*pending` tells
+// whether any job is still waiting at all
+static Job *nextJob(Fleet *fleet, bool *pending) {
+    *pending = false;
+    for (size_t i = fleet->NextMerge; i < fleet->JobCount; ++i) {
+        Job *job = &fleet->Jobs[i];
+        if (job->State != JOB_PENDING) {
+            continue;
+        }
+        *pending = true;
+        Device *device = &fleet->Devices[job->Device];
+        if (!device->Known || device->Active < fleet->Options->PerDevice) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// Copy a finished job's output to the real streams and release it
+static void mergeJob(Fleet *fleet, Job *job) {
+    for (size_t s = 0; s < fleet->Streams; ++s) {
+        OutBuf *spill = &job->Outs[s];
+        if (job->Spills[s] == NULL) {
+            outBufWrite(&fleet->Outs[s], spill->Data, spill->Length);
+        } else {
+            int fd = fileno(job->Spills[s]);
+            char buffer[FLEET_COPY_SIZE];
+            ssize_t got;
+            lseek(fd, 0, SEEK_SET);
+            while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+                outBufWrite(&fleet->Outs[s], buffer, (size_t)got);
+            }
+            fclose(job->Spills[s]);
+        }
+        free(spill->Data);
+        outBufFlush(&fleet->Outs[s]);
+    }
+    free(job->Outs);
+    free(job->Spills);
+    job->Outs = NULL;
+    job->Spills = NULL;
+}
+
+static bool runJob(Fleet *fleet, Job *job) {
+    job->Outs = calloc(fleet->Streams, sizeof(OutBuf));
+    job->Spills = calloc(fleet->Streams, sizeof(FILE *));
+    if (job->Outs == NULL || job->Spills == NULL) {
+        free(job->Outs);
+        free(job->Spills);
+        job->Outs = NULL;
+        job->Spills = NULL;
+        return false;
+    }
+
+    // Output spills to an unlinked temp file, so images waiting for their
+    // turn to be merged don't hold whole listings in memory
+    for (size_t s = 0; s < fleet->Streams; ++s) {
+        job->Spills[s] = tmpfile();
+        int fd = job->Spills[s] != NULL ? fileno(job->Spills[s]) : -1;
+        if (!outBufInit(&job->Outs[s], fd, OUTBUF_DEFAULT_CAPACITY)) {
+            return false;
+        }
+    }
+    job->Status = fleet->Work(job->Path, job->Outs, fleet->Context);
+    for (size_t s = 0; s < fleet->Streams; ++s) {
+        outBufFlush(&job->Outs[s]);
+    }
+    return true;
+}
+
+static void *worker(void *arg) {
+    Fleet *fleet = (Fleet *)arg;
+    pthread_mutex_lock(&fleet->Lock);
+    for (;;) {
+        bool pending;
+        Job *job = nextJob(fleet, &pending);
+        if (job == NULL) {
+            if (!pending) {
+                break;
+            }
+            pthread_cond_wait(&fleet->Changed, &fleet->Lock);
+            continue;
+        }
+        job->State = JOB_RUNNING;
+        ++fleet->Devices[job->Device].Active;
+        pthread_mutex_unlock(&fleet->Lock);
+
+        bool ran = runJob(fleet, job);
+
+        pthread_mutex_lock(&fleet->Lock);
+        if (!ran) {
+            job->Status = FLEET_ERROR;
+        }
+        --fleet->Devices[job->Device].Active;
+        job->State = JOB_DONE;
+        pthread_cond_broadcast(&fleet->Changed);
+        pthread_mutex_unlock(&fleet->Lock);
+
+        // Copy out every job finished in order so far. Only the Merge
+        // holder takes jobs off the front, which keeps the output in order,
+        // and Lock is held just long enough to check each job's state, so
+        // the other workers keep scheduling while a long listing is copied
+        pthread_mutex_lock(&fleet->Merge);
+        for (;;) {
+            pthread_mutex_lock(&fleet->Lock);
+            Job *done = NULL;
+            if (fleet->NextMerge < fleet->JobCount &&
+                fleet->Jobs[fleet->NextMerge].State == JOB_DONE) {
+                done = &fleet->Jobs[fleet->NextMerge++];
+            }
+            pthread_mutex_unlock(&fleet->Lock);
+            if (done == NULL) {
+                break;
+            }
+            if (done->Outs != NULL) {
+                mergeJob(fleet, done);
+            }
+        }
+        pthread_mutex_unlock(&fleet->Merge);
+        pthread_mutex_lock(&fleet->Lock);
+    }
+    pthread_mutex_unlock(&fleet->Lock);
+    return NULL;
+}
+
+int fleetRun(const FleetPaths *paths, const FleetOptions *options,
+             FleetWork work, void *context, OutBuf *outs, size_t streams) {
+    Fleet fleet;
+    memset(&fleet, 0, sizeof(Fleet));
+    fleet.JobCount = paths->Count;
+    fleet.Jobs = calloc(paths->Count, sizeof(Job));
+    fleet.Devices = calloc(paths->Count, sizeof(Device));
+    if (fleet.Jobs == NULL || fleet.Devices == NULL) {
+        free(fleet.Jobs);
+        free(fleet.Devices);
+        return FLEET_ERROR;
+    }
+    fleet.Options = options;
+    fleet.Work = work;
+    fleet.Context = context;
+    fleet.Outs = outs;
+    fleet.Streams = streams;
+    pthread_mutex_init(&fleet.Lock, NULL);
+    pthread_mutex_init(&fleet.Merge, NULL);
+    pthread_cond_init(&fleet.Changed, NULL);
+    for (size_t i = 0; i < paths->Count; ++i) {
+        fleet.Jobs[i].Path = paths->Paths[i];
+        fleet.Jobs[i].Device = deviceOf(&fleet, paths->Paths[i]);
+    }
+
+    // The calling thread is one of the workers
+    size_t workers = options->Workers > 0 ? options->Workers : 1;
+    if (workers > paths->Count) {
+        workers = paths->Count;
+    }
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    size_t started = 0;
+    while (threads != NULL && started + 1 < workers &&
+           pthread_create(&threads[started], NULL, worker, &fleet) == 0) {
+        ++started;
+    }
+    worker(&fleet);
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    int status = 0;
+    for (size_t i = 0; i < paths->Count && status == 0; ++i) {
+        status = fleet.Jobs[i].Status;
+    }
+    pthread_cond_destroy(&fleet.Changed);
+    pthread_mutex_destroy(&fleet.Merge);
+    pthread_mutex_destroy(&fleet.Lock);
+    free(fleet.Jobs);
+    free(fleet.Devices);
+    return status;
+}
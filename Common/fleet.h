@@ -0,0 +1,69 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared batch ("fleet") runner
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++. Link
+// with -pthread.
+//
+// Runs one program's work over many disk images in a single process. A
+// bounded pool of workers picks images in order, but never has more than
+// `PerDevice` images open on the same underlying device, so images stored
+// on one disk don't thrash it while other disks sit idle. Each image writes
+// into its own spill buffers, which are copied to the real output streams
+// strictly in input order, so the merged output is the same as running the
+// images one after another.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_FLEET_H_
+#define SUMMER_NTFS_PROJECT_COMMON_FLEET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "outbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define FLEET_DEFAULT_PER_DEVICE 2 // images read at once from one device
+#define FLEET_ERROR 71 // out of memory setting up a run; sysexits' EX_OSERR
+
+// Structures
+typedef struct {
+    unsigned Workers;   // images processed at once
+    unsigned PerDevice; // images processed at once per underlying device
+} FleetOptions;
+
+typedef struct {
+    char **Paths; // owned
+    size_t Count;
+    size_t Capacity;
+} FleetPaths;
+
+// Work for one image: write to `outs` (one per output stream) and return
+// the image's exit status
+typedef int (*FleetWork)(const char *path, OutBuf *outs, void *context);
+
+// Function prototypes
+
+// Add the paths matching a glob pattern, or the pattern itself if nothing
+// matches (so plain paths and missing files pass through)
+bool fleetAddPattern(FleetPaths *, const char *pattern);
+
+// Add the paths or patterns listed one per line in `file` ("-" for stdin)
+bool fleetAddList(FleetPaths *, const char *file);
+
+void fleetFreePaths(FleetPaths *);
+
+// Run `work` over every path, merging each image's `streams` outputs into
+// `outs` in path order. Returns the first non-zero status in path order, or
+// 0 if every image succeeded. An image that couldn't be set up, or a run
+// that couldn't start at all, gets FLEET_ERROR.
+int fleetRun(const FleetPaths *, const FleetOptions *, FleetWork,
+             void *context, OutBuf *outs, size_t streams);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
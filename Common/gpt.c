@@ -0,0 +1,310 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared GUID Partition Table reader
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
+#define _POSIX_C_SOURCE 200809L
+
+#include "gpt.h"
+
+#include <errno.h>
+#include <linux/fs.h> // BLKGETSIZE64
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "crc32.h"
+#include "devio.h"
+
+// Constants
+#define GPT_SIGNATURE "EFI PART"
+#define GPT_HEADER_MIN_SIZE 92
+#define GPT_WINDOW_SECTORS 33 // header plus a standard 16 KiB entry array
+#define GPT_MAX_ENTRIES_SIZE (4 * 1024 * 1024) // sanity cap on the array
+
+// Header fields
+#define GPT_HEADER_SIZE_OFFSET 0x0C
+#define GPT_HEADER_CRC_OFFSET 0x10
+#define GPT_MY_LBA_OFFSET 0x18
+#define GPT_ALTERNATE_LBA_OFFSET 0x20
+#define GPT_FIRST_USABLE_OFFSET 0x28
+#define GPT_LAST_USABLE_OFFSET 0x30
+#define GPT_DISK_GUID_OFFSET 0x38
+#define GPT_ENTRIES_LBA_OFFSET 0x48
+#define GPT_ENTRY_COUNT_OFFSET 0x50
+#define GPT_ENTRY_SIZE_OFFSET 0x54
+#define GPT_ENTRIES_CRC_OFFSET 0x58
+
+// Entry fields
+#define GPT_ENTRY_FIRST_LBA_OFFSET 0x20
+#define GPT_ENTRY_LAST_LBA_OFFSET 0x28
+#define GPT_ENTRY_ATTRIBUTES_OFFSET 0x30
+#define GPT_ATTRIBUTE_LEGACY_BOOTABLE 0x4
+
+// Partition type GUIDs as stored on disk (first three groups little-endian)
+// and their MBR counterparts
+static const struct {
+    unsigned char GUID[16];
+    unsigned char LegacyType;
+    bool NTFS;
+} GPT_TYPES[] = {
+    // Microsoft basic data
+    {{0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44, 0x87, 0xC0, 0x68, 0xB6,
+      0xB7, 0x26, 0x99, 0xC7},
+     0x07,
+     true},
+    // Windows recovery environment
+    {{0xA4, 0xBB, 0x94, 0xDE, 0xD1, 0x06, 0x40, 0x4D, 0xA1, 0x6A, 0xBF, 0xD5,
+      0x01, 0x79, 0xD6, 0xAC},
+     0x27,
+     true},
+    // EFI system partition
+    {{0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11, 0xBA, 0x4B, 0x00, 0xA0,
+      0xC9, 0x3E, 0xC9, 0x3B},
+     0xEF,
+     false},
+    // Microsoft LDM metadata
+    {{0xAA, 0xC8, 0x08, 0x58, 0x8F, 0x7E, 0xE0, 0x42, 0x85, 0xD2, 0xE1, 0xE9,
+      0x04, 0x34, 0xCF, 0xB3},
+     0x42,
+     false},
+    // Microsoft LDM data
+    {{0xA0, 0x60, 0x9B, 0xAF, 0x31, 0x14, 0x62, 0x4F, 0xBC, 0x68, 0x33, 0x11,
+      0x71, 0x4A, 0x69, 0xAD},
+     0x42,
+     false},
+    // Linux filesystem
+    {{0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47, 0x8E, 0x79, 0x3D, 0x69,
+      0xD8, 0x47, 0x7D, 0xE4},
+     0x83,
+     false},
+    // Linux swap
+    {{0x6D, 0xFD, 0x57, 0x06, 0xAB, 0xA4, 0xC4, 0x43, 0x84, 0xE5, 0x09, 0x33,
+      0xC8, 0x4B, 0x4F, 0x4F},
+     0x82,
+     false},
+    // Linux LVM
+    {{0x79, 0xD3, 0xD6, 0xE6, 0x07, 0xF5, 0xC2, 0x44, 0xA2, 0x3C, 0x23, 0x8F,
+      0x2A, 0x3D, 0xF9, 0x28},
+     0x8E,
+     false}};
+#define GPT_TYPE_COUNT (sizeof(GPT_TYPES) / sizeof(GPT_TYPES[0]))
+
+static uint32_t le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static uint64_t le64(const unsigned char *p) {
+    return (uint64_t)le32(p + 4) << 32 | le32(p);
+}
+
+// Header checks that don't need the entry array
+static bool headerValid(const unsigned char *header, uint64_t lba) {
+    if (memcmp(header, GPT_SIGNATURE, 8) != 0) {
+        return false;
+    }
+    uint32_t size = le32(header + GPT_HEADER_SIZE_OFFSET);
+    if (size < GPT_HEADER_MIN_SIZE || size > GPT_SECTOR_SIZE) {
+        return false;
+    }
+
+    // The CRC covers the header with its own CRC field zeroed
+    unsigned char copy[GPT_SECTOR_SIZE];
+    memcpy(copy, header, size);
+    memset(copy + GPT_HEADER_CRC_OFFSET, 0, 4);
+    if (crc32Update(0, copy, size) != le32(header + GPT_HEADER_CRC_OFFSET)) {
+        return false;
+    }
+
+    uint32_t entrySize = le32(header + GPT_ENTRY_SIZE_OFFSET);
+    uint64_t arraySize =
+        (uint64_t)le32(header + GPT_ENTRY_COUNT_OFFSET) * entrySize;
+    return le64(header + GPT_MY_LBA_OFFSET) == lba &&
+           entrySize >= GPT_ENTRY_SIZE && entrySize % 8 == 0 &&
+           arraySize > 0 && arraySize <= GPT_MAX_ENTRIES_SIZE &&
+           le64(header + GPT_FIRST_USABLE_OFFSET) <=
+               le64(header + GPT_LAST_USABLE_OFFSET);
+}
+
+// Disk size in sectors, or 0 if it can't be found
+static uint64_t diskSectors(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return 0;
+    }
+    if (S_ISBLK(st.st_mode)) {
+        uint64_t bytes;
+        if (ioctl(fd, BLKGETSIZE64, &bytes) < 0) {
+            return 0;
+        }
+        return bytes / GPT_SECTOR_SIZE;
+    }
+    return (uint64_t)st.st_size / GPT_SECTOR_SIZE;
+}
+
+// Read one copy of the GPT: `windowSectors` sectors from `windowLBA` in one
+// request, with the header at `headerLBA` somewhere inside the window. If the
+// entry array lies inside the window too, no second read is needed. Sets
+// `*alternate` to the other copy's LBA whenever the header itself is sound
+static int readCopy(int fd, GPT *gpt, uint64_t headerLBA, uint64_t windowLBA,
+                    size_t windowSectors, uint64_t *alternate) {
+    *alternate = 0;
+    unsigned char *window = malloc(windowSectors * GPT_SECTOR_SIZE);
+    if (window == NULL) {
+        return GPT_READ_ERROR;
+    }
+    ssize_t got = devPread(fd, window, windowSectors * GPT_SECTOR_SIZE,
+                           (off_t)(windowLBA * GPT_SECTOR_SIZE));
+    size_t headerOffset = (size_t)(headerLBA - windowLBA) * GPT_SECTOR_SIZE;
+    if (got < 0) {
+        free(window);
+        return GPT_READ_ERROR;
+    }
+    if ((size_t)got < headerOffset + GPT_SECTOR_SIZE ||
+        !headerValid(window + headerOffset, headerLBA)) {
+        free(window);
+        return GPT_CORRUPT;
+    }
+
+    const unsigned char *header = window + headerOffset;
+    *alternate = le64(header + GPT_ALTERNATE_LBA_OFFSET);
+    memcpy(gpt->Header, header, GPT_SECTOR_SIZE);
+    gpt->HeaderLBA = headerLBA;
+    gpt->AlternateLBA = *alternate;
+    gpt->FirstUsableLBA = le64(header + GPT_FIRST_USABLE_OFFSET);
+    gpt->LastUsableLBA = le64(header + GPT_LAST_USABLE_OFFSET);
+    gpt->EntriesLBA = le64(header + GPT_ENTRIES_LBA_OFFSET);
+    memcpy(gpt->DiskGUID, header + GPT_DISK_GUID_OFFSET, 16);
+    gpt->EntryCount = le32(header + GPT_ENTRY_COUNT_OFFSET);
+    gpt->EntrySize = le32(header + GPT_ENTRY_SIZE_OFFSET);
+    uint32_t entriesCRC = le32(header + GPT_ENTRIES_CRC_OFFSET);
+
+    // Entry array: take it from the window if it's all there, otherwise
+    // fetch the whole array in one more request
+    size_t arraySize = (size_t)gpt->EntryCount * gpt->EntrySize;
+    gpt->Entries = malloc(arraySize);
+    if (gpt->Entries == NULL) {
+        free(window);
+        return GPT_READ_ERROR;
+    }
+    if (gpt->EntriesLBA >= windowLBA &&
+        gpt->EntriesLBA - windowLBA <= windowSectors &&
+        (gpt->EntriesLBA - windowLBA) * GPT_SECTOR_SIZE + arraySize <=
+            (uint64_t)got) {
+        memcpy(gpt->Entries,
+               window + (gpt->EntriesLBA - windowLBA) * GPT_SECTOR_SIZE,
+               arraySize);
+    } else {
+        got = devPread(fd, gpt->Entries, arraySize,
+                       (off_t)(gpt->EntriesLBA * GPT_SECTOR_SIZE));
+        if (got < 0 || (size_t)got != arraySize) {
+            int status = got < 0 ? GPT_READ_ERROR : GPT_CORRUPT;
+            free(gpt->Entries);
+            gpt->Entries = NULL;
+            free(window);
+            return status;
+        }
+    }
+    free(window);
+
+    if (crc32Update(0, gpt->Entries, arraySize) != entriesCRC) {
+        free(gpt->Entries);
+        gpt->Entries = NULL;
+        return GPT_CORRUPT;
+    }
+    return GPT_OK;
+}
+
+int gptRead(int fd, GPT *gpt) {
+    memset(gpt, 0, sizeof(GPT));
+
+    // Primary copy: header at LBA 1, entries normally from LBA 2
+    uint64_t alternate;
+    int primary = readCopy(fd, gpt, 1, 1, GPT_WINDOW_SECTORS, &alternate);
+    if (primary == GPT_OK) {
+        return GPT_OK;
+    }
+    int savedErrno = errno;
+
+    // Backup copy: where the primary header says, if it could be trusted
+    // that far, otherwise the last sector of the disk. Its entries normally
+    // sit just before it
+    uint64_t backupLBA = alternate;
+    if (backupLBA <= 1) {
+        uint64_t sectors = diskSectors(fd);
+        if (sectors < 2) {
+            errno = savedErrno;
+            return primary;
+        }
+        backupLBA = sectors - 1;
+    }
+    uint64_t windowLBA = backupLBA > GPT_WINDOW_SECTORS - 1
+                             ? backupLBA - (GPT_WINDOW_SECTORS - 1)
+                             : 1;
+    int backup = readCopy(fd, gpt, backupLBA, windowLBA,
+                          (size_t)(backupLBA - windowLBA + 1), &alternate);
+    if (backup == GPT_OK) {
+        gpt->UsedBackup = true;
+        return GPT_OK;
+    }
+    if (primary == GPT_READ_ERROR && backup != GPT_READ_ERROR) {
+        errno = savedErrno;
+        return GPT_READ_ERROR;
+    }
+    return backup;
+}
+
+void gptFree(GPT *gpt) {
+    free(gpt->Entries);
+    gpt->Entries = NULL;
+}
+
+const unsigned char *gptEntry(const GPT *gpt, uint32_t index) {
+    return gpt->Entries + (size_t)index * gpt->EntrySize;
+}
+
+bool gptEntryUsed(const unsigned char *entry) {
+    for (int i = 0; i < 16; ++i) {
+        if (entry[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool gptIsNTFSType(const unsigned char *entry) {
+    for (size_t i = 0; i < GPT_TYPE_COUNT; ++i) {
+        if (memcmp(entry, GPT_TYPES[i].GUID, 16) == 0) {
+            return GPT_TYPES[i].NTFS;
+        }
+    }
+    return false;
+}
+
+unsigned char gptLegacyType(const unsigned char *entry) {
+    if (!gptEntryUsed(entry)) {
+        return 0x00;
+    }
+    for (size_t i = 0; i < GPT_TYPE_COUNT; ++i) {
+        if (memcmp(entry, GPT_TYPES[i].GUID, 16) == 0) {
+            return GPT_TYPES[i].LegacyType;
+        }
+    }
+    return GPT_LEGACY_UNKNOWN;
+}
+
+uint64_t gptEntryFirstLBA(const unsigned char *entry) {
+    return le64(entry + GPT_ENTRY_FIRST_LBA_OFFSET);
+}
+
+uint64_t gptEntryLastLBA(const unsigned char *entry) {
+    return le64(entry + GPT_ENTRY_LAST_LBA_OFFSET);
+}
+
+bool gptEntryBootable(const unsigned char *entry) {
+    return (le64(entry + GPT_ENTRY_ATTRIBUTES_OFFSET) &
+            GPT_ATTRIBUTE_LEGACY_BOOTABLE) != 0;
+}
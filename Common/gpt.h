@@ -0,0 +1,70 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared GUID Partition Table reader
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// Reads a GPT behind a protective MBR. The header and its partition entry
+// array are fetched together in one request when the array sits next to the
+// header, as it does on every disk partitioned by a mainstream tool, and both
+// are CRC-checked. If the primary copy at LBA 1 is damaged, the backup copy at
+// the end of the disk is used instead.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_GPT_H_
+#define SUMMER_NTFS_PROJECT_COMMON_GPT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define GPT_SECTOR_SIZE 512 // logical sector size
+#define GPT_ENTRY_SIZE 128  // minimum (and usual) partition entry size
+
+// `gptRead` results
+#define GPT_OK 0
+#define GPT_READ_ERROR -1 // a read failed; errno is set
+#define GPT_CORRUPT -2    // neither header (with its entries) checked out
+
+// MBR type byte reported for GPT partition types with no MBR counterpart
+#define GPT_LEGACY_UNKNOWN 0xDA
+
+// Structures
+typedef struct {
+    unsigned char Header[GPT_SECTOR_SIZE]; // header sector that was used
+    uint64_t HeaderLBA;      // LBA of that header
+    uint64_t AlternateLBA;   // LBA of the other copy
+    uint64_t FirstUsableLBA; // first LBA partitions may use
+    uint64_t LastUsableLBA;  // last LBA partitions may use
+    uint64_t EntriesLBA;     // first LBA of the partition entry array
+    unsigned char DiskGUID[16];
+    uint32_t EntryCount; // entries in the array, used or not
+    uint32_t EntrySize;  // bytes per entry, at least GPT_ENTRY_SIZE
+    bool UsedBackup;     // primary copy was damaged
+    unsigned char *Entries; // EntryCount * EntrySize bytes
+} GPT;
+
+// Function prototypes
+
+// Read and verify the GPT on `fd`. On GPT_OK, free with `gptFree`.
+int gptRead(int fd, GPT *);
+void gptFree(GPT *);
+
+// Entry `index` of the array
+const unsigned char *gptEntry(const GPT *, uint32_t index);
+
+// Entry accessors. Each takes one raw entry from the array.
+bool gptEntryUsed(const unsigned char *);   // type GUID isn't all zeros
+bool gptIsNTFSType(const unsigned char *);  // basic data or WinRE partition
+unsigned char gptLegacyType(const unsigned char *); // MBR type equivalent
+uint64_t gptEntryFirstLBA(const unsigned char *);
+uint64_t gptEntryLastLBA(const unsigned char *);
+bool gptEntryBootable(const unsigned char *); // legacy BIOS bootable bit
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
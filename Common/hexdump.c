@@ -0,0 +1,135 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared hex/ASCII dump engine
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#include "hexdump.h"
+
+#include <string.h>
+
+// Constants
+#define BYTES_PER_ROW 16
+
+// "00 01 02 ... FF ": three characters per byte value, built by the
+// preprocessor so there's nothing to initialize at run time
+#define HEX_ROW(h)                                                             \
+    h "0 " h "1 " h "2 " h "3 " h "4 " h "5 " h "6 " h "7 " h "8 " h "9 " h    \
+      "A " h "B " h "C " h "D " h "E " h "F "
+static const char HEX_CELLS[] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4")
+        HEX_ROW("5") HEX_ROW("6") HEX_ROW("7") HEX_ROW("8") HEX_ROW("9")
+            HEX_ROW("A") HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E")
+                HEX_ROW("F");
+
+// Layouts
+static const DumpField MBR_FIELDS[] = {
+    {0x000, 440, "boot code"},         {0x1B8, 4, "disk signature"},
+    {0x1BC, 2, "reserved"},            {0x1BE, 16, "partition entry 1"},
+    {0x1CE, 16, "partition entry 2"},  {0x1DE, 16, "partition entry 3"},
+    {0x1EE, 16, "partition entry 4"},  {0x1FE, 2, "boot signature (55 AA)"}};
+const DumpLayout DUMP_LAYOUT_MBR = {MBR_FIELDS,
+                                    sizeof(MBR_FIELDS) / sizeof(DumpField)};
+
+#define PARTITION_ENTRY_FIELDS(base)                                           \
+    {base + 0x0, 1, "boot flag"}, {base + 0x1, 3, "CHS start"},                \
+        {base + 0x4, 1, "type"}, {base + 0x5, 3, "CHS end"},                   \
+        {base + 0x8, 4, "starting LBA"}, {base + 0xC, 4, "sector count"}
+static const DumpField PARTITION_TABLE_FIELDS[] = {
+    PARTITION_ENTRY_FIELDS(0x00), PARTITION_ENTRY_FIELDS(0x10),
+    PARTITION_ENTRY_FIELDS(0x20), PARTITION_ENTRY_FIELDS(0x30)};
+const DumpLayout DUMP_LAYOUT_PARTITION_TABLE = {
+    PARTITION_TABLE_FIELDS, sizeof(PARTITION_TABLE_FIELDS) / sizeof(DumpField)};
+
+static const DumpField NTFS_VBR_FIELDS[] = {
+    {0x00, 3, "jump"},
+    {0x03, 8, "OEM ID"},
+    {0x0B, 2, "bytes/sector"},
+    {0x0D, 1, "sectors/cluster"},
+    {0x0E, 2, "reserved sectors"},
+    {0x15, 1, "media descriptor"},
+    {0x18, 2, "sectors/track"},
+    {0x1A, 2, "heads"},
+    {0x1C, 4, "hidden sectors"},
+    {0x28, 8, "total sectors"},
+    {0x30, 8, "$MFT LCN"},
+    {0x38, 8, "$MFTMirr LCN"},
+    {0x40, 1, "clusters/FILE record"},
+    {0x44, 1, "clusters/index block"},
+    {0x48, 8, "volume serial"},
+    {0x50, 4, "checksum"},
+    {0x54, 426, "boot code"},
+    {0x1FE, 2, "boot signature (55 AA)"}};
+const DumpLayout DUMP_LAYOUT_NTFS_VBR = {
+    NTFS_VBR_FIELDS, sizeof(NTFS_VBR_FIELDS) / sizeof(DumpField)};
+
+static const DumpField FILE_RECORD_FIELDS[] = {
+    {0x00, 4, "signature"},        {0x04, 2, "USA offset"},
+    {0x06, 2, "USA count"},        {0x08, 8, "$LogFile LSN"},
+    {0x10, 2, "sequence"},         {0x12, 2, "link count"},
+    {0x14, 2, "first attribute"},  {0x16, 2, "flags"},
+    {0x18, 4, "bytes in use"},     {0x1C, 4, "bytes allocated"},
+    {0x20, 8, "base record"},      {0x28, 2, "next attribute ID"},
+    {0x2C, 4, "record number"}};
+const DumpLayout DUMP_LAYOUT_FILE_RECORD = {
+    FILE_RECORD_FIELDS, sizeof(FILE_RECORD_FIELDS) / sizeof(DumpField)};
+
+static const DumpField GPT_HEADER_FIELDS[] = {
+    {0x00, 8, "signature (EFI PART)"}, {0x08, 4, "revision"},
+    {0x0C, 4, "header size"},          {0x10, 4, "header CRC32"},
+    {0x18, 8, "this LBA"},             {0x20, 8, "alternate LBA"},
+    {0x28, 8, "first usable LBA"},     {0x30, 8, "last usable LBA"},
+    {0x38, 16, "disk GUID"},           {0x48, 8, "entry array LBA"},
+    {0x50, 4, "entry count"},          {0x54, 4, "entry size"},
+    {0x58, 4, "entry array CRC32"}};
+const DumpLayout DUMP_LAYOUT_GPT_HEADER = {
+    GPT_HEADER_FIELDS, sizeof(GPT_HEADER_FIELDS) / sizeof(DumpField)};
+
+static const DumpField GPT_ENTRY_FIELDS[] = {
+    {0x00, 16, "type GUID"},   {0x10, 16, "partition GUID"},
+    {0x20, 8, "first LBA"},    {0x28, 8, "last LBA"},
+    {0x30, 8, "attributes"},   {0x38, 72, "name (UTF-16LE)"}};
+const DumpLayout DUMP_LAYOUT_GPT_ENTRY = {
+    GPT_ENTRY_FIELDS, sizeof(GPT_ENTRY_FIELDS) / sizeof(DumpField)};
+
+void hexDump(OutBuf *out, const unsigned char *data, size_t length,
+             uint64_t address, const DumpLayout *layout) {
+    size_t field = 0;
+    int addressWidth = address + length > 0xFFFFFFFFULL ? 16 : 8;
+
+    for (size_t row = 0; row < length; row += BYTES_PER_ROW) {
+        size_t n = length - row < BYTES_PER_ROW ? length - row : BYTES_PER_ROW;
+
+        // Address column
+        outBufHex(out, address + row, addressWidth, true);
+        outBufWrite(out, "  ", 2);
+
+        // Hex and ASCII columns, filled in one reservation
+        char *p = outBufReserve(out, 3 * BYTES_PER_ROW + 1 + BYTES_PER_ROW + 2);
+        if (p == NULL) {
+            return;
+        }
+        char *ascii = p + 3 * BYTES_PER_ROW + 1;
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char c = data[row + i];
+            memcpy(p + 3 * i, HEX_CELLS + 3 * c, 3);
+            ascii[i] = c >= 0x20 && c < 0x7F ? (char)c : '.';
+        }
+        memset(p + 3 * n, ' ', 3 * (BYTES_PER_ROW - n));
+        p[3 * BYTES_PER_ROW] = '|';
+        ascii[n] = '|';
+        out->Length += 3 * BYTES_PER_ROW + 1 + n + 1;
+
+        // Fields starting in this row
+        if (layout != NULL) {
+            const char *separator = "  ";
+            while (field < layout->Count &&
+                   layout->Fields[field].Offset < row + n) {
+                outBufPuts(out, separator);
+                outBufPuts(out, layout->Fields[field].Name);
+                separator = ", ";
+                ++field;
+            }
+        }
+        outBufPutc(out, '\n');
+    }
+}
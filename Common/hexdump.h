@@ -0,0 +1,53 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared hex/ASCII dump engine
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// Dumps are rendered one 16-byte row at a time from lookup tables straight
+// into an `OutBuf`. Rows can be annotated with the names of the on-disk
+// fields that start in them, from a `DumpLayout`.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_HEXDUMP_H_
+#define SUMMER_NTFS_PROJECT_COMMON_HEXDUMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Structures
+typedef struct {
+    size_t Offset;    // field offset from the start of the structure
+    size_t Length;    // field length, in bytes
+    const char *Name; // annotation
+} DumpField;
+
+typedef struct {
+    const DumpField *Fields; // sorted by offset
+    size_t Count;
+} DumpLayout;
+
+// Known layouts
+extern const DumpLayout DUMP_LAYOUT_MBR;             // whole MBR sector
+extern const DumpLayout DUMP_LAYOUT_PARTITION_TABLE; // 64-byte table
+extern const DumpLayout DUMP_LAYOUT_NTFS_VBR;        // NTFS boot sector/BPB
+extern const DumpLayout DUMP_LAYOUT_FILE_RECORD;     // FILE record header
+extern const DumpLayout DUMP_LAYOUT_GPT_HEADER;      // GPT header sector
+extern const DumpLayout DUMP_LAYOUT_GPT_ENTRY;       // one GPT entry
+
+// Function prototypes
+
+// Dump `length` bytes as "address  hex  |ascii|  fields" rows. `address` is
+// printed for the first byte; `layout` may be NULL for a plain dump.
+void hexDump(OutBuf *, const unsigned char *, size_t length, uint64_t address,
+             const DumpLayout *layout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared stage instrumentation
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "metrics.h"
+
+#include <string.h>
+#include <time.h>
+
+// Constants
+#define HISTOGRAM_BUCKETS 64 // bucket i holds latencies below 2^i ns
+
+// Structures
+typedef struct {
+    uint64_t Count;
+    uint64_t Total; // nanoseconds
+    uint64_t Max;   // nanoseconds
+    uint64_t Buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+// Process-wide state
+static uint64_t counters[METRIC_COUNTER_COUNT];
+static Histogram stages[STAGE_COUNT];
+
+static const char *const COUNTER_NAMES[METRIC_COUNTER_COUNT] = {
+    "reads",           "seeks",           "bytes_read",
+    "records_parsed",  "records_rejected", "fixup_failures",
+    "cache_hits",      "records_partial"};
+static const char *const STAGE_NAMES[STAGE_COUNT] = {"read", "parse", "emit",
+                                                     "throttle"};
+
+void metricsAdd(MetricCounter counter, uint64_t n) {
+    __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+uint64_t metricsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void metricsRecord(MetricStage stage, uint64_t nanoseconds) {
+    Histogram *h = &stages[stage];
+    int bucket = nanoseconds ? 64 - __builtin_clzll(nanoseconds) : 0;
+    if (bucket >= HISTOGRAM_BUCKETS) {
+        bucket = HISTOGRAM_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&h->Count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->Total, nanoseconds, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->Buckets[bucket], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&h->Max, __ATOMIC_RELAXED);
+    while (nanoseconds > max &&
+           !__atomic_compare_exchange_n(&h->Max, &max, nanoseconds, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Upper bound of the bucket holding the given percentile
+static uint64_t percentile(const Histogram *h, unsigned percent) {
+    uint64_t rank = (h->Count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->Buckets[i];
+        if (seen >= rank && seen > 0) {
+            uint64_t bound = i == 0 ? 0 : (i < 64 ? 1ULL << i : UINT64_MAX);
+            return bound < h->Max ? bound : h->Max;
+        }
+    }
+    return h->Max;
+}
+
+// Right-aligned unsigned column
+static void printColumn(OutBuf *out, uint64_t value, int width) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (int i = n; i < width; ++i) {
+        outBufPutc(out, ' ');
+    }
+    while (n > 0) {
+        outBufPutc(out, digits[--n]);
+    }
+}
+
+void metricsPrint(OutBuf *out) {
+    outBufPuts(out, "Counters:\n");
+    for (int i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        outBufPuts(out, "  ");
+        outBufPuts(out, COUNTER_NAMES[i]);
+        printColumn(out, __atomic_load_n(&counters[i], __ATOMIC_RELAXED),
+                    (int)(24 - strlen(COUNTER_NAMES[i])));
+        outBufPutc(out, '\n');
+    }
+
+    outBufPuts(out, "Stage latency (ns):      count         mean          p50"
+                    "          p90          p99          max\n");
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        const Histogram *h = &stages[i];
+        outBufPuts(out, "  ");
+        outBufPuts(out, STAGE_NAMES[i]);
+        printColumn(out, h->Count, (int)(27 - strlen(STAGE_NAMES[i])));
+        printColumn(out, h->Count ? h->Total / h->Count : 0, 13);
+        printColumn(out, percentile(h, 50), 13);
+        printColumn(out, percentile(h, 90), 13);
+        printColumn(out, percentile(h, 99), 13);
+        printColumn(out, h->Max, 13);
+        outBufPutc(out, '\n');
+    }
+}
+
+void metricsPrintJSON(OutBuf *out) {
+    outBufPuts(out, "{\"counters\":{");
+    for (int i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        if (i > 0) {
+            outBufPutc(out, ',');
+        }
+        outBufPutc(out, '"');
+        outBufPuts(out, COUNTER_NAMES[i]);
+        outBufWrite(out, "\":", 2);
+        outBufU64(out, __atomic_load_n(&counters[i], __ATOMIC_RELAXED));
+    }
+
+    outBufPuts(out, "},\"stages\":{");
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        const Histogram *h = &stages[i];
+        if (i > 0) {
+            outBufPutc(out, ',');
+        }
+        outBufPutc(out, '"');
+        outBufPuts(out, STAGE_NAMES[i]);
+        outBufPuts(out, "\":{\"count\":");
+        outBufU64(out, h->Count);
+        outBufPuts(out, ",\"total_ns\":");
+        outBufU64(out, h->Total);
+        outBufPuts(out, ",\"max_ns\":");
+        outBufU64(out, h->Max);
+        outBufPuts(out, ",\"p50_ns\":");
+        outBufU64(out, percentile(h, 50));
+        outBufPuts(out, ",\"p99_ns\":");
+        outBufU64(out, percentile(h, 99));
+
+        // Histogram as sparse {"below_ns": count} pairs
+        outBufPuts(out, ",\"buckets\":{");
+        const char *separator = "";
+        for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+            if (h->Buckets[b] == 0) {
+                continue;
+            }
+            outBufPuts(out, separator);
+            outBufPutc(out, '"');
+            outBufU64(out, b == 0 ? 1 : 1ULL << b);
+            outBufWrite(out, "\":", 2);
+            outBufU64(out, h->Buckets[b]);
+            separator = ",";
+        }
+        outBufWrite(out, "}}", 2);
+    }
+    outBufWrite(out, "}}\n", 3);
+}
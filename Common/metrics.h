@@ -0,0 +1,66 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared stage instrumentation
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// Process-wide counters and per-stage latency histograms. Updates are
+// relaxed atomic adds, so they're safe from worker threads and cost a few
+// nanoseconds. Compile with -DNTFS_NO_METRICS to remove them entirely.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_METRICS_H_
+#define SUMMER_NTFS_PROJECT_COMMON_METRICS_H_
+
+#include <stdint.h>
+
+#include "outbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counters
+typedef enum {
+    METRIC_READS,            // read requests issued to the device
+    METRIC_SEEKS,            // lseek calls
+    METRIC_BYTES_READ,       // bytes returned by the device
+    METRIC_RECORDS_PARSED,   // FILE records parsed successfully
+    METRIC_RECORDS_REJECTED, // FILE records that failed to parse
+    METRIC_FIXUP_FAILURES,   // FILE records with a torn update sequence
+    METRIC_CACHE_HITS,       // requests served without touching the device
+    METRIC_RECORDS_PARTIAL,  // FILE records with unreadable sectors
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+// Timed stages
+typedef enum {
+    STAGE_READ,     // device reads
+    STAGE_PARSE,    // MBR/VBR/FILE record parsing
+    STAGE_EMIT,     // output formatting
+    STAGE_THROTTLE, // reads held back by I/O throttling
+    STAGE_COUNT
+} MetricStage;
+
+// Function prototypes
+void metricsAdd(MetricCounter, uint64_t);
+uint64_t metricsNow(void); // monotonic clock, in nanoseconds
+void metricsRecord(MetricStage, uint64_t nanoseconds);
+void metricsPrint(OutBuf *);     // human-readable summary
+void metricsPrintJSON(OutBuf *); // one JSON object
+
+// Instrumentation macros, compiled out with NTFS_NO_METRICS
+#ifdef NTFS_NO_METRICS
+#define METRICS_ADD(counter, n) ((void)0)
+#define METRICS_TIME_START(name) ((void)0)
+#define METRICS_TIME_END(stage, name) ((void)0)
+#else
+#define METRICS_ADD(counter, n) metricsAdd((counter), (n))
+#define METRICS_TIME_START(name) uint64_t name = metricsNow()
+#define METRICS_TIME_END(stage, name)                                          \
+    metricsRecord((stage), metricsNow() - (name))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,303 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared buffered output writer
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "outbuf.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Constants
+static const uint64_t FILETIME_PER_SECOND = 10000000; // 100 ns ticks
+static const uint64_t FILETIME_UNIX_EPOCH = 116444736000000000ULL; // 1970-01-01
+
+// Two-digit decimal lookup table ("00" .. "99")
+static const char DIGIT_PAIRS[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+static const char HEX_UPPER[] = "0123456789ABCDEF";
+static const char HEX_LOWER[] = "0123456789abcdef";
+
+// Write the whole of `data` to `fd`, retrying on short writes
+static bool writeAll(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool outBufInit(OutBuf *out, int fd, size_t capacity) {
+    if (capacity == 0) {
+        capacity = OUTBUF_DEFAULT_CAPACITY;
+    }
+    out->Data = (char *)malloc(capacity);
+    out->Length = 0;
+    out->Capacity = out->Data != NULL ? capacity : 0;
+    out->FD = fd;
+    out->Failed = out->Data == NULL;
+    return !out->Failed;
+}
+
+void outBufFree(OutBuf *out) {
+    outBufFlush(out);
+    free(out->Data);
+    out->Data = NULL;
+    out->Length = 0;
+    out->Capacity = 0;
+}
+
+// Hand buffered bytes to the file descriptor. In-memory buffers are left
+// alone
+bool outBufFlush(OutBuf *out) {
+    if (out->FD < 0 || out->Length == 0) {
+        return !out->Failed;
+    }
+    if (!writeAll(out->FD, out->Data, out->Length)) {
+        out->Failed = true;
+    }
+    out->Length = 0;
+    return !out->Failed;
+}
+
+// Make room for `n` more bytes and return where they go. The caller fills
+// them in and bumps `Length`.
+char *outBufReserve(OutBuf *out, size_t n) {
+    if (out->Length + n <= out->Capacity) {
+        return out->Data + out->Length;
+    }
+    if (out->FD >= 0) {
+        outBufFlush(out);
+        if (n <= out->Capacity) {
+            return out->Data;
+        }
+    }
+
+    // Grow: in-memory buffer, or a single item larger than the buffer
+    size_t capacity = out->Capacity ? out->Capacity : OUTBUF_DEFAULT_CAPACITY;
+    while (capacity < out->Length + n) {
+        capacity *= 2;
+    }
+    char *data = (char *)realloc(out->Data, capacity);
+    if (data == NULL) {
+        out->Failed = true;
+        return NULL;
+    }
+    out->Data = data;
+    out->Capacity = capacity;
+    return out->Data + out->Length;
+}
+
+void outBufWrite(OutBuf *out, const void *data, size_t length) {
+    // Large blocks skip the copy
+    if (out->FD >= 0 && length >= out->Capacity) {
+        outBufFlush(out);
+        if (!writeAll(out->FD, (const char *)data, length)) {
+            out->Failed = true;
+        }
+        return;
+    }
+    char *p = outBufReserve(out, length);
+    if (p != NULL) {
+        memcpy(p, data, length);
+        out->Length += length;
+    }
+}
+
+void outBufPutc(OutBuf *out, char c) {
+    char *p = outBufReserve(out, 1);
+    if (p != NULL) {
+        *p = c;
+        ++out->Length;
+    }
+}
+
+void outBufPuts(OutBuf *out, const char *s) { outBufWrite(out, s, strlen(s)); }
+
+// Unsigned decimal, two digits at a time
+void outBufU64(OutBuf *out, uint64_t value) {
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100) {
+        unsigned pair = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        *--p = DIGIT_PAIRS[value * 2 + 1];
+        *--p = DIGIT_PAIRS[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    outBufWrite(out, p, digits + sizeof(digits) - p);
+}
+
+void outBufI64(OutBuf *out, int64_t value) {
+    if (value < 0) {
+        outBufPutc(out, '-');
+        outBufU64(out, (uint64_t)0 - (uint64_t)value);
+    } else {
+        outBufU64(out, (uint64_t)value);
+    }
+}
+
+// Hex, zero-padded to at least `width` digits
+void outBufHex(OutBuf *out, uint64_t value, int width, bool upper) {
+    const char *table = upper ? HEX_UPPER : HEX_LOWER;
+    char digits[16];
+    int n = 0;
+    do {
+        digits[15 - n++] = table[value & 0x0F];
+        value >>= 4;
+    } while (value != 0);
+    while (n < width && n < 16) {
+        digits[15 - n++] = '0';
+    }
+    outBufWrite(out, digits + 16 - n, n);
+}
+
+// Byte string as contiguous hex pairs (digests)
+void outBufHexBytes(OutBuf *out, const unsigned char *bytes, size_t length,
+                    bool upper) {
+    const char *table = upper ? HEX_UPPER : HEX_LOWER;
+    char *p = outBufReserve(out, 2 * length);
+    if (p == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        p[2 * i] = table[bytes[i] >> 4];
+        p[2 * i + 1] = table[bytes[i] & 0x0F];
+    }
+    out->Length += 2 * length;
+}
+
+int64_t fileTimeToUnix(uint64_t filetime) {
+    return ((int64_t)filetime - (int64_t)FILETIME_UNIX_EPOCH) /
+           (int64_t)FILETIME_PER_SECOND;
+}
+
+// FILETIME (100 ns ticks since 1601-01-01) as
+// YYYY-MM-DDTHH:MM:SS.fffffffZ
+void outBufTimestamp(OutBuf *out, uint64_t filetime) {
+    uint64_t seconds = filetime / FILETIME_PER_SECOND;
+    uint64_t fraction = filetime % FILETIME_PER_SECOND;
+    uint64_t secondOfDay = seconds % 86400;
+
+    // Civil date from day count (H. Hinnant's algorithm), shifted so that
+    // day 0 is 0000-03-01
+    int64_t z = (int64_t)(seconds / 86400) + 584694;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    unsigned year = (unsigned)(yoe + era * 400) + (month <= 2);
+
+    char *p = outBufReserve(out, 28);
+    if (p == NULL) {
+        return;
+    }
+    unsigned fields[6] = {year / 100,
+                          year % 100,
+                          month,
+                          day,
+                          (unsigned)(secondOfDay / 3600),
+                          (unsigned)(secondOfDay / 60 % 60)};
+    memcpy(p, DIGIT_PAIRS + fields[0] % 100 * 2, 2);
+    memcpy(p + 2, DIGIT_PAIRS + fields[1] * 2, 2);
+    p[4] = '-';
+    memcpy(p + 5, DIGIT_PAIRS + fields[2] * 2, 2);
+    p[7] = '-';
+    memcpy(p + 8, DIGIT_PAIRS + fields[3] * 2, 2);
+    p[10] = 'T';
+    memcpy(p + 11, DIGIT_PAIRS + fields[4] * 2, 2);
+    p[13] = ':';
+    memcpy(p + 14, DIGIT_PAIRS + fields[5] * 2, 2);
+    p[16] = ':';
+    memcpy(p + 17, DIGIT_PAIRS + secondOfDay % 60 * 2, 2);
+    p[19] = '.';
+    for (int i = 26; i >= 20; --i) {
+        p[i] = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    p[27] = 'Z';
+    out->Length += 28;
+}
+
+// JSON string literal. Bytes >= 0x80 pass through (input is UTF-8)
+void outBufJSONString(OutBuf *out, const char *s, size_t length) {
+    outBufPutc(out, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        outBufWrite(out, s + start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"':
+            outBufWrite(out, "\\\"", 2);
+            break;
+        case '\\':
+            outBufWrite(out, "\\\\", 2);
+            break;
+        case '\n':
+            outBufWrite(out, "\\n", 2);
+            break;
+        case '\r':
+            outBufWrite(out, "\\r", 2);
+            break;
+        case '\t':
+            outBufWrite(out, "\\t", 2);
+            break;
+        default:
+            outBufWrite(out, "\\u00", 4);
+            outBufHex(out, c, 2, false);
+        }
+    }
+    outBufWrite(out, s + start, length - start);
+    outBufPutc(out, '"');
+}
+
+// CSV field, quoted only when it holds a separator, quote or line break
+void outBufCSVField(OutBuf *out, const char *s, size_t length) {
+    if (memchr(s, ',', length) == NULL && memchr(s, '"', length) == NULL &&
+        memchr(s, '\n', length) == NULL && memchr(s, '\r', length) == NULL) {
+        outBufWrite(out, s, length);
+        return;
+    }
+    outBufPutc(out, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (s[i] == '"') {
+            outBufWrite(out, s + start, i + 1 - start); // includes the quote
+            outBufPutc(out, '"');
+            start = i + 1;
+        }
+    }
+    outBufWrite(out, s + start, length - start);
+    outBufPutc(out, '"');
+}
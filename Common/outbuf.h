@@ -0,0 +1,60 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared buffered output writer
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// All program output goes through an `OutBuf`: bytes collect in one large
+// buffer and reach the file descriptor in big `write`s. Numbers, hex and
+// timestamps are formatted by hand straight into the buffer, so no
+// `printf` format parsing happens per item.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_OUTBUF_H_
+#define SUMMER_NTFS_PROJECT_COMMON_OUTBUF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Constants
+#define OUTBUF_DEFAULT_CAPACITY (1 << 20) // bytes buffered before a write
+
+// Structures
+typedef struct {
+    char *Data;      // buffered bytes
+    size_t Length;   // bytes in use
+    size_t Capacity; // bytes allocated
+    int FD;          // destination, or -1 to collect in memory
+    bool Failed;     // a write or allocation has failed
+} OutBuf;
+
+// Function prototypes
+
+// Set up a buffer writing to `fd`. With `fd` < 0, output is kept in memory
+// (and the buffer grows) until the caller takes it from `Data`.
+bool outBufInit(OutBuf *, int fd, size_t capacity);
+void outBufFree(OutBuf *); // flushes, then releases the buffer
+bool outBufFlush(OutBuf *);
+char *outBufReserve(OutBuf *, size_t); // room for n bytes, NULL on failure
+
+void outBufWrite(OutBuf *, const void *, size_t);
+void outBufPutc(OutBuf *, char);
+void outBufPuts(OutBuf *, const char *);
+void outBufU64(OutBuf *, uint64_t);
+void outBufI64(OutBuf *, int64_t);
+void outBufHex(OutBuf *, uint64_t, int width, bool upper); // zero-padded
+void outBufHexBytes(OutBuf *, const unsigned char *, size_t, bool upper);
+void outBufTimestamp(OutBuf *, uint64_t filetime); // ISO 8601, UTC
+void outBufJSONString(OutBuf *, const char *, size_t); // quoted, escaped
+void outBufCSVField(OutBuf *, const char *, size_t);   // RFC 4180 quoting
+
+int64_t fileTimeToUnix(uint64_t filetime); // FILETIME to Unix seconds
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared zero-byte scanning
+//
+// Written by Dien Tran. Compile with a C99 compiler.
+
+#include "zeroscan.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZEROSCAN_AVX2 1
+#endif
+
+// Constants
+#define AVX2_MIN_LENGTH 64 // shorter buffers aren't worth the dispatch
+
+static uint64_t loadWord(const unsigned char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof word);
+    return word;
+}
+
+static size_t firstScalar(const unsigned char *p, size_t length) {
+    size_t i = 0;
+    while (i + 8 <= length && loadWord(p + i) == 0) {
+        i += 8;
+    }
+    while (i < length && p[i] == 0) {
+        ++i;
+    }
+    return i;
+}
+
+static size_t endScalar(const unsigned char *p, size_t length) {
+    size_t i = length;
+    while (i >= 8 && loadWord(p + i - 8) == 0) {
+        i -= 8;
+    }
+    while (i > 0 && p[i - 1] == 0) {
+        --i;
+    }
+    return i;
+}
+
+#ifdef ZEROSCAN_AVX2
+// Four 32-byte lanes are OR-ed together so a zero 128-byte block costs one
+// test; the block holding the first non-zero byte is then narrowed down 32
+// bytes at a time
+__attribute__((target("avx2"))) static size_t
+firstAVX2(const unsigned char *p, size_t length) {
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(p + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(p + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b),
+                                      _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            break;
+        }
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= length; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        uint32_t nonZero =
+            ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, zero));
+        if (nonZero != 0) {
+            return i + __builtin_ctz(nonZero);
+        }
+    }
+    return i + firstScalar(p + i, length - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+endAVX2(const unsigned char *p, size_t length) {
+    size_t i = length;
+    for (; i >= 128; i -= 128) {
+        const unsigned char *q = p + i - 128;
+        __m256i a = _mm256_loadu_si256((const __m256i *)q);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(q + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(q + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(q + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b),
+                                      _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            break;
+        }
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i >= 32; i -= 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i - 32));
+        uint32_t nonZero =
+            ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, zero));
+        if (nonZero != 0) {
+            return i - __builtin_clz(nonZero);
+        }
+    }
+    return endScalar(p, i);
+}
+
+static bool haveAVX2(void) {
+    static int cached = -1;
+    int have = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    if (have < 0) {
+        __builtin_cpu_init();
+        have = __builtin_cpu_supports("avx2");
+        __atomic_store_n(&cached, have, __ATOMIC_RELAXED);
+    }
+    return have;
+}
+#endif
+
+size_t zeroScanFirst(const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+#ifdef ZEROSCAN_AVX2
+    if (length >= AVX2_MIN_LENGTH && haveAVX2()) {
+        return firstAVX2(p, length);
+    }
+#endif
+    return firstScalar(p, length);
+}
+
+size_t zeroScanEnd(const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+#ifdef ZEROSCAN_AVX2
+    if (length >= AVX2_MIN_LENGTH && haveAVX2()) {
+        return endAVX2(p, length);
+    }
+#endif
+    return endScalar(p, length);
+}
@@ -0,0 +1,31 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Shared zero-byte scanning
+//
+// Written by Dien Tran. Compile with a C99 compiler; usable from C++.
+//
+// Finds where the non-zero bytes of a buffer start and end, so mostly empty
+// regions (such as file slack) can be passed over quickly. On x86 CPUs with
+// AVX2, 128 bytes are tested per step; elsewhere eight bytes at a time.
+
+#ifndef SUMMER_NTFS_PROJECT_COMMON_ZEROSCAN_H_
+#define SUMMER_NTFS_PROJECT_COMMON_ZEROSCAN_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototypes
+
+// Index of the first non-zero byte, or `length` if all are zero
+size_t zeroScanFirst(const void *, size_t length);
+
+// One past the last non-zero byte, or 0 if all are zero
+size_t zeroScanEnd(const void *, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -9,7 +9,9 @@
 
 #define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
 
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdint.h> // C99
 #include <stdio.h>
@@ -17,11 +19,20 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "../Common/devio.h"
+#include "../Common/ebr.h"
+#include "../Common/fleet.h"
+#include "../Common/gpt.h"
+#include "../Common/hexdump.h"
+#include "../Common/metrics.h"
+#include "../Common/outbuf.h"
+
 // Constants
 const int SECTOR_SIZE = 512;            // sector size
 const int PARTITION_TABLE_OFFSET = 446; // partition table offset
 const int PARTITION_TABLE_SIZE = 64;    // partition table size
 const int PARTITION_ENTRY_SIZE = 16;    // partition entry size
+#define PROBE_BATCH DEV_BATCH_DEPTH     // boot sectors read per probe batch
 
 // Structures
 typedef struct {
@@ -31,75 +42,219 @@ typedef struct {
     unsigned char PartitionType; // byte 4: partition type
 } PartitionEntry;
 
+// Partition found by a probe. Lives in a caller-provided array, not the heap
+typedef struct {
+    const char *Scheme;      // "mbr", "logical" or "gpt"
+    unsigned Index;          // slot in the MBR, EBR chain or GPT entry array
+    unsigned char Type;      // MBR type byte (or GPT equivalent)
+    bool Bootable;
+    uint64_t StartingSector;
+} ProbeEntry;
+
 // Function prototypes
 bool verifyNTFSVBR(unsigned char *);
-int work(int);
+int work(int, OutBuf *);
+int probe(int, const char *, OutBuf *);
+uint32_t entryStartingSector(const unsigned char *);
+void probeAdd(int, const char *, OutBuf *, ProbeEntry *, int *, ProbeEntry);
+void probeFlush(int, const char *, OutBuf *, const ProbeEntry *, int);
+const char *probeFilesystem(const unsigned char *, ssize_t);
+int workImage(const char *, OutBuf *, void *);
 PartitionEntry *newPartitionEntry(unsigned char *buf);
+PartitionEntry *newGPTPartitionEntry(const unsigned char *entry);
+int readGPTPartitions(int, OutBuf *, PartitionEntry ***, int *);
+int readLogicalPartitions(int, OutBuf *, PartitionEntry ***, int *);
 unsigned char *getVBR(PartitionEntry *, int);
 
 // Driver function
 int main(int argc, char **argv) {
-    // Check argc
-    if (argc != 2) {
-        fprintf(stderr, "Expected 2 arguments, got %d\n", argc);
+    // Parse options: --stats prints instrumentation at exit, --stats=json
+    // dumps it as JSON. --probe prints a one-line-per-partition summary
+    // instead of hex dumps. --workers, --per-device and --images control
+    // fleet mode. --rate, --iops, --idle and --control throttle device reads
+    int stats = 0; // 0 off, 1 text, 2 JSON
+    DevThrottle throttle = {0, 0, DEV_PRIORITY_NORMAL};
+    const char *controlPath = NULL;
+    bool probeMode = false;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    FleetOptions fleetOpts = {cpus > 0 ? (unsigned)cpus : 1,
+                              FLEET_DEFAULT_PER_DEVICE};
+    FleetPaths devices = {NULL, 0, 0};
+    bool imageList = false;
+    const struct option longOptions[] = {
+        {"stats", optional_argument, NULL, 's'},
+        {"workers", required_argument, NULL, 'w'},
+        {"per-device", required_argument, NULL, 'p'},
+        {"images", required_argument, NULL, 'i'},
+        {"probe", no_argument, NULL, 'P'},
+        {"rate", required_argument, NULL, 'R'},
+        {"iops", required_argument, NULL, 'O'},
+        {"idle", no_argument, NULL, 'I'},
+        {"control", required_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (c) {
+        case 's':
+            stats = optarg != NULL && strcmp(optarg, "json") == 0 ? 2 : 1;
+            break;
+        case 'w':
+            fleetOpts.Workers = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            fleetOpts.PerDevice = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            probeMode = true;
+            break;
+        case 'R':
+        case 'O':
+            if (!devParseThrottle(&throttle, c == 'R' ? "rate" : "iops",
+                                  optarg)) {
+                fprintf(stderr, "Invalid limit %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'I':
+            throttle.Priority = DEV_PRIORITY_IDLE;
+            break;
+        case 'C':
+            controlPath = optarg;
+            break;
+        case 'i':
+            imageList = true;
+            if (!fleetAddList(&devices, optarg)) {
+                perror(optarg);
+                exit(2);
+            }
+            break;
+        default:
+            exit(1);
+        }
+    }
+    if (fleetOpts.PerDevice == 0) {
+        fleetOpts.PerDevice = 1;
+    }
+    devSetThrottle(&throttle);
+    if (controlPath != NULL && !devWatchThrottle(controlPath)) {
+        fprintf(stderr, "Malformed control file %s\n", controlPath);
         exit(1);
     }
 
-    // Attempt to open device
-    int fd = open(argv[1], O_RDONLY);
-    if (fd < 0) {
-        // Failed to open
-        perror("open");
-        exit(2);
+    // Check argc. Several devices, globs or an image list run in fleet mode
+    for (int i = optind; i < argc; ++i) {
+        fleetAddPattern(&devices, argv[i]);
+    }
+    if (devices.Count == 0) {
+        fprintf(stderr,
+                "Usage: %s [--stats[=json]] [--probe] [--workers N] "
+                "[--per-device N] [--images FILE] [--rate BYTES] "
+                "[--iops N] [--idle] [--control FILE] DEVICE...\n",
+                argv[0]);
+        exit(1);
     }
-    printf("%s opened successfully\n", argv[1]);
 
-    // Do work
-    int status = work(fd);
+    // Buffered standard output
+    OutBuf out;
+    outBufInit(&out, STDOUT_FILENO, OUTBUF_DEFAULT_CAPACITY);
+    int status;
+    if (devices.Count == 1 && !imageList) {
+        // Attempt to open device
+        const char *device = devices.Paths[0];
+        int fd = open(device, O_RDONLY);
+        if (fd < 0) {
+            // Failed to open
+            perror("open");
+            exit(2);
+        }
 
-    // Done, close device
-    close(fd);
+        // Do work
+        if (probeMode) {
+            status = probe(fd, device, &out);
+        } else {
+            outBufPuts(&out, device);
+            outBufPuts(&out, " opened successfully\n");
+            status = work(fd, &out);
+        }
+        close(fd);
+    } else {
+        status =
+            fleetRun(&devices, &fleetOpts, workImage, &probeMode, &out, 1);
+    }
+    fleetFreePaths(&devices);
+
+    // Done, flush output
+    outBufFree(&out);
+
+    // Instrumentation goes to stderr
+    if (stats) {
+        OutBuf err;
+        outBufInit(&err, STDERR_FILENO, 0);
+        if (stats == 2) {
+            metricsPrintJSON(&err);
+        } else {
+            metricsPrint(&err);
+        }
+        outBufFree(&err);
+    }
     exit(status);
 }
 
+// Fleet callback: open one image and work (or probe, if `*context` is set)
+// it into `outs[0]`
+int workImage(const char *device, OutBuf *outs, void *context) {
+    int fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        outBufPuts(&outs[0], device);
+        outBufPuts(&outs[0], ": open: ");
+        outBufPuts(&outs[0], strerror(errno));
+        outBufPuts(&outs[0], "\n\n");
+        return 2;
+    }
+    int status;
+    if (*(bool *)context) {
+        status = probe(fd, device, &outs[0]);
+    } else {
+        outBufPuts(&outs[0], device);
+        outBufPuts(&outs[0], " opened successfully\n");
+        status = work(fd, &outs[0]);
+    }
+    close(fd);
+    return status;
+}
+
 // the main work function -- second function as specified in briefing
-int work(int fd) {
+int work(int fd, OutBuf *out) {
     // Read first 512 bytes
 
     // MBR
     unsigned char mbr[SECTOR_SIZE + 1];
 
     // Read MBR
-    ssize_t bytesRead = read(fd, mbr, SECTOR_SIZE + 1);
+    ssize_t bytesRead = devRead(fd, mbr, SECTOR_SIZE + 1);
     if (bytesRead < 0) {
         perror("read");
         return -1;
     }
 
     // Print MBR
-    printf("Master boot record:\n");
-    int i, j;
-    for (i = 0; i < SECTOR_SIZE; i++) {
-        printf("%02X ", mbr[i]);
-        if ((i + 1) % 16 == 0) {
-            printf("\n");
-        }
-    }
-    printf("\n===============================================\n\n");
+    METRICS_TIME_START(emitStart);
+    outBufPuts(out, "Master boot record:\n");
+    hexDump(out, mbr, SECTOR_SIZE, 0, &DUMP_LAYOUT_MBR);
+    outBufPuts(out, "\n===============================================\n\n");
 
     // Print partition table
-    printf("Partition table:\n");
-    for (i = 0, j = PARTITION_TABLE_OFFSET;
-         j < PARTITION_TABLE_OFFSET + PARTITION_TABLE_SIZE; ++i, ++j) {
-        printf("%02X ", mbr[j]);
-        if ((i + 1) % 16 == 0) {
-            printf("\n");
-        }
-    }
-    printf("\n===============================================\n\n");
+    outBufPuts(out, "Partition table:\n");
+    hexDump(out, mbr + PARTITION_TABLE_OFFSET, PARTITION_TABLE_SIZE,
+            PARTITION_TABLE_OFFSET, &DUMP_LAYOUT_PARTITION_TABLE);
+    outBufPuts(out, "\n===============================================\n\n");
+    METRICS_TIME_END(STAGE_EMIT, emitStart);
 
     // Construct partition entries
-    PartitionEntry *partitions[4];
+    METRICS_TIME_START(parseStart);
+    int partitionCount = 4;
+    PartitionEntry **partitions =
+        (PartitionEntry **)malloc(sizeof(PartitionEntry *) * partitionCount);
     for (int i = 0; i < 4; ++i) {
         unsigned char buf[16];
         for (int j = 0; j < 16; ++j) {
@@ -107,39 +262,58 @@ int work(int fd) {
         }
         partitions[i] = newPartitionEntry(buf);
     }
+    METRICS_TIME_END(STAGE_PARSE, parseStart);
 
-    // Check if the disk is in GPT format
+    // Check if the disk is in GPT format. If so, the protective MBR's entries
+    // are replaced by the GPT's
     if (partitions[0] && partitions[0]->PartitionType == 0xEE) {
-        // We do not deal with GPT disks. Terminate gracefully
-        printf("This disk is in GPT format, which is unsupported.\n");
-        return 5;
+        for (int i = 0; i < partitionCount; ++i) {
+            free(partitions[i]);
+        }
+        free(partitions);
+        int status = readGPTPartitions(fd, out, &partitions, &partitionCount);
+        if (status != 0) {
+            return status;
+        }
+    } else {
+        // Logical partitions are appended after the four primary slots
+        int status =
+            readLogicalPartitions(fd, out, &partitions, &partitionCount);
+        if (status != 0) {
+            return status;
+        }
     }
 
     // Print VBRs
-    unsigned char *VBRs[4];
-    for (int i = 0; i < 4; ++i) {
+    unsigned char **VBRs =
+        (unsigned char **)malloc(sizeof(unsigned char *) * partitionCount);
+    for (int i = 0; i < partitionCount; ++i) {
         VBRs[i] = getVBR(partitions[i], fd);
-        printf("VBR of partition %d:\n", i);
+        outBufPuts(out, "VBR of partition ");
+        outBufU64(out, i);
+        outBufPuts(out, ":\n");
         if (VBRs[i] == NULL) {
-            printf("Partition does not exist\n\n");
+            outBufPuts(out, "Partition does not exist\n\n");
             continue;
         }
-        for (int j = 0; j < SECTOR_SIZE; ++j) {
-            printf("%02X ", VBRs[i][j]);
-            if ((j + 1) % 16 == 0) {
-                printf("\n");
-            }
-        }
-        if (verifyNTFSVBR(VBRs[i])) {
-            printf("Bytes 3-11 are \"NTFS    \" -- this partition is in NTFS "
-                   "format\n");
-            printf("Reached beginning of VBR for NTFS\n");
+        METRICS_TIME_START(vbrParseStart);
+        bool isNTFS = verifyNTFSVBR(VBRs[i]);
+        METRICS_TIME_END(STAGE_PARSE, vbrParseStart);
+        METRICS_TIME_START(vbrEmitStart);
+        hexDump(out, VBRs[i], SECTOR_SIZE,
+                partitions[i]->StartingSector * SECTOR_SIZE,
+                isNTFS ? &DUMP_LAYOUT_NTFS_VBR : NULL);
+        METRICS_TIME_END(STAGE_EMIT, vbrEmitStart);
+        if (isNTFS) {
+            outBufPuts(out, "Bytes 3-11 are \"NTFS    \" -- this partition is "
+                            "in NTFS format\n");
+            outBufPuts(out, "Reached beginning of VBR for NTFS\n");
         }
-        printf("\n");
+        outBufPutc(out, '\n');
     }
 
     // Deallocation
-    for (int i = 0; i < 4; ++i) {
+    for (int i = 0; i < partitionCount; ++i) {
         if (partitions[i] != NULL) {
             free(partitions[i]);
         }
@@ -147,6 +321,8 @@ int work(int fd) {
             free(VBRs[i]);
         }
     }
+    free(partitions);
+    free(VBRs);
 
     // Work done.
     return 0;
@@ -183,6 +359,114 @@ PartitionEntry *newPartitionEntry(unsigned char *buf) {
     return entry;
 }
 
+// Read the GPT, print its header, and build one partition entry per used GPT
+// entry. Returns 0, or the exit status to stop with
+int readGPTPartitions(int fd, OutBuf *out, PartitionEntry ***partitions,
+                      int *partitionCount) {
+    GPT gpt;
+    METRICS_TIME_START(parseStart);
+    int status = gptRead(fd, &gpt);
+    METRICS_TIME_END(STAGE_PARSE, parseStart);
+    if (status == GPT_READ_ERROR) {
+        perror("read");
+        return -1;
+    }
+    if (status != GPT_OK) {
+        // Neither copy is usable. Terminate gracefully
+        outBufPuts(out, "This disk is in GPT format, but both GPT headers are "
+                        "corrupt.\n");
+        return 5;
+    }
+
+    // Print GPT header
+    METRICS_TIME_START(emitStart);
+    outBufPuts(out, gpt.UsedBackup
+                        ? "GPT header (primary copy corrupt, using backup):\n"
+                        : "GPT header:\n");
+    hexDump(out, gpt.Header, GPT_SECTOR_SIZE, gpt.HeaderLBA * SECTOR_SIZE,
+            &DUMP_LAYOUT_GPT_HEADER);
+    outBufPuts(out, "\n===============================================\n\n");
+    METRICS_TIME_END(STAGE_EMIT, emitStart);
+
+    // Construct partition entries from the used GPT entries
+    *partitionCount = 0;
+    *partitions = (PartitionEntry **)malloc(sizeof(PartitionEntry *) *
+                                            (gpt.EntryCount + 1));
+    for (uint32_t i = 0; i < gpt.EntryCount; ++i) {
+        const unsigned char *entry = gptEntry(&gpt, i);
+        if (!gptEntryUsed(entry)) {
+            continue;
+        }
+        outBufPuts(out, "GPT entry ");
+        outBufU64(out, i);
+        outBufPuts(out, ":\n");
+        hexDump(out, entry, GPT_ENTRY_SIZE,
+                gpt.EntriesLBA * SECTOR_SIZE + (uint64_t)i * gpt.EntrySize,
+                &DUMP_LAYOUT_GPT_ENTRY);
+        outBufPutc(out, '\n');
+        (*partitions)[(*partitionCount)++] = newGPTPartitionEntry(entry);
+    }
+    outBufPuts(out, "===============================================\n\n");
+    gptFree(&gpt);
+    return 0;
+}
+
+// Walk the EBR chain of every extended partition among the primary slots and
+// append its logical partitions. Returns 0, or -1 on a read error
+int readLogicalPartitions(int fd, OutBuf *out, PartitionEntry ***partitions,
+                          int *partitionCount) {
+    int primaryCount = *partitionCount;
+    for (int i = 0; i < primaryCount; ++i) {
+        PartitionEntry *extended = (*partitions)[i];
+        if (extended == NULL || !ebrIsExtendedType(extended->PartitionType)) {
+            continue;
+        }
+        EBRChain chain;
+        METRICS_TIME_START(parseStart);
+        if (ebrWalk(fd, extended->StartingSector, &chain) != EBR_OK) {
+            perror("read");
+            return -1;
+        }
+        METRICS_TIME_END(STAGE_PARSE, parseStart);
+
+        outBufPuts(out, "Extended partition ");
+        outBufU64(out, i);
+        outBufPuts(out, ": ");
+        outBufU64(out, chain.Links);
+        outBufPuts(out, " EBRs, ");
+        outBufU64(out, chain.Count);
+        outBufPuts(out, " logical partitions (");
+        outBufPuts(out, ebrEndMessage(chain.End));
+        outBufPuts(out, ")\n");
+        *partitions = (PartitionEntry **)realloc(
+            *partitions,
+            sizeof(PartitionEntry *) * (*partitionCount + chain.Count));
+        for (size_t j = 0; j < chain.Count; ++j) {
+            outBufPuts(out, "Logical partition entry of the EBR at sector ");
+            outBufU64(out, chain.EBRLBAs[j]);
+            outBufPuts(out, " (starting LBA made absolute):\n");
+            hexDump(out, chain.Entries[j], EBR_ENTRY_SIZE,
+                    chain.EBRLBAs[j] * SECTOR_SIZE + PARTITION_TABLE_OFFSET,
+                    &DUMP_LAYOUT_PARTITION_TABLE);
+            (*partitions)[(*partitionCount)++] =
+                newPartitionEntry(chain.Entries[j]);
+        }
+        outBufPuts(out,
+                   "\n===============================================\n\n");
+        ebrFree(&chain);
+    }
+    return 0;
+}
+
+PartitionEntry *newGPTPartitionEntry(const unsigned char *entry) {
+    PartitionEntry *partition =
+        (PartitionEntry *)malloc(sizeof(PartitionEntry));
+    partition->BootIndicator = gptEntryBootable(entry);
+    partition->StartingSector = gptEntryFirstLBA(entry);
+    partition->PartitionType = gptLegacyType(entry); // MBR equivalent
+    return partition;
+}
+
 unsigned char *getVBR(PartitionEntry *entry, int fd) {
     if (entry == NULL) {
         return NULL;
@@ -192,12 +476,12 @@ unsigned char *getVBR(PartitionEntry *entry, int fd) {
         (unsigned char *)malloc(sizeof(unsigned char) * SECTOR_SIZE);
 
     // Read VBR
-    off_t seekerr = lseek(fd, entry->StartingSector * SECTOR_SIZE, SEEK_SET);
+    off_t seekerr = devSeek(fd, entry->StartingSector * SECTOR_SIZE, SEEK_SET);
     if (seekerr < 0) {
         perror("lseek");
         return NULL;
     }
-    ssize_t bytesRead = read(fd, vbr, SECTOR_SIZE);
+    ssize_t bytesRead = devRead(fd, vbr, SECTOR_SIZE);
     if (bytesRead < 0) {
         perror("read");
         return NULL;
@@ -217,4 +501,162 @@ bool verifyNTFSVBR(unsigned char *vbr) {
 
     // Verify NTFS signature
     return strcmp(sig, "NTFS    ") == 0;
-}
\ No newline at end of file
+}
+
+// Starting sector of an MBR or EBR partition table entry, from its bytes
+// 8-11 (little-endian)
+uint32_t entryStartingSector(const unsigned char *entry) {
+    return (uint32_t)entry[11] << 24 | (uint32_t)entry[10] << 16 |
+           (uint32_t)entry[9] << 8 | entry[8];
+}
+
+// Compact inventory of a disk: one tab-separated line per partition (device,
+// scheme, index, type, starting sector, boot flag, filesystem). No entry is
+// allocated and all boot sectors are fetched in batches of PROBE_BATCH.
+// Returns 0, or the exit status to stop with
+int probe(int fd, const char *device, OutBuf *out) {
+    // Short images read as zeros, as in work
+    unsigned char mbr[SECTOR_SIZE];
+    memset(mbr, 0, SECTOR_SIZE);
+    if (devPread(fd, mbr, SECTOR_SIZE, 0) < 0) {
+        perror("read");
+        return -1;
+    }
+
+    ProbeEntry entries[PROBE_BATCH];
+    int count = 0;
+    bool any = false;
+    const char *scheme = "mbr";
+    int status = 0;
+    if (mbr[SECTOR_SIZE - 2] != 0x55 || mbr[SECTOR_SIZE - 1] != 0xAA) {
+        scheme = "none";
+    } else if (mbr[PARTITION_TABLE_OFFSET + 4] == 0xEE) {
+        // Protective MBR: the partitions are in the GPT
+        scheme = "gpt";
+        GPT gpt;
+        status = gptRead(fd, &gpt);
+        if (status == GPT_READ_ERROR) {
+            perror("read");
+            return -1;
+        }
+        if (status == GPT_OK) {
+            for (uint32_t i = 0; i < gpt.EntryCount; ++i) {
+                const unsigned char *entry = gptEntry(&gpt, i);
+                if (gptEntryUsed(entry)) {
+                    ProbeEntry found = {"gpt", i, gptLegacyType(entry),
+                                        gptEntryBootable(entry),
+                                        gptEntryFirstLBA(entry)};
+                    probeAdd(fd, device, out, entries, &count, found);
+                    any = true;
+                }
+            }
+            gptFree(&gpt);
+        }
+        status = status == GPT_OK ? 0 : 5;
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            const unsigned char *entry =
+                mbr + PARTITION_TABLE_OFFSET + PARTITION_ENTRY_SIZE * i;
+            if (entry[4] == 0x00) {
+                continue;
+            }
+            ProbeEntry found = {"mbr", (unsigned)i, entry[4], entry[0] != 0,
+                                entryStartingSector(entry)};
+            probeAdd(fd, device, out, entries, &count, found);
+            any = true;
+            if (!ebrIsExtendedType(found.Type)) {
+                continue;
+            }
+            EBRChain chain;
+            if (ebrWalk(fd, found.StartingSector, &chain) != EBR_OK) {
+                perror("read");
+                return -1;
+            }
+            for (size_t j = 0; j < chain.Count; ++j) {
+                const unsigned char *logical = chain.Entries[j];
+                ProbeEntry logicalEntry = {
+                    "logical", (unsigned)j, logical[4], logical[0] != 0,
+                    entryStartingSector(logical)};
+                probeAdd(fd, device, out, entries, &count, logicalEntry);
+            }
+            ebrFree(&chain);
+        }
+    }
+    probeFlush(fd, device, out, entries, count);
+
+    // Disks without partitions still get a line
+    if (!any) {
+        outBufPuts(out, device);
+        outBufPutc(out, '\t');
+        outBufPuts(out, scheme);
+        outBufPuts(out, status == 5 ? "\t-\t-\t-\t-\tcorrupt\n"
+                                    : "\t-\t-\t-\t-\tempty\n");
+    }
+    return status;
+}
+
+// Queue a probed partition, flushing the batch when it's full
+void probeAdd(int fd, const char *device, OutBuf *out, ProbeEntry *entries,
+              int *count, ProbeEntry entry) {
+    if (*count == PROBE_BATCH) {
+        probeFlush(fd, device, out, entries, *count);
+        *count = 0;
+    }
+    entries[(*count)++] = entry;
+}
+
+// Read the boot sectors of `count` probed partitions in one batch and print
+// their lines
+void probeFlush(int fd, const char *device, OutBuf *out,
+                const ProbeEntry *entries, int count) {
+    unsigned char vbrs[PROBE_BATCH][SECTOR_SIZE];
+    DevRead reads[PROBE_BATCH];
+    for (int i = 0; i < count; ++i) {
+        reads[i].Buffer = vbrs[i];
+        reads[i].Length = SECTOR_SIZE;
+        reads[i].Offset = (off_t)(entries[i].StartingSector * SECTOR_SIZE);
+    }
+    devPreadBatch(fd, reads, count);
+
+    METRICS_TIME_START(emitStart);
+    for (int i = 0; i < count; ++i) {
+        outBufPuts(out, device);
+        outBufPutc(out, '\t');
+        outBufPuts(out, entries[i].Scheme);
+        outBufPutc(out, '\t');
+        outBufU64(out, entries[i].Index);
+        outBufPuts(out, "\t0x");
+        outBufHex(out, entries[i].Type, 2, false);
+        outBufPutc(out, '\t');
+        outBufU64(out, entries[i].StartingSector);
+        outBufPuts(out, entries[i].Bootable ? "\tboot\t" : "\t-\t");
+        outBufPuts(out, ebrIsExtendedType(entries[i].Type)
+                            ? "extended"
+                            : probeFilesystem(vbrs[i], reads[i].Result));
+        outBufPutc(out, '\n');
+    }
+    METRICS_TIME_END(STAGE_EMIT, emitStart);
+}
+
+// Filesystem a boot sector belongs to, from its OEM ID or FAT type string
+const char *probeFilesystem(const unsigned char *vbr, ssize_t got) {
+    if (got < SECTOR_SIZE) {
+        return "unreadable";
+    }
+    if (memcmp(vbr + 3, "NTFS    ", 8) == 0) {
+        return "ntfs";
+    }
+    if (memcmp(vbr + 3, "EXFAT   ", 8) == 0) {
+        return "exfat";
+    }
+    if (vbr[SECTOR_SIZE - 2] != 0x55 || vbr[SECTOR_SIZE - 1] != 0xAA) {
+        return "none";
+    }
+    if (memcmp(vbr + 0x52, "FAT32   ", 8) == 0) {
+        return "fat32";
+    }
+    if (memcmp(vbr + 0x36, "FAT1", 4) == 0) {
+        return "fat";
+    }
+    return "unknown";
+}
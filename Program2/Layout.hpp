@@ -0,0 +1,89 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM2_LAYOUT_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM2_LAYOUT_HPP_
+
+// On-disk structure layouts. Every field we parse is a little-endian integer
+// at a fixed offset from the start of its structure, so each one is declared
+// once here as an `LEField` and decoded with a single unaligned load, plus a
+// byte swap on big-endian hosts, instead of shifting bytes together by hand.
+
+// Standard library
+#include <cstddef> // std::size_t
+#include <cstdint> // for standard types
+#include <cstring> // std::memcpy
+#include <vector>  // std::vector
+
+// Self-defined
+#include "utility.hpp" // constants
+
+namespace dkt {
+// Little-endian to host byte order, and back. No-ops on little-endian hosts
+inline std::uint8_t FromLE(std::uint8_t value) { return value; }
+inline std::int8_t FromLE(std::int8_t value) { return value; }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline std::uint16_t FromLE(std::uint16_t value) {
+    return __builtin_bswap16(value);
+}
+inline std::uint32_t FromLE(std::uint32_t value) {
+    return __builtin_bswap32(value);
+}
+inline std::uint64_t FromLE(std::uint64_t value) {
+    return __builtin_bswap64(value);
+}
+#else
+inline std::uint16_t FromLE(std::uint16_t value) { return value; }
+inline std::uint32_t FromLE(std::uint32_t value) { return value; }
+inline std::uint64_t FromLE(std::uint64_t value) { return value; }
+#endif
+
+// Little-endian `T` at `p`, which needn't be aligned
+template <typename T> inline T LoadLE(const unsigned char *p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return FromLE(value);
+}
+
+template <typename T> inline void StoreLE(unsigned char *p, T value) {
+    value = FromLE(value);
+    std::memcpy(p, &value, sizeof(T));
+}
+
+// A `T` stored little-endian at byte `Offset` of a `Size`-byte structure.
+// Fields that don't fit their structure fail to compile
+template <typename T, std::size_t Offset, std::size_t Size> struct LEField {
+    static_assert(Offset + sizeof(T) <= Size, "Field outside its structure");
+
+    typedef T Type;
+    static constexpr std::size_t OFFSET = Offset;
+    static constexpr std::size_t END = Offset + sizeof(T); // one past the field
+
+    // Read from the structure starting at `base`
+    static T Get(const unsigned char *base) { return LoadLE<T>(base + Offset); }
+
+    // Read from the structure starting at byte `base` of `s`
+    static T Get(const std::vector<unsigned char> &s, std::size_t base = 0) {
+        return LoadLE<T>(&s[base + Offset]);
+    }
+
+    static void Set(unsigned char *base, T value) {
+        StoreLE<T>(base + Offset, value);
+    }
+};
+
+// MBR partition table entry (also EBR entries)
+struct PartitionEntryLayout {
+    static constexpr std::size_t SIZE = PARTITION_ENTRY_SIZE;
+    typedef LEField<std::uint8_t, 0x00, SIZE> BootIndicator;
+    typedef LEField<std::uint8_t, 0x04, SIZE> Type;
+    typedef LEField<std::uint32_t, 0x08, SIZE> StartingSector;
+    typedef LEField<std::uint32_t, 0x0C, SIZE> SectorCount;
+};
+
+// NTFS boot sector (VBR). Only the MFT locations are read
+struct BootSectorLayout {
+    static constexpr std::size_t SIZE = SECTOR_SIZE;
+    typedef LEField<std::uint64_t, NTFS_VBR_MFT_OFFSET, SIZE> MFTLCN;
+    typedef LEField<std::uint64_t, NTFS_VBR_MFTMIRR_OFFSET, SIZE> MFTMirrLCN;
+};
+} // namespace dkt
+
+#endif
@@ -14,39 +14,101 @@
 #define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
 
 // Standard headers
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
-#include <iostream>
+#include <getopt.h>
+#include <stdexcept>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
 // Self-defined headers
+#include "../Common/devio.h"
+#include "../Common/fleet.h"
+#include "../Common/metrics.h"
+#include "../Common/outbuf.h"
 #include "Program2.hpp"
 #include "utility.hpp"
 
-void displayMFTProperties(const NTFSVBR &vbr) {
+void displayMFTProperties(const NTFSVBR &vbr, OutBuf *out) {
     // Find start address of $MFT
-    std::printf("$MFT address: 0x%llX\n",
-                vbr.GetMFTLCN() * CLUSTER_SIZE * SECTOR_SIZE);
+    outBufPuts(out, "$MFT address: 0x");
+    outBufHex(out, vbr.GetMFTLCN() * CLUSTER_SIZE * SECTOR_SIZE, 0, true);
+    outBufPutc(out, '\n');
 
     // Find start address of $MFTMirr
-    std::printf("$MFTMirr address: 0x%llX\n",
-                vbr.GetMFTMirrLCN() * CLUSTER_SIZE * SECTOR_SIZE);
+    outBufPuts(out, "$MFTMirr address: 0x");
+    outBufHex(out, vbr.GetMFTMirrLCN() * CLUSTER_SIZE * SECTOR_SIZE, 0, true);
+    outBufPutc(out, '\n');
+}
+
+// Replace `entries` with the used entries of the disk's GPT
+int readGPTEntries(int fd, dkt::EntryVector &entries, OutBuf *out) {
+    GPT gpt;
+    METRICS_TIME_START(gptStart);
+    int gptStatus = gptRead(fd, &gpt);
+    if (gptStatus == GPT_READ_ERROR) {
+        perror("read");
+        return READ_ERROR;
+    }
+    if (gptStatus != GPT_OK) {
+        // Both copies are damaged. Terminate the program gracefully
+        outBufPuts(out, "This disk is in GPT format, but both GPT headers are "
+                        "corrupt.\n");
+        return GPT_FORMATTED;
+    }
+    entries = ParseGPTEntries(gpt);
+    METRICS_TIME_END(STAGE_PARSE, gptStart);
+    outBufPuts(out, gpt.UsedBackup
+                        ? "GPT disk (primary copy corrupt, using backup)\n"
+                        : "GPT disk\n");
+    gptFree(&gpt);
+    return SUCCESS;
+}
+
+// Append the logical partitions of every extended partition in `entries`
+int readLogicalEntries(int fd, dkt::EntryVector &entries, OutBuf *out) {
+    dkt::EntryVector logical;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (!ebrIsExtendedType(entries[i].GetPartitionType())) {
+            continue;
+        }
+        EBRChain chain;
+        METRICS_TIME_START(ebrStart);
+        if (ebrWalk(fd, entries[i].GetStartingSector(), &chain) != EBR_OK) {
+            perror("read");
+            return READ_ERROR;
+        }
+        dkt::EntryVector found = ParseEBREntries(chain);
+        METRICS_TIME_END(STAGE_PARSE, ebrStart);
+        logical.insert(logical.end(), found.begin(), found.end());
+        if (chain.End != EBR_END_CHAIN) {
+            outBufPuts(out, "Extended partition chain cut short: ");
+            outBufPuts(out, ebrEndMessage(chain.End));
+            outBufPutc(out, '\n');
+        }
+        ebrFree(&chain);
+    }
+    entries.insert(entries.end(), logical.begin(), logical.end());
+    return SUCCESS;
 }
 
 // work function.
-int work(int fd) {
+int work(int fd, OutBuf *out) {
     // Read MBR
     unsigned char mbrArr[SECTOR_SIZE + 1];
-    if (read(fd, mbrArr, SECTOR_SIZE + 1) < 0) {
+    if (devRead(fd, mbrArr, SECTOR_SIZE + 1) < 0) {
         perror("read");
         return READ_ERROR;
     }
 
     // Create MBR object
+    METRICS_TIME_START(parseStart);
     dkt::UString mbrStr(SECTOR_SIZE);
     for (size_t i = 0; i < SECTOR_SIZE; ++i) {
         mbrStr[i] = mbrArr[i];
@@ -55,27 +117,38 @@ int work(int fd) {
 
     // Parse partition entries, and see which ones are NTFS
     dkt::EntryVector entries = mbr.ParseEntries();
-    // ...but first, check if the disk is in GPT
+    METRICS_TIME_END(STAGE_PARSE, parseStart);
+    // ...but first, check if the disk is in GPT, and take the GPT's entries
+    // instead of the protective MBR's if so
     if (entries.size() && entries[0].GetPartitionType() == 0xEE) {
-        // We do not deal with GPT disks. Terminate the program gracefully
-        std::cout << "This disk is in GPT format, which is unsupported." << '\n';
-        return GPT_FORMATTED;
+        int gptStatus = readGPTEntries(fd, entries, out);
+        if (gptStatus != SUCCESS) {
+            return gptStatus;
+        }
+    } else {
+        // Logical partitions inside extended partitions follow the primaries
+        int ebrStatus = readLogicalEntries(fd, entries, out);
+        if (ebrStatus != SUCCESS) {
+            return ebrStatus;
+        }
     }
     dkt::NTFSEntryVector NTFSEntries;
     NTFSEntries.reserve(4);
     for (size_t i = 0; i < entries.size(); ++i) {
-        std::cout << "Partition " << i + 1 << ": ";
+        outBufPuts(out, "Partition ");
+        outBufU64(out, i + 1);
         try {
             // Attempt to create an `NTFSPartitionEntry` object
             NTFSPartitionEntry e(entries[i].GetEntry());
             NTFSEntries.push_back(e); // and push it into the NTFS array
-            std::cout << "NTFS entry\n";
+            outBufPuts(out, ": NTFS entry\n");
         } catch (std::invalid_argument &e) {
-            std::cout << "Non-NTFS entry\n";
+            outBufPuts(out, ": Non-NTFS entry\n");
         }
     }
-    std::cout << "\n"
-              << NTFSEntries.size() << " NTFS partitions on opened device\n\n";
+    outBufPutc(out, '\n');
+    outBufU64(out, NTFSEntries.size());
+    outBufPuts(out, " NTFS partitions on opened device\n\n");
 
     // Read VBR for each NTFS partition
     dkt::VBRVector VBRs;
@@ -84,12 +157,12 @@ int work(int fd) {
         // Read VBR
         std::uint64_t vbrAddr =
             NTFSEntries[i].GetStartingSector() * SECTOR_SIZE;
-        if (lseek(fd, vbrAddr, SEEK_SET) < 0) {
+        if (devSeek(fd, vbrAddr, SEEK_SET) < 0) {
             perror("lseek");
             return LSEEK_ERROR;
         }
         unsigned char vbr[SECTOR_SIZE + 1];
-        if (read(fd, vbr, SECTOR_SIZE + 1) < 0) {
+        if (devRead(fd, vbr, SECTOR_SIZE + 1) < 0) {
             perror("read");
             return READ_ERROR;
         }
@@ -97,43 +170,166 @@ int work(int fd) {
         for (size_t j = 0; j < SECTOR_SIZE; ++j) {
             vbrStr[j] = vbr[j];
         }
-        std::cout << "Partition " << i + 1 << ": ";
+        outBufPuts(out, "Partition ");
+        outBufU64(out, i + 1);
         try {
             // Attempt to create VBR from NTFS partition
+            METRICS_TIME_START(vbrParseStart);
             VBRs.push_back(NTFSVBR(vbrStr));
-            std::cout << "valid VBR\n";
-            displayMFTProperties(VBRs[i]);
-            std::cout << '\n';
+            METRICS_TIME_END(STAGE_PARSE, vbrParseStart);
+            METRICS_TIME_START(emitStart);
+            outBufPuts(out, ": valid VBR\n");
+            displayMFTProperties(VBRs.back(), out);
+            outBufPutc(out, '\n');
+            METRICS_TIME_END(STAGE_EMIT, emitStart);
         } catch (std::invalid_argument &e) {
-            std::cout << "invalid VBR\n";
+            outBufPuts(out, ": invalid VBR\n");
         }
     }
 
     return 0;
 }
 
+// Fleet callback: open one image, work it, and report into `outs[0]`
+int workImage(const char *device, OutBuf *outs, void *) {
+    int fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        outBufPuts(&outs[0], device);
+        outBufPuts(&outs[0], ": open: ");
+        outBufPuts(&outs[0], std::strerror(errno));
+        outBufPuts(&outs[0], "\n\n");
+        return OPEN_ERROR;
+    }
+    outBufPuts(&outs[0], device);
+    outBufPuts(&outs[0], " opened successfully\n\n");
+    int workResult = work(fd, &outs[0]);
+    close(fd);
+    return workResult;
+}
+
 // main function
 int main(int argc, char **argv) {
-    // Require 2 arguments
-    if (argc != 2) {
-        std::fprintf(stderr, "Expected 2 arguments, got %d\n", argc);
+    // Parse options: --stats prints instrumentation at exit, --stats=json
+    // dumps it as JSON. --workers, --per-device and --images control fleet
+    // mode. --rate, --iops, --idle and --control throttle device reads
+    int stats = 0; // 0 off, 1 text, 2 JSON
+    DevThrottle throttle = {0, 0, DEV_PRIORITY_NORMAL};
+    const char *controlPath = NULL;
+    FleetOptions fleetOpts;
+    fleetOpts.Workers = std::thread::hardware_concurrency();
+    fleetOpts.PerDevice = FLEET_DEFAULT_PER_DEVICE;
+    FleetPaths devices = {NULL, 0, 0};
+    bool imageList = false;
+    const struct option longOptions[] = {
+        {"stats", optional_argument, NULL, 's'},
+        {"workers", required_argument, NULL, 'w'},
+        {"per-device", required_argument, NULL, 'p'},
+        {"images", required_argument, NULL, 'i'},
+        {"rate", required_argument, NULL, 'R'},
+        {"iops", required_argument, NULL, 'O'},
+        {"idle", no_argument, NULL, 'I'},
+        {"control", required_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (c) {
+        case 's':
+            stats = optarg != NULL && std::strcmp(optarg, "json") == 0 ? 2 : 1;
+            break;
+        case 'w':
+            fleetOpts.Workers = std::strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            fleetOpts.PerDevice = std::strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            imageList = true;
+            if (!fleetAddList(&devices, optarg)) {
+                std::perror(optarg);
+                std::exit(OPEN_ERROR);
+            }
+            break;
+        case 'R':
+        case 'O':
+            if (!devParseThrottle(&throttle, c == 'R' ? "rate" : "iops",
+                                  optarg)) {
+                std::fprintf(stderr, "Invalid limit %s\n", optarg);
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            break;
+        case 'I':
+            throttle.Priority = DEV_PRIORITY_IDLE;
+            break;
+        case 'C':
+            controlPath = optarg;
+            break;
+        default:
+            std::exit(ARGUMENT_EXPECTED);
+        }
+    }
+    if (fleetOpts.PerDevice == 0) {
+        fleetOpts.PerDevice = 1;
+    }
+    devSetThrottle(&throttle);
+    if (controlPath != NULL && !devWatchThrottle(controlPath)) {
+        std::fprintf(stderr, "Malformed control file %s\n", controlPath);
         std::exit(ARGUMENT_EXPECTED);
     }
 
-    // Open device
-    int fd = open(argv[1], O_RDONLY);
-    if (fd < 0) {
-        std::perror("open");
-        std::exit(OPEN_ERROR);
+    // Require at least one device. Several devices, globs or an image list
+    // run in fleet mode
+    for (int i = optind; i < argc; ++i) {
+        fleetAddPattern(&devices, argv[i]);
+    }
+    if (devices.Count == 0) {
+        std::fprintf(stderr,
+                     "Usage: %s [--stats[=json]] [--workers N] "
+                     "[--per-device N] [--images FILE] [--rate BYTES] "
+                     "[--iops N] [--idle] [--control FILE] DEVICE...\n",
+                     argv[0]);
+        std::exit(ARGUMENT_EXPECTED);
     }
-    std::cout << argv[1] << " opened successfully\n\n";
 
-    // Do work
-    int workResult = work(fd);
+    // Buffered standard output
+    OutBuf out;
+    outBufInit(&out, STDOUT_FILENO, OUTBUF_DEFAULT_CAPACITY);
+    int workResult;
+    if (devices.Count == 1 && !imageList) {
+        // Open device
+        const char *device = devices.Paths[0];
+        int fd = open(device, O_RDONLY);
+        if (fd < 0) {
+            std::perror("open");
+            std::exit(OPEN_ERROR);
+        }
+        outBufPuts(&out, device);
+        outBufPuts(&out, " opened successfully\n\n");
 
-    // Close device
-    close(fd);
+        // Do work
+        workResult = work(fd, &out);
+
+        // Close device
+        close(fd);
+    } else {
+        workResult = fleetRun(&devices, &fleetOpts, workImage, NULL, &out, 1);
+    }
+    fleetFreePaths(&devices);
+
+    // Flush output
+    outBufFree(&out);
+
+    // Instrumentation goes to stderr
+    if (stats) {
+        OutBuf err;
+        outBufInit(&err, STDERR_FILENO, 0);
+        if (stats == 2) {
+            metricsPrintJSON(&err);
+        } else {
+            metricsPrint(&err);
+        }
+        outBufFree(&err);
+    }
 
     // Exit with work's return code
     std::exit(workResult);
-}
\ No newline at end of file
+}
@@ -7,6 +7,6 @@ const int ARGUMENT_EXPECTED = 1;
 const int OPEN_ERROR = 2;
 const int READ_ERROR = 3;
 const int LSEEK_ERROR = 4;
-const int GPT_FORMATTED = 5;
+const int GPT_FORMATTED = 5; // GPT disk with both GPT headers corrupt
 
 #endif
\ No newline at end of file
@@ -5,13 +5,15 @@
 #include <stdexcept>
 #include <string>
 
+#include "Layout.hpp"
+
 // `UString`-based `PartitionEntry` constructor.
 // THROWS:
-//  - std::invalid_argument("Expected ${PARTITION_ENTRY_SIZE} for entry
-//  size, got ${actual_value}"): if partition entry size is not exactly
-//  PARTITION_ENTRY_SIZE
+//  - std::invalid_argument("Expected ${PARTITION_ENTRY_SIZE} or
+//  ${GPT_ENTRY_SIZE} for entry size, got ${actual_value}"): if partition
+//  entry size is neither PARTITION_ENTRY_SIZE nor GPT_ENTRY_SIZE
 //  - std::invalid_argument("Non-existent partition"): if partition
-//  entry's type field is 0x0
+//  entry's type field is 0x0 (MBR) or its type GUID is all zeros (GPT)
 PartitionEntry::PartitionEntry(const dkt::UString &entry) {
     // Copy entry
     this->SetEntry(entry);
@@ -22,48 +24,75 @@ dkt::UString PartitionEntry::GetEntry() const { return this->entry; }
 
 // Entry string setter
 void PartitionEntry::SetEntry(const dkt::UString &entry) {
-    // Check if entry size is not exactly PARTITION_ENTRY_SIZE bytes long
-    if (entry.size() != PARTITION_ENTRY_SIZE) {
+    // Check if entry size is exactly PARTITION_ENTRY_SIZE (MBR) or
+    // GPT_ENTRY_SIZE (GPT) bytes long
+    if (entry.size() != PARTITION_ENTRY_SIZE &&
+        entry.size() != GPT_ENTRY_SIZE) {
         std::stringstream ss;
-        ss << "Expected " << PARTITION_ENTRY_SIZE << " for entry size, got "
-           << entry.size();
+        ss << "Expected " << PARTITION_ENTRY_SIZE << " or " << GPT_ENTRY_SIZE
+           << " for entry size, got " << entry.size();
         throw std::invalid_argument(ss.str());
     }
 
     // Check if partition type is non-zero (0x0 is agreed upon as a non-existent
-    // partition type)
-    if (entry[4] == 0x0) {
+    // partition type, as is the all-zero GUID on GPT)
+    if (entry.size() == GPT_ENTRY_SIZE
+            ? !gptEntryUsed(&entry[0])
+            : dkt::PartitionEntryLayout::Type::Get(entry) == 0x0) {
         throw std::invalid_argument("Non-existent partition");
     }
 
     this->entry = entry;
 }
 
+// GPT entry check
+bool PartitionEntry::IsGPTEntry() const {
+    return this->entry.size() == GPT_ENTRY_SIZE;
+}
+
 // Bootable status
 bool PartitionEntry::GetBootIndicator() const {
-    return static_cast<bool>(
-        entry[0]); // return if boot field is non-zero (0x80)
+    if (this->IsGPTEntry()) {
+        return gptEntryBootable(&entry[0]); // legacy BIOS bootable attribute
+    }
+    return static_cast<bool>(dkt::PartitionEntryLayout::BootIndicator::Get(
+        this->entry)); // return if boot field is non-zero (0x80)
 }
 
 // Partition type
-unsigned char PartitionEntry::GetPartitionType() const { return entry[4]; }
+unsigned char PartitionEntry::GetPartitionType() const {
+    if (this->IsGPTEntry()) {
+        return gptLegacyType(&entry[0]);
+    }
+    return dkt::PartitionEntryLayout::Type::Get(this->entry);
+}
 
 // Starting sector (VBR)
 std::uint64_t PartitionEntry::GetStartingSector() const {
-    return static_cast<std::uint64_t>(entry[11]) << 24 | entry[10] << 16 |
-           entry[9] << 8 | entry[8];
+    if (this->IsGPTEntry()) {
+        return gptEntryFirstLBA(&entry[0]);
+    }
+    return dkt::PartitionEntryLayout::StartingSector::Get(this->entry);
 }
 
 // `NTFSPartitionEntry` constructor
 NTFSPartitionEntry::NTFSPartitionEntry(const dkt::UString &entry)
     : PartitionEntry(entry) {
     if (!this->IsNTFSEntry()) {
-        throw std::invalid_argument("Not an NTFS entry (byte 4 != 0x07)");
+        throw std::invalid_argument(
+            this->IsGPTEntry() ? "Not an NTFS entry (type GUID isn't basic "
+                                 "data or WinRE)"
+                               : "Not an NTFS entry (byte 4 != 0x07)");
     }
 }
 
 // NTFS partition check
-bool NTFSPartitionEntry::IsNTFSEntry() const { return entry[4] == 0x07; }
+bool NTFSPartitionEntry::IsNTFSEntry() const {
+    if (this->IsGPTEntry()) {
+        return gptIsNTFSType(&entry[0]);
+    }
+    return dkt::PartitionEntryLayout::Type::Get(this->entry) == 0x07;
+}
 
 // `UString`-based `Sector` constructor.
 // THROWS:
@@ -132,6 +161,32 @@ dkt::EntryVector MBR::ParseEntries() const {
     return result;
 }
 
+// GPT entry parser. Returns the used entries, trimmed to GPT_ENTRY_SIZE, as
+// an `EntryVector`
+dkt::EntryVector ParseGPTEntries(const GPT &gpt) {
+    dkt::EntryVector result;
+    for (std::uint32_t i = 0; i < gpt.EntryCount; ++i) {
+        const unsigned char *entry = gptEntry(&gpt, i);
+        if (gptEntryUsed(entry)) {
+            result.push_back(
+                PartitionEntry(dkt::UString(entry, entry + GPT_ENTRY_SIZE)));
+        }
+    }
+    return result;
+}
+
+// EBR chain parser. Returns the logical partitions, with absolute starting
+// sectors, as an `EntryVector`
+dkt::EntryVector ParseEBREntries(const EBRChain &chain) {
+    dkt::EntryVector result;
+    result.reserve(chain.Count);
+    for (std::size_t i = 0; i < chain.Count; ++i) {
+        result.push_back(PartitionEntry(
+            dkt::UString(chain.Entries[i], chain.Entries[i] + EBR_ENTRY_SIZE)));
+    }
+    return result;
+}
+
 // `UString`-based `NTFSVBR` constructor.
 // THROWS:
 //  - std::invalid_argument("VBR ending must be 0x55AA"): if VBR ending is not
@@ -157,45 +212,10 @@ void NTFSVBR::SetVBR(const dkt::UString &VBR) {
 
 // Compute MFT LCN
 std::uint64_t NTFSVBR::GetMFTLCN() const {
-    return static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 7])
-               << (8 * 7) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 6])
-               << (8 * 6) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 5])
-               << (8 * 5) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 4])
-               << (8 * 4) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 3])
-               << (8 * 3) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 2])
-               << (8 * 2) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET + 1])
-               << (8 * 1) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFT_OFFSET]);
+    return dkt::BootSectorLayout::MFTLCN::Get(this->SectorStr);
 }
 
 // Compute MFTMirr LCN
 std::uint64_t NTFSVBR::GetMFTMirrLCN() const {
-    return static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 7])
-               << (8 * 7) |
-           static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 6])
-               << (8 * 6) |
-           static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 5])
-               << (8 * 5) |
-           static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 4])
-               << (8 * 4) |
-           static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 3])
-               << (8 * 3) |
-           static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 2])
-               << (8 * 2) |
-           static_cast<std::uint64_t>(
-               this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET + 1])
-               << (8 * 1) |
-           static_cast<std::uint64_t>(this->SectorStr[NTFS_VBR_MFTMIRR_OFFSET]);
+    return dkt::BootSectorLayout::MFTMirrLCN::Get(this->SectorStr);
 }
\ No newline at end of file
@@ -5,6 +5,10 @@
 #include <cstdint> // for standard types
 #include <vector>  // std::vector
 
+// Shared C modules
+#include "../Common/ebr.h"
+#include "../Common/gpt.h"
+
 // Constants
 const int SECTOR_SIZE = 512;            // sector size
 const int PARTITION_TABLE_OFFSET = 446; // partition table offset
@@ -32,7 +36,8 @@ typedef std::vector<NTFSVBR> VBRVector; // vector of `NTFSVBR`s
 
 // Class definitions
 
-// General partition entry
+// General partition entry: a 16-byte MBR entry or a 128-byte GPT entry. GPT
+// entries report the MBR type byte equivalent to their type GUID
 class PartitionEntry {
   protected:
     // Data fields
@@ -45,6 +50,7 @@ class PartitionEntry {
     // Methods
     dkt::UString GetEntry() const;
     void SetEntry(const dkt::UString &);
+    bool IsGPTEntry() const;
     bool GetBootIndicator() const;
     unsigned char GetPartitionType() const;
     std::uint64_t GetStartingSector() const;
@@ -96,6 +102,8 @@ class NTFSVBR : public MBR {
     GetMFTMirrLCN() const; // retrieve MFTMirr sector from extended BPB
 };
 
-// Function prototypes (none)
+// Function prototypes
+dkt::EntryVector ParseGPTEntries(const GPT &); // used entries of a GPT
+dkt::EntryVector ParseEBREntries(const EBRChain &); // logical partitions
 
 #endif
\ No newline at end of file
@@ -0,0 +1,351 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Program 3 - Parser microbenchmarks and end-to-end throughput runs
+//
+// Written by Dien Tran. Compile with a C++11 compiler.
+//
+// Every result is one JSON object per line on standard output, so runs can be
+// diffed or fed to a regression checker. Microbenchmarks work on in-memory
+// sectors and need no disk; throughput runs take image files as arguments.
+
+#ifndef __linux
+#error This program can only be compiled on Linux systems.
+#endif
+
+#if __cplusplus < 201103L
+#error This program requires a C++11 or newer compiler.
+#endif
+
+#define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
+
+// Standard headers
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+// Self-defined headers
+#include "../Common/devio.h"
+#include "../Common/metrics.h"
+#include "../Common/outbuf.h"
+#include "Constants.hpp"
+#include "ImageBuilder.hpp"
+#include "MFT.hpp"
+#include "NameIndex.hpp"
+#include "utility.hpp"
+
+// Command line options
+struct Options {
+    std::uint64_t MinTime; // minimum wall time per microbenchmark, in ns
+    bool Micro;            // run microbenchmarks
+    bool Direct;           // read images around the page cache
+    std::vector<std::string> Images; // images for throughput runs
+};
+
+// Keeps results observable so the optimizer can't drop the work
+static volatile std::uint64_t sink;
+
+// Store a little-endian value of `n` bytes
+static void putLE(dkt::UString &buf, std::size_t offset, std::uint64_t value,
+                  int n) {
+    for (int i = 0; i < n; ++i) {
+        buf[offset + i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+// MBR with one NTFS partition and three other entries
+static dkt::UString makeMBR() {
+    dkt::UString mbr(SECTOR_SIZE, 0);
+    const unsigned char types[4] = {0x07, 0x83, 0x0B, 0x07};
+    for (int i = 0; i < 4; ++i) {
+        std::size_t entry = PARTITION_TABLE_OFFSET + PARTITION_ENTRY_SIZE * i;
+        mbr[entry + 4] = types[i];
+        putLE(mbr, entry + 8, 2048 + 1048576 * i, 4);
+        putLE(mbr, entry + 12, 1048576, 4);
+    }
+    mbr[SECTOR_SIZE - 2] = 0x55;
+    mbr[SECTOR_SIZE - 1] = 0xAA;
+    return mbr;
+}
+
+// In-use FILE record with $STANDARD_INFORMATION, $FILE_NAME and a
+// fragmented non-resident $DATA, update sequence applied as on disk
+static dkt::UString makeFileRecord() {
+    RecordBuilder builder(1024);
+    builder.Begin(64, 1, FILE_RECORD_FLAG_IN_USE);
+    builder.AddStandardInformation(132000000000000000ULL,
+                                   132000000000000001ULL,
+                                   132000000000000002ULL,
+                                   132000000000000003ULL);
+    builder.AddFileName(5 | 5ULL << 48, u"benchmark.txt", 1, 32 * 4096 - 100);
+
+    const Extent runs[3] = {
+        {0, 4096, 8, false}, {8, 5120, 8, false}, {16, 5152, 16, false}};
+    builder.AddNonResidentData(dkt::ExtentVector(runs, runs + 3), 4096,
+                               32 * 4096 - 100, 0);
+    return builder.Finish(0x0001);
+}
+
+// Name index over `count` names built from a few words, numbers and
+// extensions, in the mix a user volume has
+static void fillNameIndex(NameIndex &index, std::size_t count) {
+    const char *words[] = {"invoice", "report", "Draft", "IMG",  "backup",
+                           "notes",   "budget", "Mail",  "setup", "cache"};
+    const char *extensions[] = {".pst", ".txt", ".dll", ".jpg",
+                                ".docx", ".log", ".dat"};
+    for (std::size_t i = 0; i < count; ++i) {
+        unsigned number = i * 7919 % 100000;
+        char name[64];
+        std::snprintf(name, sizeof(name), "%s_%s%u%s", words[i % 10],
+                      words[i / 10 % 10], number, extensions[i % 7]);
+        RecordBuilder builder(1024);
+        builder.Begin(i, 1, FILE_RECORD_FLAG_IN_USE);
+        builder.AddFileName(5 | 5ULL << 48, UTF8ToUTF16(name), 1, 0);
+        index.Add(FileRecord(builder.Finish(0x0001), i));
+    }
+    index.Build();
+}
+
+// Time `op` in doubling batches until the batch runs for at least
+// `minTime`, then report the per-operation cost of the last batch
+template <typename Op>
+static void microbench(OutBuf *out, const char *name, std::size_t bytesPerOp,
+                       std::uint64_t minTime, Op op) {
+    std::uint64_t iterations = 1;
+    std::uint64_t elapsed = 0;
+    for (;;) {
+        std::uint64_t start = metricsNow();
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        elapsed = metricsNow() - start;
+        if (elapsed >= minTime || iterations >= (1ULL << 40)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double nsPerOp = static_cast<double>(elapsed) / iterations;
+    char numbers[96];
+    std::snprintf(numbers, sizeof(numbers), "%.2f,\"ops_per_sec\":%.0f",
+                  nsPerOp, 1e9 / nsPerOp);
+    outBufPuts(out, "{\"bench\":");
+    outBufJSONString(out, name, std::strlen(name));
+    outBufPuts(out, ",\"kind\":\"micro\",\"iterations\":");
+    outBufU64(out, iterations);
+    outBufPuts(out, ",\"ns_per_op\":");
+    outBufPuts(out, numbers);
+    if (bytesPerOp > 0) {
+        std::snprintf(numbers, sizeof(numbers), ",\"mb_per_sec\":%.1f",
+                      bytesPerOp * 1e3 / nsPerOp);
+        outBufPuts(out, numbers);
+    }
+    outBufPuts(out, "}\n");
+    outBufFlush(out);
+}
+
+void runMicrobenchmarks(OutBuf *out, std::uint64_t minTime) {
+    const dkt::UString mbrStr = makeMBR();
+    const dkt::UString vbrStr =
+        ImageBuilder::MakeVBR(4096, 2097152, 786432, 2, 2048, 0);
+    const dkt::UString recordStr = makeFileRecord();
+    const MBR mbr(mbrStr);
+    const NTFSVBR vbr(vbrStr);
+
+    microbench(out, "mbr_parse_entries", SECTOR_SIZE, minTime, [&]() {
+        sink = sink + mbr.ParseEntries().size();
+    });
+    microbench(out, "mbr_is_valid", SECTOR_SIZE, minTime,
+               [&]() { sink = sink + mbr.IsValidMBR(); });
+    microbench(out, "vbr_validate", SECTOR_SIZE, minTime, [&]() {
+        NTFSVBR parsed(vbrStr);
+        sink = sink + parsed.IsValidMBR();
+    });
+    microbench(out, "vbr_get_mft_lcn", 0, minTime,
+               [&]() { sink = sink + vbr.GetMFTLCN(); });
+    microbench(out, "vbr_get_mftmirr_lcn", 0, minTime,
+               [&]() { sink = sink + vbr.GetMFTMirrLCN(); });
+    microbench(out, "file_record_parse", recordStr.size(), minTime, [&]() {
+        FileRecord record(recordStr, 64);
+        sink = sink + record.GetExtents().size();
+    });
+
+    // Eight runs hopping back and forth across the volume
+    dkt::ExtentVector extents;
+    for (std::uint64_t i = 0; i < 8; ++i) {
+        Extent e = {8 * i, i % 2 ? 4096 + 70000 * i : 900000 - 3000 * i, 8,
+                    false};
+        extents.push_back(e);
+    }
+    const dkt::UString runs = RecordBuilder::EncodeRunlist(extents);
+    microbench(out, "runlist_decode", 0, minTime, [&]() {
+        const unsigned char *begin = &runs[0];
+        sink = sink +
+               FileRecord::DecodeRunlist(begin, begin + runs.size(), 0).size();
+    });
+
+    NameIndex names;
+    fillNameIndex(names, 100000);
+    const NameQuery substring = NameIndex::ParseQuery("*budget12*", false);
+    const NameQuery suffix = NameIndex::ParseQuery("*.PST", false);
+    microbench(out, "name_search_substring", 0, minTime,
+               [&]() { sink = sink + names.Search(substring).size(); });
+    microbench(out, "name_search_suffix", 0, minTime,
+               [&]() { sink = sink + names.Search(suffix).size(); });
+}
+
+// Report one end-to-end run
+static void reportThroughput(OutBuf *out, const char *name,
+                             const std::string &image, int partition,
+                             std::uint64_t records, std::uint64_t bytes,
+                             std::uint64_t elapsed) {
+    double seconds = elapsed / 1e9;
+    char numbers[128];
+    std::snprintf(numbers, sizeof(numbers),
+                  "%.6f,\"records_per_sec\":%.0f,\"mb_per_sec\":%.1f", seconds,
+                  records / seconds, bytes / 1e6 / seconds);
+    outBufPuts(out, "{\"bench\":");
+    outBufJSONString(out, name, std::strlen(name));
+    outBufPuts(out, ",\"kind\":\"throughput\",\"image\":");
+    outBufJSONString(out, image.c_str(), image.size());
+    outBufPuts(out, ",\"partition\":");
+    outBufU64(out, partition);
+    outBufPuts(out, ",\"records\":");
+    outBufU64(out, records);
+    outBufPuts(out, ",\"bytes\":");
+    outBufU64(out, bytes);
+    outBufPuts(out, ",\"seconds\":");
+    outBufPuts(out, numbers);
+    outBufPuts(out, "}\n");
+    outBufFlush(out);
+}
+
+// Raw $MFT read rate, then read + parse rate, for every NTFS partition in
+// the image. Direct I/O runs are reported with a "_direct" suffix. Returns a
+// Constants.hpp error code
+int runThroughput(OutBuf *out, const std::string &image, bool direct) {
+    int fd = devOpen(image.c_str(), direct);
+    if (fd < 0) {
+        perror(image.c_str());
+        return OPEN_ERROR;
+    }
+    std::string suffix = devIsDirect(fd) ? "_direct" : "";
+
+    dkt::UString mbrStr(SECTOR_SIZE);
+    if (devPread(fd, &mbrStr[0], SECTOR_SIZE, 0) != SECTOR_SIZE) {
+        perror("read");
+        devClose(fd);
+        return READ_ERROR;
+    }
+
+    int status = SUCCESS;
+    try {
+        dkt::EntryVector entries = MBR(mbrStr).ParseEntries();
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].GetPartitionType() != 0x07) {
+                continue;
+            }
+            std::uint64_t volumeOffset =
+                entries[i].GetStartingSector() * SECTOR_SIZE;
+            dkt::UString vbrStr(SECTOR_SIZE);
+            if (devPread(fd, &vbrStr[0], SECTOR_SIZE, volumeOffset) !=
+                SECTOR_SIZE) {
+                perror("read");
+                status = READ_ERROR;
+                break;
+            }
+            NTFSVBR vbr(vbrStr);
+            MFT mft(fd, volumeOffset, vbr);
+            std::uint64_t count = mft.GetRecordCount();
+            std::uint64_t size = mft.GetRecordSize();
+
+            // Raw reads in the same chunks ForEachRecord uses
+            std::uint64_t perChunk =
+                MFT_READ_SIZE / size ? MFT_READ_SIZE / size : 1;
+            DeviceBuffer buf(perChunk * size);
+            std::uint64_t start = metricsNow();
+            for (std::uint64_t first = 0; first < count; first += perChunk) {
+                std::uint64_t n =
+                    count - first < perChunk ? count - first : perChunk;
+                mft.ReadRecords(first, n, buf.Data());
+            }
+            reportThroughput(out, ("mft_read" + suffix).c_str(), image, i + 1, count,
+                             count * size, metricsNow() - start);
+
+            // Read and parse every record
+            std::uint64_t parsed = 0;
+            start = metricsNow();
+            mft.ForEachRecord([&](const FileRecord &record) {
+                parsed += record.IsInUse();
+            });
+            sink = sink + parsed;
+            reportThroughput(out, ("mft_scan" + suffix).c_str(), image, i + 1, count,
+                             count * size, metricsNow() - start);
+        }
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "%s: %s\n", image.c_str(), e.what());
+        status = MFT_ERROR;
+    }
+
+    devClose(fd);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+    opts.MinTime = 200000000; // 200 ms
+    opts.Micro = true;
+    opts.Direct = false;
+
+    const struct option longOptions[] = {
+        {"min-time", required_argument, NULL, 't'},
+        {"no-micro", no_argument, NULL, 'n'},
+        {"direct", no_argument, NULL, 'D'},
+        {NULL, 0, NULL, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "t:n", longOptions, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            opts.MinTime = std::strtoull(optarg, NULL, 10) * 1000000;
+            break;
+        case 'n':
+            opts.Micro = false;
+            break;
+        case 'D':
+            opts.Direct = true;
+            break;
+        default:
+            std::fprintf(stderr,
+                         "Usage: %s [--min-time MS] [--no-micro] [--direct] "
+                         "[IMAGE...]\n",
+                         argv[0]);
+            return ARGUMENT_EXPECTED;
+        }
+    }
+    for (int i = optind; i < argc; ++i) {
+        opts.Images.push_back(argv[i]);
+    }
+
+    OutBuf out;
+    outBufInit(&out, STDOUT_FILENO, OUTBUF_DEFAULT_CAPACITY);
+
+    if (opts.Micro) {
+        runMicrobenchmarks(&out, opts.MinTime);
+    }
+    int status = SUCCESS;
+    for (std::size_t i = 0; i < opts.Images.size(); ++i) {
+        int result = runThroughput(&out, opts.Images[i], opts.Direct);
+        if (status == SUCCESS) {
+            status = result;
+        }
+    }
+
+    outBufFree(&out);
+    return status;
+}
@@ -0,0 +1,219 @@
+#include "Checkpoint.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+const char *const CHECKPOINT_MAGIC = "ntfs-checkpoint 1"; // first line
+
+// Whole-string unsigned decimal
+bool parseU64(const std::string &text, std::uint64_t &value) {
+    if (text.empty() || text[0] < '0' || text[0] > '9') {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    value = std::strtoull(text.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+void putText(OutBuf *out, const char *key, const std::string &value) {
+    outBufPuts(out, key);
+    outBufPutc(out, ' ');
+    outBufWrite(out, value.data(), value.size());
+    outBufPutc(out, '\n');
+}
+
+void putField(OutBuf *out, const char *key, std::uint64_t value) {
+    outBufPuts(out, key);
+    outBufPutc(out, ' ');
+    outBufU64(out, value);
+    outBufPutc(out, '\n');
+}
+
+// Make a rename in `path`'s directory durable
+bool syncDirectory(const std::string &path) {
+    std::string::size_type slash = path.rfind('/');
+    std::string dir = ".";
+    if (slash == 0) {
+        dir = "/";
+    } else if (slash != std::string::npos) {
+        dir = path.substr(0, slash);
+    }
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+} // namespace
+
+// Fresh scan, from the first record of the first partition
+ScanState::ScanState()
+    : List(false), Hash(false), Partition(0), Serial(0), NextRecord(0),
+      OutputBytes(0), Listed(0), Hashed(0), Known(0), Failed(0), Skipped(0) {}
+
+// Move on to NTFS partition `partition`, with its counters at zero
+void ScanState::StartPartition(std::size_t partition, std::uint64_t serial) {
+    this->Partition = partition;
+    this->Serial = serial;
+    this->NextRecord = 0;
+    this->Listed = 0;
+    this->Hashed = 0;
+    this->Known = 0;
+    this->Failed = 0;
+    this->Skipped = 0;
+}
+
+// Whether `other` was taken with the options this scan writes its rows with
+bool ScanState::SameListing(const ScanState &other) const {
+    return this->Format == other.Format && this->List == other.List &&
+           this->Hash == other.Hash && this->KnownPath == other.KnownPath;
+}
+
+// `Checkpoint` constructor. Nothing is read or written until `Load`/`Save`
+Checkpoint::Checkpoint(const std::string &path, std::uint64_t interval,
+                       OutBuf *listing)
+    : path(path), interval(interval ? interval : 1), listing(listing) {}
+
+const std::string &Checkpoint::GetPath() const { return this->path; }
+
+std::uint64_t Checkpoint::GetInterval() const { return this->interval; }
+
+bool Checkpoint::Load(ScanState &state) const {
+    std::ifstream in(this->path.c_str());
+    if (!in) {
+        return false;
+    }
+
+    const std::string malformed = "Malformed checkpoint " + this->path;
+    std::string line;
+    if (!std::getline(in, line) || line != CHECKPOINT_MAGIC) {
+        throw std::runtime_error(malformed);
+    }
+    ScanState loaded;
+    while (std::getline(in, line)) {
+        std::string::size_type space = line.find(' ');
+        if (space == std::string::npos) {
+            throw std::runtime_error(malformed);
+        }
+        std::string key = line.substr(0, space);
+        std::string text = line.substr(space + 1);
+        if (key == "device") {
+            loaded.Device = text;
+            continue;
+        }
+        if (key == "format") {
+            loaded.Format = text;
+            continue;
+        }
+        if (key == "known-list") {
+            loaded.KnownPath = text;
+            continue;
+        }
+        if (key == "output-bytes" && text == "-1") {
+            loaded.OutputBytes = -1;
+            continue;
+        }
+
+        std::uint64_t value;
+        if (!parseU64(text, value)) {
+            throw std::runtime_error(malformed);
+        }
+        if (key == "list") {
+            loaded.List = value != 0;
+        } else if (key == "hash") {
+            loaded.Hash = value != 0;
+        } else if (key == "partition") {
+            loaded.Partition = value;
+        } else if (key == "serial") {
+            loaded.Serial = value;
+        } else if (key == "next-record") {
+            loaded.NextRecord = value;
+        } else if (key == "output-bytes") {
+            loaded.OutputBytes = value;
+        } else if (key == "listed") {
+            loaded.Listed = value;
+        } else if (key == "hashed") {
+            loaded.Hashed = value;
+        } else if (key == "known") {
+            loaded.Known = value;
+        } else if (key == "failed") {
+            loaded.Failed = value;
+        } else if (key == "skipped") {
+            loaded.Skipped = value;
+        } else {
+            throw std::runtime_error(malformed);
+        }
+    }
+
+    state = loaded;
+    return true;
+}
+
+bool Checkpoint::Save(ScanState &state) const {
+    // Rows up to here must be on disk before the state that counts them
+    if (!outBufFlush(this->listing)) {
+        errno = EIO;
+        return false;
+    }
+    // An appended listing ends at the end of the file, even before the first
+    // write has moved the offset there
+    int flags = fcntl(this->listing->FD, F_GETFL);
+    state.OutputBytes =
+        lseek(this->listing->FD, 0,
+              flags >= 0 && (flags & O_APPEND) ? SEEK_END : SEEK_CUR);
+    if (state.OutputBytes >= 0 && fsync(this->listing->FD) != 0 &&
+        errno != EINVAL) {
+        return false; // EINVAL: nothing to sync, as on /dev/null
+    }
+
+    std::string temp = this->path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    OutBuf out;
+    outBufInit(&out, fd, 4096);
+    outBufPuts(&out, CHECKPOINT_MAGIC);
+    outBufPutc(&out, '\n');
+    putText(&out, "device", state.Device);
+    putText(&out, "format", state.Format);
+    putField(&out, "list", state.List);
+    putField(&out, "hash", state.Hash);
+    if (!state.KnownPath.empty()) {
+        putText(&out, "known-list", state.KnownPath);
+    }
+    putField(&out, "partition", state.Partition);
+    putField(&out, "serial", state.Serial);
+    putField(&out, "next-record", state.NextRecord);
+    outBufPuts(&out, "output-bytes ");
+    outBufI64(&out, state.OutputBytes);
+    outBufPutc(&out, '\n');
+    putField(&out, "listed", state.Listed);
+    putField(&out, "hashed", state.Hashed);
+    putField(&out, "known", state.Known);
+    putField(&out, "failed", state.Failed);
+    putField(&out, "skipped", state.Skipped);
+    bool ok = outBufFlush(&out) && fsync(fd) == 0;
+    outBufFree(&out);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+
+    if (!ok || std::rename(temp.c_str(), this->path.c_str()) != 0) {
+        saved = errno;
+        unlink(temp.c_str());
+        errno = saved;
+        return false;
+    }
+    return syncDirectory(this->path);
+}
+
+void Checkpoint::Remove() const { unlink(this->path.c_str()); }
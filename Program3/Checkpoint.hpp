@@ -0,0 +1,72 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_CHECKPOINT_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_CHECKPOINT_HPP_
+
+// Standard library
+#include <cstddef> // std::size_t
+#include <cstdint> // for standard types
+#include <string>  // std::string
+
+// Self-defined
+#include "../Common/outbuf.h"
+
+// How far a listing/hashing scan has got: everything before `NextRecord` of
+// NTFS partition `Partition` is in the listing, and the counters cover it.
+// The options that shape the listing are kept too, since a resumed scan has
+// to go on writing the same rows
+struct ScanState {
+    std::string Device;        // device or image scanned
+    std::string Format;        // listing format
+    bool List;                 // --list
+    bool Hash;                 // --hash
+    std::string KnownPath;     // --known list, if any
+    std::size_t Partition;     // NTFS partition in progress, 0-based
+    std::uint64_t Serial;      // its volume serial number
+    std::uint64_t NextRecord;  // first $MFT record not yet listed
+    std::int64_t OutputBytes;  // listing bytes written, -1 if not seekable
+    std::uint64_t Listed;      // rows written
+    std::uint64_t Hashed;      // files hashed
+    std::uint64_t Known;       // known files filtered
+    std::uint64_t Failed;      // files that couldn't be read
+    std::uint64_t Skipped;     // compressed/encrypted files skipped
+
+    ScanState();
+    void StartPartition(std::size_t, std::uint64_t); // index, serial
+    bool SameListing(const ScanState &) const;       // options match
+};
+
+// Class definitions
+
+// State file for resuming a scan. Every save writes a temp file next to it,
+// syncs it and renames it over the old one, so a crash leaves either the
+// previous checkpoint or the new one, never a torn file.
+class Checkpoint {
+  protected:
+    // Data fields
+    std::string path;       // state file
+    std::uint64_t interval; // $MFT records between saves
+    OutBuf *listing;        // listing output, flushed before every save
+
+  public:
+    // Constructors
+    Checkpoint(const std::string &, std::uint64_t, OutBuf *); // path,
+                                                              // interval,
+                                                              // listing
+
+    // Methods
+    const std::string &GetPath() const;
+    std::uint64_t GetInterval() const;
+
+    // Load the saved state. Returns false if there is no state file yet.
+    // THROWS:
+    //  - std::runtime_error("Malformed checkpoint ${path}"): if the file
+    //  can't be parsed
+    bool Load(ScanState &) const;
+
+    // Flush the listing, note its length in `OutputBytes` and save. Returns
+    // false with errno set on failure
+    bool Save(ScanState &) const;
+
+    void Remove() const; // the scan is complete
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "ClusterIndex.hpp"
+#include <algorithm>
+
+#include "Constants.hpp"
+
+namespace {
+bool byLCN(const ClusterExtent &a, const ClusterExtent &b) {
+    return a.LCN < b.LCN;
+}
+
+bool byFirst(const ClusterRange &a, const ClusterRange &b) {
+    return a.First < b.First || (a.First == b.First && a.End < b.End);
+}
+} // namespace
+
+ClusterIndex::ClusterIndex() : nameBytes(0) {}
+
+std::uint32_t ClusterIndex::OwnerId(std::uint64_t record) {
+    auto found = this->ownerIds.find(record);
+    if (found != this->ownerIds.end()) {
+        return found->second;
+    }
+    std::uint32_t id = this->owners.size();
+    ClusterOwner owner;
+    owner.RecordNumber = record;
+    this->owners.push_back(owner);
+    this->ownerIds[record] = id;
+    return id;
+}
+
+// Attribute table entry for an attribute's type and name
+std::uint32_t ClusterIndex::AttributeId(const AttributeRuns &runs) {
+    std::string label = AttributeTypeName(runs.Type);
+    if (!runs.Name.empty()) {
+        label += ':' + UTF16ToUTF8(runs.Name);
+    }
+    auto found = this->attributeIds.find(label);
+    if (found != this->attributeIds.end()) {
+        return found->second;
+    }
+    std::uint32_t id = this->attributes.size();
+    this->attributes.push_back(label);
+    this->attributeIds[label] = id;
+    return id;
+}
+
+void ClusterIndex::Add(const FileRecord &record) {
+    std::uint64_t base = record.IsBaseRecord()
+                             ? record.GetRecordNumber()
+                             : record.GetBaseReference() & MFT_REFERENCE_MASK;
+    // Records with only resident attributes own no clusters, but a base
+    // record with an attribute list may have runs in extension records
+    dkt::AttributeRunsVector attributes = record.GetAttributeRuns();
+    if (attributes.empty() && !record.HasAttributeList()) {
+        return;
+    }
+    if (record.IsBaseRecord() && record.HasFileName()) {
+        std::string &name = this->owners[this->OwnerId(base)].Name;
+        this->nameBytes -= name.capacity();
+        name = record.GetFileNameUTF8();
+        this->nameBytes += name.capacity();
+    }
+
+    for (std::size_t a = 0; a < attributes.size(); ++a) {
+        const dkt::ExtentVector &runs = attributes[a].Extents;
+        std::uint32_t attribute = this->AttributeId(attributes[a]);
+        for (std::size_t i = 0; i < runs.size(); ++i) {
+            if (runs[i].Sparse || runs[i].Length == 0) {
+                continue;
+            }
+            ClusterExtent extent;
+            extent.LCN = runs[i].LCN;
+            extent.Length = runs[i].Length;
+            extent.VCN = runs[i].VCN;
+            extent.Owner = this->OwnerId(base);
+            extent.Attribute = attribute;
+            extent.Live = record.IsInUse();
+            this->extents.push_back(extent);
+        }
+    }
+}
+
+// Fill in `maxEnd` for the subtree rooted at the middle of [lo, hi), and
+// return it
+std::uint64_t ClusterIndex::Augment(std::size_t lo, std::size_t hi) {
+    if (lo >= hi) {
+        return 0;
+    }
+    std::size_t mid = lo + (hi - lo) / 2;
+    std::uint64_t end = this->extents[mid].LCN + this->extents[mid].Length;
+    std::uint64_t left = this->Augment(lo, mid);
+    std::uint64_t right = this->Augment(mid + 1, hi);
+    end = std::max(end, std::max(left, right));
+    this->maxEnd[mid] = end;
+    return end;
+}
+
+void ClusterIndex::Build() {
+    std::sort(this->extents.begin(), this->extents.end(), byLCN);
+    this->maxEnd.assign(this->extents.size(), 0);
+    this->Augment(0, this->extents.size());
+    this->ownerIds.clear(); // only needed while adding
+    this->attributeIds.clear();
+}
+
+// Extents of the slice [lo, hi) overlapping `range`, in LCN order
+void ClusterIndex::Collect(std::size_t lo, std::size_t hi,
+                           const ClusterRange &range,
+                           dkt::ClusterExtentVector &found) const {
+    if (lo >= hi) {
+        return;
+    }
+    std::size_t mid = lo + (hi - lo) / 2;
+    if (this->maxEnd[mid] <= range.First) {
+        return; // everything here ends before the range
+    }
+    this->Collect(lo, mid, range, found);
+    const ClusterExtent &extent = this->extents[mid];
+    if (extent.LCN >= range.End) {
+        return; // this and everything after start past the range
+    }
+    if (extent.LCN + extent.Length > range.First) {
+        found.push_back(extent);
+    }
+    this->Collect(mid + 1, hi, range, found);
+}
+
+dkt::ClusterExtentVector ClusterIndex::Find(const ClusterRange &range) const {
+    dkt::ClusterExtentVector found;
+    this->Collect(0, this->extents.size(), range, found);
+    return found;
+}
+
+void ClusterIndex::Annotate(
+    dkt::ClusterRangeVector &hits,
+    const std::function<void(const ClusterRange &, const ClusterExtent *)>
+        &emit) const {
+    std::sort(hits.begin(), hits.end(), byFirst);
+
+    // Extents that have started and may still overlap a hit. Only as many
+    // as overlap at one spot, so a plain list does
+    std::vector<std::size_t> open;
+    std::vector<std::size_t> overlapping;
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < hits.size(); ++i) {
+        const ClusterRange &hit = hits[i];
+        while (next < this->extents.size() &&
+               this->extents[next].LCN < hit.End) {
+            open.push_back(next++);
+        }
+
+        overlapping.clear();
+        for (std::size_t j = 0; j < open.size();) {
+            const ClusterExtent &extent = this->extents[open[j]];
+            if (extent.LCN + extent.Length <= hit.First) {
+                // Hits only move forward, so this one is done with
+                open[j] = open.back();
+                open.pop_back();
+                continue;
+            }
+            if (extent.LCN < hit.End) {
+                overlapping.push_back(open[j]); // not so for a shorter hit
+            }
+            ++j;
+        }
+        if (overlapping.empty()) {
+            emit(hit, NULL);
+            continue;
+        }
+        std::sort(overlapping.begin(), overlapping.end());
+        for (std::size_t j = 0; j < overlapping.size(); ++j) {
+            emit(hit, &this->extents[overlapping[j]]);
+        }
+    }
+}
+
+const ClusterOwner &ClusterIndex::GetOwner(const ClusterExtent &extent) const {
+    return this->owners[extent.Owner];
+}
+
+const std::string &
+ClusterIndex::GetAttribute(const ClusterExtent &extent) const {
+    return this->attributes[extent.Attribute];
+}
+
+std::size_t ClusterIndex::GetExtentCount() const {
+    return this->extents.size();
+}
+
+std::size_t ClusterIndex::GetOwnerCount() const { return this->owners.size(); }
+
+std::size_t ClusterIndex::GetMemoryUsage() const {
+    // Hash map nodes carry a next pointer and the cached hash
+    std::size_t node = sizeof(std::pair<const std::uint64_t, std::uint32_t>) +
+                       2 * sizeof(void *);
+    return this->extents.capacity() * sizeof(ClusterExtent) +
+           this->extents.size() * sizeof(std::uint64_t) + // `maxEnd`
+           this->owners.capacity() * sizeof(ClusterOwner) + this->nameBytes +
+           this->ownerIds.size() * node +
+           this->ownerIds.bucket_count() * sizeof(void *);
+}
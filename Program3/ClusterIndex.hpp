@@ -0,0 +1,101 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_CLUSTERINDEX_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_CLUSTERINDEX_HPP_
+
+// Standard library
+#include <cstddef>       // std::size_t
+#include <cstdint>       // for standard types
+#include <functional>    // std::function
+#include <string>        // std::string
+#include <unordered_map> // std::unordered_map
+#include <vector>        // std::vector
+
+// Self-defined
+#include "MFT.hpp"
+
+// Clusters [First, End) of a volume
+struct ClusterRange {
+    std::uint64_t First;
+    std::uint64_t End;
+};
+
+// Run of clusters, and the file and attribute that own or owned them
+struct ClusterExtent {
+    std::uint64_t LCN;       // first cluster
+    std::uint64_t Length;    // in clusters
+    std::uint64_t VCN;       // position of `LCN` in the attribute
+    std::uint32_t Owner;     // index into the owner table
+    std::uint32_t Attribute; // index into the attribute table
+    bool Live;               // the record mapping the run is in use
+};
+
+// File that extents belong to
+struct ClusterOwner {
+    std::uint64_t RecordNumber; // base record
+    std::string Name;           // UTF-8, empty until the base record is seen
+};
+
+// Type aliases
+namespace dkt {
+typedef std::vector<ClusterRange> ClusterRangeVector;
+typedef std::vector<ClusterExtent> ClusterExtentVector;
+} // namespace dkt
+
+// Class definitions
+
+// Reverse map from clusters to files, built from the runlists of every
+// record, live or deleted. Extents are kept in one array sorted by LCN,
+// which doubles as an implicit balanced search tree (the root of each
+// slice is its middle element) augmented with the furthest extent end in
+// each subtree, so the overlaps of a cluster range are found in
+// O(log n + k) even though extents of deleted files overlap live ones.
+class ClusterIndex {
+  protected:
+    // Data fields
+    dkt::ClusterExtentVector extents; // sorted by LCN once built
+    std::vector<std::uint64_t> maxEnd; // furthest end in each subtree
+    std::vector<ClusterOwner> owners;
+    std::unordered_map<std::uint64_t, std::uint32_t> ownerIds; // by record
+    std::vector<std::string> attributes; // "$DATA", "$DATA:$J", ...
+    std::unordered_map<std::string, std::uint32_t> attributeIds;
+    std::size_t nameBytes; // owner names
+
+    std::uint32_t OwnerId(std::uint64_t); // owner entry of a base record
+    std::uint32_t AttributeId(const AttributeRuns &);
+    std::uint64_t Augment(std::size_t, std::size_t); // slice [lo, hi)
+    void Collect(std::size_t, std::size_t, const ClusterRange &,
+                 dkt::ClusterExtentVector &) const;
+
+  public:
+    // Constructors
+    ClusterIndex();
+
+    // Methods
+
+    // Take in the runs of a record's non-resident attributes: every $DATA
+    // stream, $INDEX_ALLOCATION, $BITMAP, ... Extension records count
+    // toward their base record's file
+    void Add(const FileRecord &);
+    void Build(); // sort and augment; call once every record is added
+
+    // Extents overlapping `range`, by LCN
+    dkt::ClusterExtentVector Find(const ClusterRange &) const;
+
+    // Annotate many hits in one merge pass: `hits` are sorted, then swept
+    // against the extents, keeping the ones still open at the sweep line.
+    // `emit` gets each hit with each extent overlapping it (in LCN order),
+    // or with null if none
+    void Annotate(dkt::ClusterRangeVector &,
+                  const std::function<void(const ClusterRange &,
+                                           const ClusterExtent *)> &) const;
+
+    const ClusterOwner &GetOwner(const ClusterExtent &) const;
+    const std::string &GetAttribute(const ClusterExtent &) const; // $TYPE:name
+    std::size_t GetExtentCount() const;
+    std::size_t GetOwnerCount() const;
+
+    // Estimated bytes held once built, extents and the owner table with
+    // its map; the handful of attribute labels aren't counted
+    std::size_t GetMemoryUsage() const;
+};
+
+#endif
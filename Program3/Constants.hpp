@@ -1,13 +1,19 @@
 #ifndef SUMMER_NTFS_PROJECT_PROGRAM3_CONSTANTS_HPP_
 #define SUMMER_NTFS_PROJECT_PROGRAM3_CONSTANTS_HPP_
 
+#include <cstdint> // for standard types
+
 // Error codes
 const int SUCCESS = 0;
 const int ARGUMENT_EXPECTED = 1;
 const int OPEN_ERROR = 2;
 const int READ_ERROR = 3;
 const int LSEEK_ERROR = 4;
-const int GPT_FORMATTED = 5;
+const int GPT_FORMATTED = 5; // GPT disk with both GPT headers corrupt
+const int MFT_ERROR = 6;
+const int WRITE_ERROR = 7;
+const int CHECKPOINT_ERROR = 8; // checkpoint can't be saved or resumed
+const int MEMORY_ERROR = 9;     // index won't fit in --memory-budget
 
 // Magic numbers
 const int SECTOR_SIZE = 512;            // sector size
@@ -18,5 +24,72 @@ const int NTFS_VBR_MFT_OFFSET = 0x30; // MFT starting sector, starting from VBR
 const int NTFS_VBR_MFTMIRR_OFFSET =
     0x38;                   // MFTMirr starting sector, starting from VBR
 const int CLUSTER_SIZE = 8; // cluster size, in sectors
+const int NTFS_VBR_BYTES_PER_SECTOR_OFFSET = 0x0B;    // bytes per sector
+const int NTFS_VBR_SECTORS_PER_CLUSTER_OFFSET = 0x0D; // sectors per cluster
+const int NTFS_VBR_TOTAL_SECTORS_OFFSET = 0x28;       // sectors in volume
+const int NTFS_VBR_RECORD_SIZE_OFFSET = 0x40;         // file record size
+const int NTFS_VBR_INDEX_SIZE_OFFSET = 0x44;          // index block size
+const int NTFS_VBR_SERIAL_OFFSET = 0x48;              // volume serial number
+
+// File record (FILE) header
+const int FILE_RECORD_USA_OFFSET = 0x04;        // update sequence array offset
+const int FILE_RECORD_USA_COUNT_OFFSET = 0x06;  // update sequence array count
+const int FILE_RECORD_SEQUENCE_OFFSET = 0x10;   // sequence number
+const int FILE_RECORD_LINK_COUNT_OFFSET = 0x12; // hard link count
+const int FILE_RECORD_ATTR_OFFSET = 0x14;       // first attribute offset
+const int FILE_RECORD_FLAGS_OFFSET = 0x16;      // in use/directory flags
+const int FILE_RECORD_USED_OFFSET = 0x18;       // bytes in use
+const int FILE_RECORD_ALLOCATED_OFFSET = 0x1C;  // bytes allocated
+const int FILE_RECORD_BASE_OFFSET = 0x20;       // base record reference
+const int FILE_RECORD_NUMBER_OFFSET = 0x2C;     // own record number
+const int FILE_RECORD_FIXUP_STRIDE = 512;       // bytes covered by a fixup
+const int FILE_RECORD_MIN_SIZE = 256;           // smallest valid record
+const int FILE_RECORD_MAX_SIZE = 65536;         // largest valid record
+const std::uint64_t MFT_REFERENCE_MASK = 0x0000FFFFFFFFFFFFULL; // record part
+const int FILE_RECORD_FLAG_IN_USE = 0x01;
+const int FILE_RECORD_FLAG_DIRECTORY = 0x02;
+
+// Attributes
+const std::uint32_t ATTR_STANDARD_INFORMATION = 0x10;
+const std::uint32_t ATTR_ATTRIBUTE_LIST = 0x20;
+const std::uint32_t ATTR_FILE_NAME = 0x30;
+const std::uint32_t ATTR_OBJECT_ID = 0x40;
+const std::uint32_t ATTR_SECURITY_DESCRIPTOR = 0x50;
+const std::uint32_t ATTR_VOLUME_NAME = 0x60;
+const std::uint32_t ATTR_VOLUME_INFORMATION = 0x70;
+const std::uint32_t ATTR_DATA = 0x80;
+const std::uint32_t ATTR_INDEX_ROOT = 0x90;
+const std::uint32_t ATTR_INDEX_ALLOCATION = 0xA0;
+const std::uint32_t ATTR_BITMAP = 0xB0;
+const std::uint32_t ATTR_REPARSE_POINT = 0xC0;
+const std::uint32_t ATTR_EA_INFORMATION = 0xD0;
+const std::uint32_t ATTR_EA = 0xE0;
+const std::uint32_t ATTR_LOGGED_UTILITY_STREAM = 0x100;
+const std::uint32_t ATTR_END = 0xFFFFFFFF;
+const int ATTR_FLAG_COMPRESSED = 0x0001;
+const int ATTR_FLAG_ENCRYPTED = 0x4000;
+const int ATTR_FLAG_SPARSE = 0x8000;
+const int FILE_NAME_NAMESPACE_DOS = 2; // 8.3 short name namespace
+
+// Bulk reads
+const int MFT_READ_SIZE = 1 << 20;  // bytes of $MFT read per request
+const int HASH_READ_SIZE = 1 << 20; // bytes read per hashing request
+
+// Checkpoints
+const int CHECKPOINT_INTERVAL = 1 << 16; // $MFT records between saves
+
+// Memory budget
+const std::uint64_t MEMORY_BUDGET = 1 << 30; // bytes of held-back rows
+const int SPILL_MERGE_FAN_IN = 64;           // runs merged at once
+const int SPILL_BUFFER_SIZE = 1 << 16;       // stdio buffer per run
+
+// Slack extraction
+const int SLACK_READ_SIZE = 1 << 20;  // longest read of file slack
+const int SLACK_BATCH_SIZE = 4 << 20; // bytes of file slack per batch
+const int SLACK_BATCH_REGIONS = 4096; // regions per batch
+const int SLACK_JOIN_GAP = 1 << 16;   // closer regions share a read
+
+// Rescue reads
+const unsigned RESCUE_RETRIES = 3; // extra tries per bad sector
 
 #endif
\ No newline at end of file
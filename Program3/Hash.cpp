@@ -0,0 +1,504 @@
+#include "Hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "../Common/devio.h"
+
+namespace {
+// XXH64 primes
+const std::uint64_t PRIME64_1 = 11400714785074694791ULL;
+const std::uint64_t PRIME64_2 = 14029467366897019727ULL;
+const std::uint64_t PRIME64_3 = 1609587929392839161ULL;
+const std::uint64_t PRIME64_4 = 9650029242287828579ULL;
+const std::uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+// SHA-256 round constants
+const std::uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+std::uint64_t rotl64(std::uint64_t x, int r) { return x << r | x >> (64 - r); }
+
+std::uint32_t rotr32(std::uint32_t x, int r) { return x >> r | x << (32 - r); }
+
+std::uint64_t load64(const unsigned char *p) {
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value)); // little-endian host (Linux/x86)
+    return value;
+}
+
+std::uint32_t load32(const unsigned char *p) {
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+std::uint64_t xxhRound(std::uint64_t acc, std::uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+std::uint64_t xxhMerge(std::uint64_t acc, std::uint64_t value) {
+    acc ^= xxhRound(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+} // namespace
+
+// `XXH64` constructor
+XXH64::XXH64(std::uint64_t seed) : seed(seed), total(0), buffered(0) {
+    this->v[0] = seed + PRIME64_1 + PRIME64_2;
+    this->v[1] = seed + PRIME64_2;
+    this->v[2] = seed;
+    this->v[3] = seed - PRIME64_1;
+}
+
+// Feed bytes
+void XXH64::Update(const void *data, std::size_t length) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + length;
+    this->total += length;
+
+    // Top up a pending stripe first
+    if (this->buffered > 0) {
+        std::size_t take = std::min<std::size_t>(32 - this->buffered, length);
+        std::memcpy(this->buffer + this->buffered, p, take);
+        this->buffered += take;
+        p += take;
+        if (this->buffered < 32) {
+            return;
+        }
+        for (int i = 0; i < 4; ++i) {
+            this->v[i] = xxhRound(this->v[i], load64(this->buffer + 8 * i));
+        }
+        this->buffered = 0;
+    }
+
+    // Whole stripes
+    while (end - p >= 32) {
+        for (int i = 0; i < 4; ++i) {
+            this->v[i] = xxhRound(this->v[i], load64(p + 8 * i));
+        }
+        p += 32;
+    }
+
+    // Keep the tail for later
+    std::memcpy(this->buffer, p, end - p);
+    this->buffered = end - p;
+}
+
+// Final 64-bit hash. The state is left untouched
+std::uint64_t XXH64::Digest() const {
+    std::uint64_t h;
+    if (this->total >= 32) {
+        h = rotl64(this->v[0], 1) + rotl64(this->v[1], 7) +
+            rotl64(this->v[2], 12) + rotl64(this->v[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h = xxhMerge(h, this->v[i]);
+        }
+    } else {
+        h = this->seed + PRIME64_5;
+    }
+    h += this->total;
+
+    const unsigned char *p = this->buffer;
+    const unsigned char *end = p + this->buffered;
+    while (end - p >= 8) {
+        h ^= xxhRound(0, load64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= static_cast<std::uint64_t>(load32(p)) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        ++p;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// `SHA256` constructor
+SHA256::SHA256() : total(0), buffered(0) {
+    const std::uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                      0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                      0x1f83d9ab, 0x5be0cd19};
+    std::memcpy(this->state, initial, sizeof(initial));
+}
+
+// Compress one 64-byte block
+void SHA256::Transform(const unsigned char *chunk) {
+    std::uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = static_cast<std::uint32_t>(chunk[4 * i]) << 24 |
+               chunk[4 * i + 1] << 16 | chunk[4 * i + 2] << 8 |
+               chunk[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        std::uint32_t s0 =
+            rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ w[i - 15] >> 3;
+        std::uint32_t s1 =
+            rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ w[i - 2] >> 10;
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    std::uint32_t a = this->state[0], b = this->state[1], c = this->state[2],
+                  d = this->state[3], e = this->state[4], f = this->state[5],
+                  g = this->state[6], h = this->state[7];
+    for (int i = 0; i < 64; ++i) {
+        std::uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        std::uint32_t ch = (e & f) ^ (~e & g);
+        std::uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+        std::uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        std::uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    this->state[0] += a;
+    this->state[1] += b;
+    this->state[2] += c;
+    this->state[3] += d;
+    this->state[4] += e;
+    this->state[5] += f;
+    this->state[6] += g;
+    this->state[7] += h;
+}
+
+// Feed bytes
+void SHA256::Update(const void *data, std::size_t length) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    this->total += length;
+
+    if (this->buffered > 0) {
+        std::size_t take = std::min<std::size_t>(64 - this->buffered, length);
+        std::memcpy(this->block + this->buffered, p, take);
+        this->buffered += take;
+        p += take;
+        length -= take;
+        if (this->buffered < 64) {
+            return;
+        }
+        this->Transform(this->block);
+        this->buffered = 0;
+    }
+
+    while (length >= 64) {
+        this->Transform(p);
+        p += 64;
+        length -= 64;
+    }
+
+    std::memcpy(this->block, p, length);
+    this->buffered = length;
+}
+
+// Pad and produce the digest. The object must not be updated afterwards
+dkt::Digest SHA256::Final() {
+    std::uint64_t bits = this->total * 8;
+    unsigned char pad[72] = {0x80};
+    std::size_t padLength =
+        this->buffered < 56 ? 56 - this->buffered : 120 - this->buffered;
+    for (int i = 0; i < 8; ++i) {
+        pad[padLength + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+    this->Update(pad, padLength + 8);
+
+    dkt::Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<unsigned char>(this->state[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(this->state[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(this->state[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(this->state[i]);
+    }
+    return digest;
+}
+
+// `KnownHashSet` constructor. Sizes the table to at most half full, so probe
+// sequences stay short
+KnownHashSet::KnownHashSet(const std::vector<dkt::Digest> &digests)
+    : count(0) {
+    std::size_t capacity = 16;
+    while (capacity < 2 * digests.size()) {
+        capacity *= 2;
+    }
+    this->slots.resize(capacity);
+    this->used.resize(capacity, false);
+    this->mask = capacity - 1;
+
+    for (std::size_t i = 0; i < digests.size(); ++i) {
+        // Digests are already uniformly distributed, so the first 8 bytes
+        // make a fine table hash
+        std::size_t slot = load64(&digests[i][0]) & this->mask;
+        while (this->used[slot] && this->slots[slot] != digests[i]) {
+            slot = (slot + 1) & this->mask;
+        }
+        if (!this->used[slot]) {
+            this->used[slot] = true;
+            this->slots[slot] = digests[i];
+            ++this->count;
+        }
+    }
+}
+
+// Membership check
+bool KnownHashSet::Contains(const dkt::Digest &digest) const {
+    std::size_t slot = load64(&digest[0]) & this->mask;
+    while (this->used[slot]) {
+        if (this->slots[slot] == digest) {
+            return true;
+        }
+        slot = (slot + 1) & this->mask;
+    }
+    return false;
+}
+
+std::size_t KnownHashSet::Size() const { return this->count; }
+
+// Load a known-hash list. Every line starting with 64 hex digits contributes
+// one digest; anything else (headers, comments, other columns) is ignored.
+// THROWS:
+//  - std::runtime_error("Cannot open ${path}"): if the file can't be opened
+KnownHashSet KnownHashSet::FromFile(const std::string &path) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    std::vector<dkt::Digest> digests;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.size() < 64) {
+            continue;
+        }
+        dkt::Digest digest;
+        bool valid = true;
+        for (int i = 0; i < 32 && valid; ++i) {
+            int high = hexValue(line[2 * i]);
+            int low = hexValue(line[2 * i + 1]);
+            valid = high >= 0 && low >= 0;
+            digest[i] = static_cast<unsigned char>(high << 4 | low);
+        }
+        if (valid) {
+            digests.push_back(digest);
+        }
+    }
+
+    return KnownHashSet(digests);
+}
+
+// `HashPool` constructor. Starts `workers` threads (at least one)
+HashPool::HashPool(int fd, std::uint64_t volumeOffset,
+                   std::uint64_t clusterSize, unsigned workers,
+                   const KnownHashSet *known)
+    : fd(fd), volumeOffset(volumeOffset), clusterSize(clusterSize),
+      known(known), queueLimit(2 * (workers ? workers : 1)), busy(0),
+      closing(false) {
+    if (workers == 0) {
+        workers = 1;
+    }
+    for (unsigned i = 0; i < workers; ++i) {
+        this->workers.push_back(std::thread(&HashPool::Work, this));
+    }
+}
+
+HashPool::~HashPool() { this->Finish(); }
+
+// Queue a file. Blocks while the queue is full, so the producer (the $MFT
+// walk) never runs far ahead of the readers
+void HashPool::Submit(const HashJob &job) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (this->queue.size() >= this->queueLimit) {
+        this->drained.wait(guard);
+    }
+    this->queue.push_back(job);
+    this->ready.notify_one();
+}
+
+// Wait until every queued file is hashed and hand back the results so far,
+// ordered by record number. The workers keep running for later jobs
+std::vector<HashResult> HashPool::Drain() {
+    std::vector<HashResult> done;
+    {
+        std::unique_lock<std::mutex> guard(this->lock);
+        while (!this->queue.empty() || this->busy > 0) {
+            this->drained.wait(guard);
+        }
+        done.swap(this->results);
+    }
+    std::sort(done.begin(), done.end(),
+              [](const HashResult &a, const HashResult &b) {
+                  return a.RecordNumber < b.RecordNumber;
+              });
+    return done;
+}
+
+// Wait for all queued files, stop the workers and hand back the results
+std::vector<HashResult> HashPool::Finish() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->closing = true;
+    }
+    this->ready.notify_all();
+    for (std::size_t i = 0; i < this->workers.size(); ++i) {
+        this->workers[i].join();
+    }
+    this->workers.clear();
+
+    std::sort(this->results.begin(), this->results.end(),
+              [](const HashResult &a, const HashResult &b) {
+                  return a.RecordNumber < b.RecordNumber;
+              });
+    return this->results;
+}
+
+// Worker loop
+void HashPool::Work() {
+    DeviceBuffer buf(HASH_READ_SIZE);
+    for (;;) {
+        HashJob job;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            while (this->queue.empty() && !this->closing) {
+                this->ready.wait(guard);
+            }
+            if (this->queue.empty()) {
+                return;
+            }
+            job = this->queue.front();
+            this->queue.pop_front();
+            ++this->busy;
+        }
+        this->drained.notify_all();
+
+        HashResult result = this->Hash(job, buf);
+
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->results.push_back(result);
+            --this->busy;
+        }
+        this->drained.notify_all();
+    }
+}
+
+// Hash one file, reading its extents in HASH_READ_SIZE pieces. Sparse runs
+// and bytes past the initialized size hash as zeros, as NTFS reads them,
+// and the last cluster is cut off at the data size
+HashResult HashPool::Hash(const HashJob &job, DeviceBuffer &buf) const {
+    XXH64 fast;
+    SHA256 strong;
+    HashResult result;
+    result.RecordNumber = job.RecordNumber;
+    result.DataSize = job.DataSize;
+    result.Failed = false;
+
+    if (job.Resident) {
+        fast.Update(job.ResidentData.data(), job.ResidentData.size());
+        strong.Update(job.ResidentData.data(), job.ResidentData.size());
+    } else {
+        std::uint64_t left = job.DataSize;
+        for (std::size_t i = 0; i < job.Extents.size() && left > 0; ++i) {
+            const Extent &run = job.Extents[i];
+            std::uint64_t runBytes = run.Length * this->clusterSize;
+            if (runBytes > left) {
+                runBytes = left;
+            }
+            off_t address = this->volumeOffset + run.LCN * this->clusterSize;
+            std::uint64_t runStart = job.DataSize - left; // file offset
+            for (std::uint64_t done = 0; done < runBytes;) {
+                std::size_t n = runBytes - done < buf.Size()
+                                    ? runBytes - done
+                                    : buf.Size();
+                std::uint64_t at = runStart + done;
+                std::size_t written = 0; // bytes of this piece on disk
+                if (!run.Sparse && at < job.Initialized) {
+                    written = job.Initialized - at < n ? job.Initialized - at
+                                                       : n;
+                }
+                if (written > 0) {
+                    ssize_t got =
+                        devPread(this->fd, buf.Data(), written, address + done);
+                    if (got <= 0) {
+                        result.Failed = true;
+                        break;
+                    }
+                    if (static_cast<std::size_t>(got) < written) {
+                        n = written = got;
+                    }
+                }
+                std::memset(buf.Data() + written, 0, n - written);
+                fast.Update(buf.Data(), n);
+                strong.Update(buf.Data(), n);
+                done += n;
+            }
+            if (result.Failed) {
+                break;
+            }
+            left -= runBytes;
+        }
+        // Runlist shorter than the data size: the record is inconsistent
+        if (left > 0) {
+            result.Failed = true;
+        }
+    }
+
+    result.XXH64Digest = fast.Digest();
+    result.SHA256Digest = strong.Final();
+    result.Known = !result.Failed && this->known != NULL &&
+                   this->known->Contains(result.SHA256Digest);
+    return result;
+}
+
+// Lowercase hex rendering of a digest
+std::string DigestToHex(const dkt::Digest &digest) {
+    const char *digits = "0123456789abcdef";
+    std::string hex(2 * digest.size(), '0');
+    for (std::size_t i = 0; i < digest.size(); ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0x0F];
+    }
+    return hex;
+}
@@ -0,0 +1,141 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_HASH_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_HASH_HPP_
+
+// Standard library
+#include <array>              // std::array
+#include <condition_variable> // std::condition_variable
+#include <cstddef>            // std::size_t
+#include <cstdint>            // for standard types
+#include <deque>              // std::deque
+#include <mutex>              // std::mutex
+#include <string>             // std::string
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+// Self-defined
+#include "MFT.hpp"
+
+// Type aliases
+namespace dkt {
+typedef std::array<unsigned char, 32> Digest; // SHA-256 digest
+} // namespace dkt
+
+// Class definitions
+
+// Streaming XXH64, used as the fast dedupe hash
+class XXH64 {
+  protected:
+    std::uint64_t v[4];       // accumulators
+    std::uint64_t seed;       // hash seed
+    std::uint64_t total;      // bytes hashed so far
+    unsigned char buffer[32]; // pending partial stripe
+    std::size_t buffered;     // bytes in `buffer`
+
+  public:
+    // Constructors
+    XXH64(std::uint64_t seed = 0);
+
+    // Methods
+    void Update(const void *, std::size_t);
+    std::uint64_t Digest() const;
+};
+
+// Streaming SHA-256 (FIPS 180-4), used for reporting and known-file matching
+class SHA256 {
+  protected:
+    std::uint32_t state[8];   // intermediate hash value
+    std::uint64_t total;      // bytes hashed so far
+    unsigned char block[64];  // pending partial block
+    std::size_t buffered;     // bytes in `block`
+
+    void Transform(const unsigned char *);
+
+  public:
+    // Constructors
+    SHA256();
+
+    // Methods
+    void Update(const void *, std::size_t);
+    dkt::Digest Final();
+};
+
+// Set of known SHA-256 digests (e.g. an NSRL-style OS file list), built once
+// as an open-addressing table with linear probing
+class KnownHashSet {
+  protected:
+    std::vector<dkt::Digest> slots; // digests, indexed by probe position
+    std::vector<bool> used;         // slot occupancy
+    std::size_t mask;               // slot count - 1
+    std::size_t count;              // digests stored
+
+  public:
+    // Constructors
+    KnownHashSet(const std::vector<dkt::Digest> &);
+
+    // Methods
+    bool Contains(const dkt::Digest &) const;
+    std::size_t Size() const;
+
+    static KnownHashSet FromFile(const std::string &);
+};
+
+// File content to hash, described by its extent list
+struct HashJob {
+    std::uint64_t RecordNumber;   // owning record
+    std::uint64_t DataSize;       // bytes of content
+    std::uint64_t Initialized;    // bytes written; the rest hash as zeros
+    bool Resident;                // content is `ResidentData`
+    dkt::UString ResidentData;    // resident content
+    dkt::ExtentVector Extents;    // non-resident content
+};
+
+// Hashes of one file
+struct HashResult {
+    std::uint64_t RecordNumber; // owning record
+    std::uint64_t DataSize;     // bytes hashed
+    std::uint64_t XXH64Digest;  // dedupe hash
+    dkt::Digest SHA256Digest;   // reporting hash
+    bool Known;                 // SHA-256 found in the known set
+    bool Failed;                // content could not be read
+};
+
+// Bounded pool of hashing threads. Each worker reads a file's extents
+// straight from the device and feeds both hashes in a single pass, so file
+// content is read exactly once.
+class HashPool {
+  protected:
+    // Data fields
+    int fd;                       // opened device
+    std::uint64_t volumeOffset;   // byte offset of the volume on the device
+    std::uint64_t clusterSize;    // cluster size, in bytes
+    const KnownHashSet *known;    // known-file set, may be null
+    std::size_t queueLimit;       // pending jobs before `Submit` blocks
+    std::deque<HashJob> queue;    // pending jobs
+    std::vector<HashResult> results;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable ready;   // signalled when a job is queued
+    std::condition_variable drained; // signalled when a job is taken or done
+    std::size_t busy;                // jobs being hashed
+    bool closing;
+
+    void Work();
+    HashResult Hash(const HashJob &, DeviceBuffer &) const;
+
+  public:
+    // Constructors
+    HashPool(int, std::uint64_t, std::uint64_t, unsigned,
+             const KnownHashSet *); // device, volume offset, cluster size,
+                                    // worker count, known set
+    ~HashPool();
+
+    // Methods
+    void Submit(const HashJob &);
+    std::vector<HashResult> Drain();  // wait for queued jobs, take results
+    std::vector<HashResult> Finish(); // results, ordered by record number
+};
+
+// Function prototypes
+std::string DigestToHex(const dkt::Digest &);
+
+#endif
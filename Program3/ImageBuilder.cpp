@@ -0,0 +1,767 @@
+#include "ImageBuilder.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "Layout.hpp"
+
+namespace {
+// Layout
+const std::uint32_t PARTITION_START = 2048; // first sector of the volume
+const std::size_t RECORD_SIZE = 1024;       // FILE record size
+const std::size_t USA_OFFSET = 0x30;        // update sequence array offset
+const std::uint64_t BOOT_SIZE = 8192;       // bytes in $Boot
+const std::uint64_t MIRROR_RECORDS = 4;     // records copied to $MFTMirr
+const std::uint64_t COMPRESSION_UNIT = 16;  // clusters per compression unit
+const std::size_t LZNT1_CHUNK = 4096;       // bytes per LZNT1 chunk
+const std::size_t STREAM_BUFFER_SIZE = 4 << 20; // write-behind buffer
+
+// $FILE_NAME namespaces and record references
+const int NAMESPACE_WIN32_AND_DOS = 3;
+const std::uint64_t ROOT_REFERENCE = 5 | 5ULL << 48;
+
+// On-disk layouts
+typedef dkt::PartitionEntryLayout PE;
+typedef dkt::BootSectorLayout BPB;
+typedef dkt::FileRecordLayout FR;
+typedef dkt::AttributeLayout Attr;
+typedef dkt::ResidentAttributeLayout Resident;
+typedef dkt::NonResidentAttributeLayout NR;
+typedef dkt::StandardInformationLayout SI;
+typedef dkt::FileNameLayout FN;
+
+// Timestamps, in FILETIME ticks
+const std::uint64_t BASE_TIME = 132000000000000000ULL; // 2019-04-17
+const std::uint64_t DAY = 864000000000ULL;
+const std::uint64_t YEAR = 365 * DAY;
+
+// Name parts for generated files and directories
+const char16_t *const NAME_STEMS[] = {
+    u"report", u"invoice", u"IMG_",      u"notes",  u"backup",  u"draft",
+    u"budget", u"photo",   u"scan",      u"README", u"setup",   u"資料",
+    u"Отчёт",  u"résumé",  u"Übersicht", u"données"};
+const char16_t *const NAME_EXTENSIONS[] = {u".txt", u".pdf", u".docx",
+                                           u".jpg", u".png", u".log",
+                                           u".dat", u".exe", u".dll",
+                                           u".zip"};
+
+// System files, by record number
+const char16_t *const SYSTEM_NAMES[] = {
+    u"$MFT",    u"$MFTMirr", u"$LogFile", u"$Volume", u"$AttrDef", u".",
+    u"$Bitmap", u"$Boot",    u"$BadClus", u"$Secure", u"$UpCase",  u"$Extend"};
+
+// Store a little-endian value of `n` bytes
+void putLE(unsigned char *p, std::uint64_t value, int n) {
+    for (int i = 0; i < n; ++i) {
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+std::size_t align8(std::size_t n) {
+    return (n + 7) & ~static_cast<std::size_t>(7);
+}
+
+std::uint64_t ceilDiv(std::uint64_t a, std::uint64_t b) {
+    return (a + b - 1) / b;
+}
+
+// Non-resident attribute header size; compressed ones carry one more field
+std::size_t nonResidentHeaderSize(std::uint16_t flags) {
+    if (flags & ATTR_FLAG_COMPRESSED) {
+        return NR::COMPRESSED_SIZE;
+    }
+    return NR::SIZE;
+}
+
+// Bytes needed to hold `value` as a signed little-endian integer
+int signedWidth(std::int64_t value) {
+    int n = 1;
+    while (n < 8 && (value < -(INT64_C(1) << (8 * n - 1)) ||
+                     value >= (INT64_C(1) << (8 * n - 1)))) {
+        ++n;
+    }
+    return n;
+}
+
+// splitmix64: small, fast and identical on every platform, so a seed always
+// reproduces the same image
+class Random {
+    std::uint64_t state;
+
+  public:
+    explicit Random(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t Next() {
+        std::uint64_t z = (this->state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t Below(std::uint64_t n) { return n ? this->Next() % n : 0; }
+
+    bool Chance(double p) {
+        return (this->Next() >> 11) * (1.0 / 9007199254740992.0) < p;
+    }
+
+    void Fill(unsigned char *p, std::size_t n) {
+        while (n >= 8) {
+            std::uint64_t value = this->Next();
+            std::memcpy(p, &value, 8);
+            p += 8;
+            n -= 8;
+        }
+        if (n > 0) {
+            std::uint64_t value = this->Next();
+            std::memcpy(p, &value, n);
+        }
+    }
+};
+
+// Write-behind buffer for a region of the image that's filled front to back
+class StreamWriter {
+    int fd;
+    std::uint64_t offset; // device offset of buffer[0]
+    std::vector<unsigned char> buffer;
+    std::size_t used;
+
+  public:
+    StreamWriter(int fd, std::uint64_t offset)
+        : fd(fd), offset(offset), buffer(STREAM_BUFFER_SIZE), used(0) {}
+
+    void Append(const unsigned char *data, std::size_t n) {
+        while (n > 0) {
+            std::size_t take = std::min(n, this->buffer.size() - this->used);
+            std::memcpy(&this->buffer[this->used], data, take);
+            this->used += take;
+            data += take;
+            n -= take;
+            if (this->used == this->buffer.size()) {
+                this->Flush();
+            }
+        }
+    }
+
+    // Leave a hole; it reads back as zeros
+    void Skip(std::uint64_t n) {
+        this->Flush();
+        this->offset += n;
+    }
+
+    void Flush() {
+        std::size_t done = 0;
+        while (done < this->used) {
+            ssize_t wrote = pwrite(this->fd, &this->buffer[done],
+                                   this->used - done, this->offset + done);
+            if (wrote < 0) {
+                throw std::runtime_error(std::string("write: ") +
+                                         std::strerror(errno));
+            }
+            done += wrote;
+        }
+        this->offset += this->used;
+        this->used = 0;
+    }
+};
+
+void writeAt(int fd, const dkt::UString &data, std::uint64_t offset) {
+    std::size_t done = 0;
+    while (done < data.size()) {
+        ssize_t wrote =
+            pwrite(fd, &data[done], data.size() - done, offset + done);
+        if (wrote < 0) {
+            throw std::runtime_error(std::string("write: ") +
+                                     std::strerror(errno));
+        }
+        done += wrote;
+    }
+}
+
+// "<stem>_<number><extension>" for files, "<stem> <number>" for directories
+std::u16string makeName(Random &rng, std::uint64_t number, bool directory) {
+    const std::size_t stems = sizeof(NAME_STEMS) / sizeof(NAME_STEMS[0]);
+    const std::size_t extensions =
+        sizeof(NAME_EXTENSIONS) / sizeof(NAME_EXTENSIONS[0]);
+    std::u16string name = NAME_STEMS[rng.Below(stems)];
+    name += directory ? u' ' : u'_';
+    std::u16string digits;
+    do {
+        digits += static_cast<char16_t>(u'0' + number % 10);
+        number /= 10;
+    } while (number != 0);
+    name.append(digits.rbegin(), digits.rend());
+    if (!directory) {
+        name += NAME_EXTENSIONS[rng.Below(extensions)];
+    }
+    return name;
+}
+
+// LZNT1 stream for `length` bytes of `fill`. Each 4K chunk is a literal
+// followed by one back-reference covering the rest of the chunk
+void compressRun(dkt::UString &out, unsigned char fill, std::uint64_t length) {
+    while (length > 0) {
+        std::size_t n = std::min<std::uint64_t>(length, LZNT1_CHUNK);
+        length -= n;
+        std::size_t start = out.size();
+        out.resize(start + 2);
+        if (n > 3) {
+            // Flag byte (token 1 is a back-reference), literal, then
+            // offset 1 / length n - 1 in the 4:12 split used at position 1
+            std::uint16_t token = static_cast<std::uint16_t>(n - 1 - 3);
+            out.push_back(0x02);
+            out.push_back(fill);
+            out.push_back(static_cast<unsigned char>(token));
+            out.push_back(static_cast<unsigned char>(token >> 8));
+        } else {
+            out.push_back(0x00);
+            out.insert(out.end(), n, fill);
+        }
+        // Chunk header: compressed flag, signature 3, data size - 1
+        putLE(&out[start], 0xB000 | (out.size() - start - 3), 2);
+    }
+}
+} // namespace
+
+// `RecordBuilder` constructor
+// THROWS:
+//  - std::invalid_argument("Record size must be a multiple of 512"): if the
+//  record can't be covered by update sequence fixups
+RecordBuilder::RecordBuilder(std::size_t size)
+    : record(size, 0), next(0), nextID(0) {
+    if (size == 0 || size % FILE_RECORD_FIXUP_STRIDE != 0) {
+        throw std::invalid_argument("Record size must be a multiple of 512");
+    }
+}
+
+// Start a new, empty record
+void RecordBuilder::Begin(std::uint64_t number, std::uint16_t sequence,
+                          std::uint16_t flags) {
+    std::fill(this->record.begin(), this->record.end(), 0);
+    unsigned char *r = &this->record[0];
+    std::size_t usaCount = this->record.size() / FILE_RECORD_FIXUP_STRIDE + 1;
+
+    std::memcpy(r, "FILE", 4);
+    FR::USAOffset::Set(r, USA_OFFSET);
+    FR::USACount::Set(r, usaCount);
+    FR::Sequence::Set(r, sequence);
+    FR::LinkCount::Set(r, 1);
+    FR::Flags::Set(r, flags);
+    FR::Allocated::Set(r, this->record.size());
+    FR::Number::Set(r, number);
+
+    this->next = align8(USA_OFFSET + 2 * usaCount);
+    FR::AttrOffset::Set(r, this->next);
+    this->nextID = 0;
+}
+
+// Space left for attributes, keeping room for the end marker
+std::size_t RecordBuilder::GetFree() const {
+    return this->record.size() - this->next - 8;
+}
+
+// Reserve an attribute and fill in its common header
+// THROWS:
+//  - std::invalid_argument("Attribute does not fit in the record")
+std::size_t RecordBuilder::AddAttribute(std::uint32_t type, std::size_t length,
+                                        bool nonResident) {
+    if (length > this->GetFree()) {
+        throw std::invalid_argument("Attribute does not fit in the record");
+    }
+    std::size_t offset = this->next;
+    unsigned char *a = &this->record[offset];
+    Attr::Type::Set(a, type);
+    Attr::Length::Set(a, length);
+    Attr::NonResident::Set(a, nonResident);
+    Attr::ID::Set(a, this->nextID++);
+    this->next += length;
+    return offset;
+}
+
+void RecordBuilder::AddStandardInformation(std::uint64_t created,
+                                           std::uint64_t modified,
+                                           std::uint64_t changed,
+                                           std::uint64_t accessed) {
+    std::size_t offset = this->AddAttribute(ATTR_STANDARD_INFORMATION,
+                                            ResidentDataSize(0x48), false);
+    unsigned char *a = &this->record[offset];
+    Resident::ValueLength::Set(a, SI::SIZE);
+    Resident::ValueOffset::Set(a, Resident::SIZE);
+    unsigned char *value = a + Resident::SIZE;
+    SI::Created::Set(value, created);
+    SI::Modified::Set(value, modified);
+    SI::Changed::Set(value, changed);
+    SI::Accessed::Set(value, accessed);
+}
+
+// THROWS:
+//  - std::invalid_argument("File name longer than 255 characters")
+void RecordBuilder::AddFileName(std::uint64_t parent,
+                                const std::u16string &name, int nameNamespace,
+                                std::uint64_t size) {
+    if (name.size() > 255) {
+        throw std::invalid_argument("File name longer than 255 characters");
+    }
+    std::size_t valueLength = FN::SIZE + 2 * name.size();
+    std::size_t offset = this->AddAttribute(
+        ATTR_FILE_NAME, ResidentDataSize(valueLength), false);
+    unsigned char *a = &this->record[offset];
+    Resident::ValueLength::Set(a, valueLength);
+    Resident::ValueOffset::Set(a, Resident::SIZE);
+    Resident::Indexed::Set(a, 1);
+
+    unsigned char *value = a + Resident::SIZE;
+    FN::Parent::Set(value, parent);
+    FN::AllocatedSize::Set(value, align8(size));
+    FN::DataSize::Set(value, size);
+    FN::NameLength::Set(value, name.size());
+    FN::Namespace::Set(value, nameNamespace);
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        dkt::StoreLE<std::uint16_t>(value + FN::SIZE + 2 * i, name[i]);
+    }
+}
+
+void RecordBuilder::AddResidentData(const unsigned char *data,
+                                    std::size_t length) {
+    std::size_t offset =
+        this->AddAttribute(ATTR_DATA, ResidentDataSize(length), false);
+    unsigned char *a = &this->record[offset];
+    Resident::ValueLength::Set(a, length);
+    Resident::ValueOffset::Set(a, Resident::SIZE);
+    if (length > 0) {
+        std::memcpy(a + Resident::SIZE, data, length);
+    }
+}
+
+// Non-resident unnamed $DATA. Compressed attributes get the longer header
+// carrying the compressed size, and a compression unit of 16 clusters
+void RecordBuilder::AddNonResidentData(const dkt::ExtentVector &extents,
+                                       std::uint64_t clusterSize,
+                                       std::uint64_t size,
+                                       std::uint16_t flags) {
+    bool compressed = flags & ATTR_FLAG_COMPRESSED;
+    std::size_t header = nonResidentHeaderSize(flags);
+    dkt::UString runlist = EncodeRunlist(extents);
+    std::size_t offset = this->AddAttribute(
+        ATTR_DATA, NonResidentDataSize(extents, flags), true);
+
+    std::uint64_t clusters = 0;
+    std::uint64_t allocated = 0;
+    for (std::size_t i = 0; i < extents.size(); ++i) {
+        clusters += extents[i].Length;
+        allocated += extents[i].Sparse ? 0 : extents[i].Length;
+    }
+
+    unsigned char *a = &this->record[offset];
+    Attr::NameOffset::Set(a, header);
+    Attr::Flags::Set(a, flags);
+    NR::LastVCN::Set(a, clusters ? clusters - 1 : 0);
+    NR::RunlistOffset::Set(a, header);
+    NR::CompressionUnit::Set(a, compressed ? 4 : 0); // 2^4 clusters per unit
+    NR::AllocatedSize::Set(a, clusters * clusterSize);
+    NR::DataSize::Set(a, size);
+    NR::InitializedSize::Set(a, size);
+    if (compressed) {
+        NR::CompressedSize::Set(a, allocated * clusterSize);
+    }
+    std::memcpy(a + header, &runlist[0], runlist.size());
+}
+
+// Close the attribute list and protect every sector with the update
+// sequence number `usn`, as NTFS does before writing a record
+const dkt::UString &RecordBuilder::Finish(std::uint16_t usn) {
+    unsigned char *r = &this->record[0];
+    putLE(r + this->next, ATTR_END, 4);
+    FR::Used::Set(r, this->next + 8);
+
+    putLE(r + USA_OFFSET, usn, 2);
+    std::size_t sectors = this->record.size() / FILE_RECORD_FIXUP_STRIDE;
+    for (std::size_t i = 1; i <= sectors; ++i) {
+        std::size_t end = i * FILE_RECORD_FIXUP_STRIDE - 2;
+        r[USA_OFFSET + 2 * i] = r[end];
+        r[USA_OFFSET + 2 * i + 1] = r[end + 1];
+        putLE(r + end, usn, 2);
+    }
+    return this->record;
+}
+
+// Attribute length of a resident value
+std::size_t RecordBuilder::ResidentDataSize(std::size_t length) {
+    return align8(Resident::SIZE + length);
+}
+
+// Attribute length of a non-resident value with the given runs
+std::size_t RecordBuilder::NonResidentDataSize(const dkt::ExtentVector &extents,
+                                               std::uint16_t flags) {
+    return align8(nonResidentHeaderSize(flags) +
+                  EncodeRunlist(extents).size());
+}
+
+// Mapping pairs for `extents`: a header byte holding the field sizes, the
+// run length, then the LCN as a signed delta from the previous run (absent
+// for sparse runs). Ends with a zero byte
+dkt::UString RecordBuilder::EncodeRunlist(const dkt::ExtentVector &extents) {
+    dkt::UString out;
+    std::uint64_t previous = 0;
+    for (std::size_t i = 0; i < extents.size(); ++i) {
+        const Extent &e = extents[i];
+        int lengthSize = signedWidth(static_cast<std::int64_t>(e.Length));
+        std::int64_t delta = static_cast<std::int64_t>(e.LCN - previous);
+        int offsetSize = e.Sparse ? 0 : signedWidth(delta);
+
+        std::size_t at = out.size();
+        out.resize(at + 1 + lengthSize + offsetSize);
+        out[at] = static_cast<unsigned char>(offsetSize << 4 | lengthSize);
+        putLE(&out[at + 1], e.Length, lengthSize);
+        if (!e.Sparse) {
+            putLE(&out[at + 1 + lengthSize], delta, offsetSize);
+            previous = e.LCN;
+        }
+    }
+    out.push_back(0);
+    return out;
+}
+
+// `ImageBuilder` constructor
+// THROWS:
+//  - std::invalid_argument(...): if an option is out of range
+ImageBuilder::ImageBuilder(const ImageOptions &opts) : opts(opts) {
+    if (opts.ClusterSize < 512 || opts.ClusterSize > 65536 ||
+        (opts.ClusterSize & (opts.ClusterSize - 1)) != 0) {
+        throw std::invalid_argument(
+            "Cluster size must be a power of two from 512 to 65536");
+    }
+    if (opts.Records < 16 || opts.Records > 0xFFFFFFFFULL) {
+        throw std::invalid_argument("Record count must be between 16 and 2^32");
+    }
+    const double shares[4] = {opts.Fragmentation, opts.Deleted,
+                              opts.Compressed, opts.Sparse};
+    for (int i = 0; i < 4; ++i) {
+        if (!(shares[i] >= 0 && shares[i] <= 1)) {
+            throw std::invalid_argument("Shares must be between 0 and 1");
+        }
+    }
+    if (opts.Compressed > 0 && opts.ClusterSize > LZNT1_CHUNK) {
+        throw std::invalid_argument(
+            "Compression needs clusters of 4096 bytes or less");
+    }
+    // A file is only split with two clusters or more, and only given a
+    // sparse middle with three or more
+    if (opts.Fragmentation > 0 && opts.MaxFileSize <= opts.ClusterSize) {
+        throw std::invalid_argument(
+            "Fragmentation needs a maximum file size over one cluster");
+    }
+    if (opts.Sparse > 0 && opts.MaxFileSize <= 2ULL * opts.ClusterSize) {
+        throw std::invalid_argument(
+            "Sparse files need a maximum file size over two clusters");
+    }
+}
+
+// Generate the image. The layout is boot sectors, $MFTMirr, $MFT, then file
+// contents in record order; the volume is sized to fit once every file has
+// been placed, so the boot sectors are written last.
+// THROWS:
+//  - std::runtime_error("write: ..."): if the device can't be written
+//  - std::runtime_error("Volume too large for an MBR partition")
+ImageSummary ImageBuilder::Write(int fd) const {
+    const std::uint64_t cluster = this->opts.ClusterSize;
+    const std::uint64_t bootClusters = ceilDiv(BOOT_SIZE, cluster);
+    const std::uint64_t mirrLCN = bootClusters;
+    const std::uint64_t mirrClusters =
+        ceilDiv(MIRROR_RECORDS * RECORD_SIZE, cluster);
+    const std::uint64_t mftLCN = mirrLCN + mirrClusters;
+    const std::uint64_t mftClusters =
+        ceilDiv(this->opts.Records * RECORD_SIZE, cluster);
+    const std::uint64_t dataLCN = mftLCN + mftClusters;
+
+    ImageSummary summary;
+    std::memset(&summary, 0, sizeof(summary));
+    summary.VolumeOffset =
+        static_cast<std::uint64_t>(PARTITION_START) * SECTOR_SIZE;
+    summary.MFTLCN = mftLCN;
+
+    Random rng(this->opts.Seed);
+    RecordBuilder builder(RECORD_SIZE);
+    StreamWriter mftOut(fd, summary.VolumeOffset + mftLCN * cluster);
+    StreamWriter dataOut(fd, summary.VolumeOffset + dataLCN * cluster);
+    dkt::UString mirror;
+    std::uint64_t nextLCN = dataLCN;
+    std::vector<std::uint64_t> directories(1, ROOT_REFERENCE);
+    dkt::UString content;
+    dkt::UString span;
+
+    for (std::uint64_t number = 0; number < this->opts.Records; ++number) {
+        std::uint64_t created = BASE_TIME + rng.Below(3 * YEAR);
+        std::uint64_t modified = created + rng.Below(YEAR);
+        std::uint64_t changed = modified + rng.Below(DAY);
+        std::uint64_t accessed = changed + rng.Below(30 * DAY);
+
+        if (number < 16) {
+            // System files; 12-15 are reserved and carry no name
+            bool directory = number == 5 || number == 11;
+            builder.Begin(number, number ? number : 1,
+                          FILE_RECORD_FLAG_IN_USE |
+                              (directory ? FILE_RECORD_FLAG_DIRECTORY : 0));
+            builder.AddStandardInformation(created, modified, changed,
+                                           accessed);
+            if (number < 12) {
+                std::uint64_t lcn = 0, clusters = 0, size = 0;
+                if (number == 0) {
+                    lcn = mftLCN;
+                    clusters = mftClusters;
+                    size = this->opts.Records * RECORD_SIZE;
+                } else if (number == 1) {
+                    lcn = mirrLCN;
+                    clusters = mirrClusters;
+                    size = MIRROR_RECORDS * RECORD_SIZE;
+                } else if (number == 7) {
+                    clusters = bootClusters;
+                    size = BOOT_SIZE;
+                }
+                builder.AddFileName(ROOT_REFERENCE, SYSTEM_NAMES[number],
+                                    NAMESPACE_WIN32_AND_DOS, size);
+                if (clusters > 0) {
+                    Extent e = {0, lcn, clusters, false};
+                    builder.AddNonResidentData(dkt::ExtentVector(1, e),
+                                               cluster, size, 0);
+                } else if (!directory) {
+                    builder.AddResidentData(NULL, 0);
+                }
+            }
+        } else {
+            bool deleted = rng.Chance(this->opts.Deleted);
+            bool directory = rng.Below(16) == 0;
+            std::uint64_t parent = directories[rng.Below(directories.size())];
+            std::u16string name = makeName(rng, number, directory);
+            std::uint64_t size = 0;
+            if (!directory) {
+                size = rng.Chance(0.25) ? rng.Below(512)
+                                        : rng.Below(this->opts.MaxFileSize + 1);
+            }
+
+            builder.Begin(number, 1,
+                          (deleted ? 0 : FILE_RECORD_FLAG_IN_USE) |
+                              (directory ? FILE_RECORD_FLAG_DIRECTORY : 0));
+            builder.AddStandardInformation(created, modified, changed,
+                                           accessed);
+            builder.AddFileName(parent, name, NAMESPACE_WIN32_AND_DOS, size);
+            summary.Deleted += deleted;
+
+            if (directory) {
+                ++summary.Directories;
+                if (!deleted) {
+                    directories.push_back(number | 1ULL << 48);
+                }
+            } else {
+                ++summary.Files;
+                summary.DataBytes += size;
+
+                // Contents come from their own stream, so layout choices
+                // don't change what a file holds
+                Random fileRng(this->opts.Seed ^
+                               (number * 0x9E3779B97F4A7C15ULL));
+                std::uint64_t clusters = ceilDiv(size, cluster);
+                if (RecordBuilder::ResidentDataSize(size) <=
+                    builder.GetFree()) {
+                    content.resize(size);
+                    fileRng.Fill(content.data(), size);
+                    builder.AddResidentData(content.data(), size);
+                    ++summary.Resident;
+                } else {
+                    dkt::ExtentVector extents;
+                    std::uint16_t flags = 0;
+                    std::uint64_t spanClusters = 0;
+                    std::uint64_t k = 0; // fragments
+
+                    if (rng.Chance(this->opts.Compressed)) {
+                        // One cluster of LZNT1 data, then 15 sparse
+                        // clusters, per compression unit
+                        std::uint64_t units =
+                            ceilDiv(clusters, COMPRESSION_UNIT);
+                        for (std::uint64_t u = 0; u < units; ++u) {
+                            Extent data = {u * COMPRESSION_UNIT, nextLCN + u,
+                                           1, false};
+                            Extent hole = {u * COMPRESSION_UNIT + 1, 0,
+                                           COMPRESSION_UNIT - 1, true};
+                            extents.push_back(data);
+                            extents.push_back(hole);
+                        }
+                        flags = ATTR_FLAG_COMPRESSED;
+                        spanClusters = units;
+                    } else if (clusters >= 3 && rng.Chance(this->opts.Sparse)) {
+                        // Allocated head and last cluster, sparse middle
+                        std::uint64_t head = 1 + rng.Below(clusters / 2);
+                        Extent first = {0, nextLCN, head, false};
+                        Extent hole = {head, 0, clusters - head - 1, true};
+                        Extent last = {clusters - 1, nextLCN + head, 1, false};
+                        extents.push_back(first);
+                        extents.push_back(hole);
+                        extents.push_back(last);
+                        flags = ATTR_FLAG_SPARSE;
+                        spanClusters = head + 1;
+                    } else if (clusters >= 2 &&
+                               rng.Chance(this->opts.Fragmentation)) {
+                        // Fragments laid out back to front with a free
+                        // cluster between them, so LCN deltas go negative
+                        k = 2 + rng.Below(
+                                    std::min<std::uint64_t>(clusters, 8) - 1);
+                        std::uint64_t base = clusters / k;
+                        std::uint64_t lcn = nextLCN;
+                        extents.resize(k);
+                        for (std::uint64_t j = k; j-- > 0;) {
+                            std::uint64_t length =
+                                j == k - 1 ? clusters - base * (k - 1) : base;
+                            Extent e = {j * base, lcn, length, false};
+                            extents[j] = e;
+                            lcn += length + 1;
+                        }
+                        spanClusters = clusters + k - 1;
+                    }
+
+                    // A record never needs an $ATTRIBUTE_LIST here; runs that
+                    // don't fit fall back to one contiguous run
+                    if (extents.empty() ||
+                        RecordBuilder::NonResidentDataSize(extents, flags) >
+                            builder.GetFree()) {
+                        Extent e = {0, nextLCN, clusters, false};
+                        extents.assign(1, e);
+                        flags = 0;
+                        spanClusters = clusters;
+                        k = 0;
+                    }
+                    summary.Compressed += flags == ATTR_FLAG_COMPRESSED;
+                    summary.Sparse += flags == ATTR_FLAG_SPARSE;
+                    summary.Fragmented += k > 1;
+                    builder.AddNonResidentData(extents, cluster, size, flags);
+
+                    // Lay the file's clusters out in the data region
+                    if (!this->opts.WriteData) {
+                        dataOut.Skip(spanClusters * cluster);
+                    } else {
+                        span.assign(spanClusters * cluster, 0);
+                        if (flags == ATTR_FLAG_COMPRESSED) {
+                            unsigned char fill = fileRng.Next() & 0xFF;
+                            std::uint64_t unitSize = COMPRESSION_UNIT * cluster;
+                            for (std::uint64_t u = 0; u < spanClusters; ++u) {
+                                content.clear();
+                                compressRun(content, fill,
+                                            std::min(unitSize,
+                                                     size - u * unitSize));
+                                std::memcpy(&span[u * cluster], content.data(),
+                                            content.size());
+                            }
+                        } else {
+                            // Contents, zeros to the end of the sector, then
+                            // stale bytes to the end of the cluster (slack)
+                            content.resize(clusters * cluster);
+                            std::uint64_t sectorEnd =
+                                ceilDiv(size, SECTOR_SIZE) * SECTOR_SIZE;
+                            fileRng.Fill(content.data(), size);
+                            std::memset(content.data() + size, 0,
+                                        sectorEnd - size);
+                            fileRng.Fill(content.data() + sectorEnd,
+                                         content.size() - sectorEnd);
+                            for (std::size_t j = 0; j < extents.size(); ++j) {
+                                const Extent &e = extents[j];
+                                if (!e.Sparse) {
+                                    std::memcpy(&span[(e.LCN - nextLCN) *
+                                                      cluster],
+                                                &content[e.VCN * cluster],
+                                                e.Length * cluster);
+                                }
+                            }
+                        }
+                        dataOut.Append(span.data(), span.size());
+                    }
+                    nextLCN += spanClusters;
+                }
+            }
+        }
+
+        const dkt::UString &record = builder.Finish(
+            static_cast<std::uint16_t>(1 + number % 0xFFFE));
+        mftOut.Append(record.data(), record.size());
+        if (number < MIRROR_RECORDS) {
+            mirror.insert(mirror.end(), record.begin(), record.end());
+        }
+    }
+    mftOut.Flush();
+    dataOut.Flush();
+
+    // Size the volume, then write $MFTMirr and both boot sectors
+    summary.TotalClusters = nextLCN;
+    std::uint64_t totalSectors = nextLCN * (cluster / SECTOR_SIZE);
+    if (PARTITION_START + totalSectors + 1 > 0xFFFFFFFFULL) {
+        throw std::runtime_error("Volume too large for an MBR partition");
+    }
+    std::uint64_t serial = rng.Next();
+    dkt::UString vbr = MakeVBR(this->opts.ClusterSize, totalSectors, mftLCN,
+                               mirrLCN, PARTITION_START, serial);
+    writeAt(fd, mirror, summary.VolumeOffset + mirrLCN * cluster);
+    writeAt(fd, vbr, summary.VolumeOffset);
+    writeAt(fd, vbr, summary.VolumeOffset + totalSectors * SECTOR_SIZE);
+    writeAt(fd,
+            MakeMBR(PARTITION_START, totalSectors + 1,
+                    static_cast<std::uint32_t>(serial >> 32)),
+            0);
+
+    summary.ImageSize =
+        summary.VolumeOffset + (totalSectors + 1) * SECTOR_SIZE;
+    if (ftruncate(fd, summary.ImageSize) < 0) {
+        throw std::runtime_error(std::string("ftruncate: ") +
+                                 std::strerror(errno));
+    }
+    return summary;
+}
+
+// MBR with a single active NTFS partition, addressed by LBA only
+dkt::UString ImageBuilder::MakeMBR(std::uint32_t start, std::uint32_t sectors,
+                                   std::uint32_t signature) {
+    dkt::UString mbr(SECTOR_SIZE, 0);
+    unsigned char *entry = &mbr[PARTITION_TABLE_OFFSET];
+    putLE(&mbr[0x1B8], signature, 4); // disk signature
+    PE::BootIndicator::Set(entry, 0x80);
+    putLE(entry + 1, 0xFFFFFE, 3); // CHS out of range: use LBA
+    PE::Type::Set(entry, 0x07);
+    putLE(entry + 5, 0xFFFFFE, 3);
+    PE::StartingSector::Set(entry, start);
+    PE::SectorCount::Set(entry, sectors);
+    mbr[SECTOR_SIZE - 2] = 0x55;
+    mbr[SECTOR_SIZE - 1] = 0xAA;
+    return mbr;
+}
+
+// NTFS boot sector with 1K FILE records and 4K index blocks. Sizes that are
+// smaller than a cluster are stored as negative powers of two
+dkt::UString ImageBuilder::MakeVBR(std::uint32_t clusterSize,
+                                   std::uint64_t totalSectors,
+                                   std::uint64_t mftLCN, std::uint64_t mirrLCN,
+                                   std::uint32_t hiddenSectors,
+                                   std::uint64_t serial) {
+    dkt::UString vbr(SECTOR_SIZE, 0);
+    unsigned char *v = &vbr[0];
+    const unsigned char jump[3] = {0xEB, 0x52, 0x90};
+    std::memcpy(v, jump, 3);
+    std::memcpy(v + 3, "NTFS    ", 8);
+    BPB::BytesPerSector::Set(v, SECTOR_SIZE);
+    BPB::SectorsPerCluster::Set(v, clusterSize / SECTOR_SIZE);
+    v[0x15] = 0xF8;          // media descriptor: fixed disk
+    putLE(v + 0x18, 63, 2);  // sectors per track
+    putLE(v + 0x1A, 255, 2); // heads
+    putLE(v + 0x1C, hiddenSectors, 4);
+    putLE(v + 0x24, 0x800080, 4);
+    BPB::TotalSectors::Set(v, totalSectors);
+    BPB::MFTLCN::Set(v, mftLCN);
+    BPB::MFTMirrLCN::Set(v, mirrLCN);
+    BPB::RecordSize::Set(v, clusterSize <= RECORD_SIZE
+                                ? static_cast<int>(RECORD_SIZE / clusterSize)
+                                : -10);
+    BPB::IndexSize::Set(
+        v, clusterSize <= 4096 ? static_cast<int>(4096 / clusterSize) : -12);
+    BPB::Serial::Set(v, serial);
+    vbr[SECTOR_SIZE - 2] = 0x55;
+    vbr[SECTOR_SIZE - 1] = 0xAA;
+    return vbr;
+}
@@ -0,0 +1,116 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_IMAGEBUILDER_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_IMAGEBUILDER_HPP_
+
+// Standard library
+#include <cstddef> // std::size_t
+#include <cstdint> // for standard types
+#include <string>  // std::u16string
+
+// Self-defined
+#include "Constants.hpp"
+#include "MFT.hpp"
+#include "utility.hpp"
+
+// Class declarations
+class RecordBuilder;
+class ImageBuilder;
+
+// Knobs for a synthetic image
+struct ImageOptions {
+    std::uint32_t ClusterSize;   // bytes per cluster, 512 to 65536
+    std::uint64_t Records;       // $MFT records, system files included
+    double Fragmentation;        // share of files split into several runs
+    double Deleted;              // share of user records marked not in use
+    double Compressed;           // share of files stored LZNT1-compressed
+    double Sparse;               // share of files with a sparse run
+    std::uint64_t MaxFileSize;   // largest generated file, in bytes
+    std::uint64_t Seed;          // generator seed; same seed, same image
+    bool WriteData;              // write file contents, or leave holes
+};
+
+// What ended up in the image
+struct ImageSummary {
+    std::uint64_t VolumeOffset;  // byte offset of the NTFS volume
+    std::uint64_t TotalClusters; // clusters in the volume
+    std::uint64_t MFTLCN;        // first cluster of $MFT
+    std::uint64_t Files;         // user files
+    std::uint64_t Directories;   // user directories
+    std::uint64_t Deleted;       // user records not in use
+    std::uint64_t Resident;      // files with resident $DATA
+    std::uint64_t Fragmented;    // files split into several runs
+    std::uint64_t Compressed;    // compressed files
+    std::uint64_t Sparse;        // sparse files
+    std::uint64_t DataBytes;     // bytes of file contents
+    std::uint64_t ImageSize;     // bytes in the image file
+};
+
+// Class definitions
+
+// FILE record assembler. Attributes are appended in type order, then
+// `Finish` closes the attribute list and applies the update sequence, giving
+// the record exactly as it sits on disk
+class RecordBuilder {
+  protected:
+    // Data fields
+    dkt::UString record;    // record being built
+    std::size_t next;       // offset of the next attribute
+    std::uint16_t nextID;   // next attribute instance number
+
+    // Methods
+    std::size_t AddAttribute(std::uint32_t type, std::size_t length,
+                             bool nonResident); // returns attribute offset
+
+  public:
+    // Constructors
+    RecordBuilder(std::size_t); // record size, in bytes
+
+    // Methods
+    void Begin(std::uint64_t number, std::uint16_t sequence,
+               std::uint16_t flags);
+    std::size_t GetFree() const; // bytes left for attributes
+    void AddStandardInformation(std::uint64_t created, std::uint64_t modified,
+                                std::uint64_t changed, std::uint64_t accessed);
+    void AddFileName(std::uint64_t parent, const std::u16string &name,
+                     int nameNamespace, std::uint64_t size);
+    void AddResidentData(const unsigned char *, std::size_t);
+    void AddNonResidentData(const dkt::ExtentVector &,
+                            std::uint64_t clusterSize, std::uint64_t size,
+                            std::uint16_t flags);
+    const dkt::UString &Finish(std::uint16_t usn);
+
+    // Attribute sizes, for checking what still fits
+    static std::size_t ResidentDataSize(std::size_t);
+    static std::size_t NonResidentDataSize(const dkt::ExtentVector &,
+                                           std::uint16_t flags);
+
+    // Runlist encoder, the inverse of `FileRecord::DecodeRunlist`
+    static dkt::UString EncodeRunlist(const dkt::ExtentVector &);
+};
+
+// Synthetic MBR + NTFS image generator. Records and file contents are
+// streamed out in disk order, so images far larger than memory are cheap.
+// Only $MFT, $MFTMirr, $Boot and the root directory are filled in among the
+// system files; the rest are empty placeholders
+class ImageBuilder {
+  protected:
+    // Data fields
+    ImageOptions opts;
+
+  public:
+    // Constructors
+    ImageBuilder(const ImageOptions &);
+
+    // Methods
+    ImageSummary Write(int fd) const; // generate the image into `fd`
+
+    // Boot sectors
+    static dkt::UString MakeMBR(std::uint32_t start, std::uint32_t sectors,
+                                std::uint32_t signature);
+    static dkt::UString MakeVBR(std::uint32_t clusterSize,
+                                std::uint64_t totalSectors,
+                                std::uint64_t mftLCN, std::uint64_t mirrLCN,
+                                std::uint32_t hiddenSectors,
+                                std::uint64_t serial);
+};
+
+#endif
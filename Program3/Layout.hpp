@@ -0,0 +1,183 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_LAYOUT_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_LAYOUT_HPP_
+
+// On-disk structure layouts. Every field we parse is a little-endian integer
+// at a fixed offset from the start of its structure, so each one is declared
+// once here as an `LEField` and decoded with a single unaligned load, plus a
+// byte swap on big-endian hosts, instead of shifting bytes together by hand.
+
+// Standard library
+#include <cstddef> // std::size_t
+#include <cstdint> // for standard types
+#include <cstring> // std::memcpy
+#include <vector>  // std::vector
+
+// Self-defined
+#include "Constants.hpp"
+
+namespace dkt {
+// Little-endian to host byte order, and back. No-ops on little-endian hosts
+inline std::uint8_t FromLE(std::uint8_t value) { return value; }
+inline std::int8_t FromLE(std::int8_t value) { return value; }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline std::uint16_t FromLE(std::uint16_t value) {
+    return __builtin_bswap16(value);
+}
+inline std::uint32_t FromLE(std::uint32_t value) {
+    return __builtin_bswap32(value);
+}
+inline std::uint64_t FromLE(std::uint64_t value) {
+    return __builtin_bswap64(value);
+}
+#else
+inline std::uint16_t FromLE(std::uint16_t value) { return value; }
+inline std::uint32_t FromLE(std::uint32_t value) { return value; }
+inline std::uint64_t FromLE(std::uint64_t value) { return value; }
+#endif
+
+// Little-endian `T` at `p`, which needn't be aligned
+template <typename T> inline T LoadLE(const unsigned char *p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return FromLE(value);
+}
+
+template <typename T> inline void StoreLE(unsigned char *p, T value) {
+    value = FromLE(value);
+    std::memcpy(p, &value, sizeof(T));
+}
+
+// A `T` stored little-endian at byte `Offset` of a `Size`-byte structure.
+// Fields that don't fit their structure fail to compile
+template <typename T, std::size_t Offset, std::size_t Size> struct LEField {
+    static_assert(Offset + sizeof(T) <= Size, "Field outside its structure");
+
+    typedef T Type;
+    static constexpr std::size_t OFFSET = Offset;
+    static constexpr std::size_t END = Offset + sizeof(T); // one past the field
+
+    // Read from the structure starting at `base`
+    static T Get(const unsigned char *base) { return LoadLE<T>(base + Offset); }
+
+    // Read from the structure starting at byte `base` of `s`
+    static T Get(const std::vector<unsigned char> &s, std::size_t base = 0) {
+        return LoadLE<T>(&s[base + Offset]);
+    }
+
+    static void Set(unsigned char *base, T value) {
+        StoreLE<T>(base + Offset, value);
+    }
+};
+
+// MBR partition table entry (also EBR entries)
+struct PartitionEntryLayout {
+    static constexpr std::size_t SIZE = PARTITION_ENTRY_SIZE;
+    typedef LEField<std::uint8_t, 0x00, SIZE> BootIndicator;
+    typedef LEField<std::uint8_t, 0x04, SIZE> Type;
+    typedef LEField<std::uint32_t, 0x08, SIZE> StartingSector;
+    typedef LEField<std::uint32_t, 0x0C, SIZE> SectorCount;
+};
+
+// NTFS boot sector (VBR) and its BIOS parameter block
+struct BootSectorLayout {
+    static constexpr std::size_t SIZE = SECTOR_SIZE;
+    typedef LEField<std::uint16_t, NTFS_VBR_BYTES_PER_SECTOR_OFFSET, SIZE>
+        BytesPerSector;
+    typedef LEField<std::uint8_t, NTFS_VBR_SECTORS_PER_CLUSTER_OFFSET, SIZE>
+        SectorsPerCluster;
+    typedef LEField<std::uint64_t, NTFS_VBR_TOTAL_SECTORS_OFFSET, SIZE>
+        TotalSectors;
+    typedef LEField<std::uint64_t, NTFS_VBR_MFT_OFFSET, SIZE> MFTLCN;
+    typedef LEField<std::uint64_t, NTFS_VBR_MFTMIRR_OFFSET, SIZE> MFTMirrLCN;
+    // Positive: clusters. Negative n: 2^-n bytes
+    typedef LEField<std::int8_t, NTFS_VBR_RECORD_SIZE_OFFSET, SIZE> RecordSize;
+    typedef LEField<std::int8_t, NTFS_VBR_INDEX_SIZE_OFFSET, SIZE> IndexSize;
+    typedef LEField<std::uint64_t, NTFS_VBR_SERIAL_OFFSET, SIZE> Serial;
+};
+
+// FILE record header
+struct FileRecordLayout {
+    static constexpr std::size_t SIZE = 0x30;
+    typedef LEField<std::uint16_t, FILE_RECORD_USA_OFFSET, SIZE> USAOffset;
+    typedef LEField<std::uint16_t, FILE_RECORD_USA_COUNT_OFFSET, SIZE> USACount;
+    typedef LEField<std::uint16_t, FILE_RECORD_SEQUENCE_OFFSET, SIZE> Sequence;
+    typedef LEField<std::uint16_t, FILE_RECORD_LINK_COUNT_OFFSET, SIZE>
+        LinkCount;
+    typedef LEField<std::uint16_t, FILE_RECORD_ATTR_OFFSET, SIZE> AttrOffset;
+    typedef LEField<std::uint16_t, FILE_RECORD_FLAGS_OFFSET, SIZE> Flags;
+    typedef LEField<std::uint32_t, FILE_RECORD_USED_OFFSET, SIZE> Used;
+    typedef LEField<std::uint32_t, FILE_RECORD_ALLOCATED_OFFSET, SIZE>
+        Allocated;
+    typedef LEField<std::uint64_t, FILE_RECORD_BASE_OFFSET, SIZE> Base;
+    typedef LEField<std::uint32_t, FILE_RECORD_NUMBER_OFFSET, SIZE> Number;
+};
+
+// Header common to every attribute, relative to the attribute
+struct AttributeLayout {
+    static constexpr std::size_t SIZE = 0x10;
+    typedef LEField<std::uint32_t, 0x00, SIZE> Type;
+    typedef LEField<std::uint32_t, 0x04, SIZE> Length;
+    typedef LEField<std::uint8_t, 0x08, SIZE> NonResident;
+    typedef LEField<std::uint8_t, 0x09, SIZE> NameLength;
+    typedef LEField<std::uint16_t, 0x0A, SIZE> NameOffset;
+    typedef LEField<std::uint16_t, 0x0C, SIZE> Flags;
+    typedef LEField<std::uint16_t, 0x0E, SIZE> ID;
+};
+
+// Resident attribute header, after the common one
+struct ResidentAttributeLayout {
+    static constexpr std::size_t SIZE = 0x18;
+    typedef LEField<std::uint32_t, 0x10, SIZE> ValueLength;
+    typedef LEField<std::uint16_t, 0x14, SIZE> ValueOffset;
+    typedef LEField<std::uint8_t, 0x16, SIZE> Indexed;
+};
+
+// Non-resident attribute header, after the common one. Compressed
+// attributes add the compressed size, for a 0x48-byte header
+struct NonResidentAttributeLayout {
+    static constexpr std::size_t SIZE = 0x40;
+    static constexpr std::size_t COMPRESSED_SIZE = 0x48;
+    typedef LEField<std::uint64_t, 0x10, SIZE> StartVCN;
+    typedef LEField<std::uint64_t, 0x18, SIZE> LastVCN;
+    typedef LEField<std::uint16_t, 0x20, SIZE> RunlistOffset;
+    typedef LEField<std::uint8_t, 0x22, SIZE> CompressionUnit;
+    typedef LEField<std::uint64_t, 0x28, SIZE> AllocatedSize;
+    typedef LEField<std::uint64_t, 0x30, SIZE> DataSize;
+    typedef LEField<std::uint64_t, 0x38, SIZE> InitializedSize;
+    typedef LEField<std::uint64_t, 0x40, COMPRESSED_SIZE> CompressedSize;
+};
+
+// $ATTRIBUTE_LIST entry, relative to the entry. The UTF-16LE name, if
+// any, is at `NameOffset`
+struct AttributeListEntryLayout {
+    static constexpr std::size_t SIZE = 0x1A;
+    typedef LEField<std::uint32_t, 0x00, SIZE> Type;
+    typedef LEField<std::uint16_t, 0x04, SIZE> Length;
+    typedef LEField<std::uint8_t, 0x06, SIZE> NameLength;
+    typedef LEField<std::uint8_t, 0x07, SIZE> NameOffset;
+    typedef LEField<std::uint64_t, 0x08, SIZE> StartVCN;
+    typedef LEField<std::uint64_t, 0x10, SIZE> Reference;
+    typedef LEField<std::uint16_t, 0x18, SIZE> ID;
+};
+
+// $STANDARD_INFORMATION value. Only the timestamps are read
+struct StandardInformationLayout {
+    static constexpr std::size_t SIZE = 0x48;
+    typedef LEField<std::uint64_t, 0x00, SIZE> Created;
+    typedef LEField<std::uint64_t, 0x08, SIZE> Modified;
+    typedef LEField<std::uint64_t, 0x10, SIZE> Changed;
+    typedef LEField<std::uint64_t, 0x18, SIZE> Accessed;
+};
+
+// $FILE_NAME value. The UTF-16LE name follows the fixed part
+struct FileNameLayout {
+    static constexpr std::size_t SIZE = 0x42;
+    typedef LEField<std::uint64_t, 0x00, SIZE> Parent;
+    typedef LEField<std::uint64_t, 0x28, SIZE> AllocatedSize;
+    typedef LEField<std::uint64_t, 0x30, SIZE> DataSize;
+    typedef LEField<std::uint8_t, 0x40, SIZE> NameLength;
+    typedef LEField<std::uint8_t, 0x41, SIZE> Namespace;
+};
+} // namespace dkt
+
+#endif
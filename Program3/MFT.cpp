@@ -0,0 +1,929 @@
+#include "MFT.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "../Common/devio.h"
+#include "../Common/metrics.h"
+#include "Layout.hpp"
+
+namespace {
+// Variable-width little-endian integer, as found in runlists
+std::uint64_t readLEN(const unsigned char *p, int n) {
+    std::uint64_t value = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+} // namespace
+
+// `UString`-based `FileRecord` constructor. Applies the update sequence
+// fixups, then parses $STANDARD_INFORMATION, $FILE_NAME and unnamed $DATA,
+// and keeps the runs of every non-resident attribute.
+// Sectors flagged in `unreadable` were zero-filled by a rescue read: their
+// fixups aren't checked and attributes stop at the first of them.
+// THROWS:
+//  - std::invalid_argument("Not a FILE record"): if the signature is missing
+//  - std::invalid_argument("Fixup mismatch in sector ${n}"): if a sector's
+//  last two bytes don't match the update sequence number (torn write)
+//  - std::invalid_argument("Malformed ..."): if a header or attribute points
+//  outside the record
+FileRecord::FileRecord(const dkt::UString &record, std::uint64_t number,
+                       std::uint64_t unreadable)
+    : record(record), number(number), unreadable(unreadable), created(0),
+      modified(0), changed(0), accessed(0), hasName(false), parent(0),
+      hasData(false), dataResident(false), dataFlags(0), dataSize(0),
+      allocatedSize(0), initialized(0), hasAttributeList(false),
+      attributeListResident(false), attributeListSize(0) {
+    // Check signature
+    if (record.size() < FILE_RECORD_FIXUP_STRIDE || record[0] != 'F' ||
+        record[1] != 'I' || record[2] != 'L' || record[3] != 'E') {
+        throw std::invalid_argument("Not a FILE record");
+    }
+
+    this->ApplyFixups();
+    this->ParseAttributes();
+}
+
+// Replace the last two bytes of every sector with their saved values
+void FileRecord::ApplyFixups() {
+    std::size_t usaOffset = dkt::FileRecordLayout::USAOffset::Get(this->record);
+    std::size_t usaCount = dkt::FileRecordLayout::USACount::Get(this->record);
+    if (usaCount == 0 || usaOffset + 2 * usaCount > this->record.size() ||
+        (usaCount - 1) * FILE_RECORD_FIXUP_STRIDE > this->record.size()) {
+        throw std::invalid_argument("Malformed update sequence array");
+    }
+
+    for (std::size_t i = 1; i < usaCount; ++i) {
+        if (i - 1 < 64 && (this->unreadable >> (i - 1) & 1)) {
+            continue; // zero-filled, nothing to restore
+        }
+        std::size_t end = i * FILE_RECORD_FIXUP_STRIDE - 2;
+        if (this->record[end] != this->record[usaOffset] ||
+            this->record[end + 1] != this->record[usaOffset + 1]) {
+            METRICS_ADD(METRIC_FIXUP_FAILURES, 1);
+            std::stringstream ss;
+            ss << "Fixup mismatch in sector " << i - 1;
+            throw std::invalid_argument(ss.str());
+        }
+        this->record[end] = this->record[usaOffset + 2 * i];
+        this->record[end + 1] = this->record[usaOffset + 2 * i + 1];
+    }
+}
+
+// Walk the attribute list, picking up the attributes we care about
+void FileRecord::ParseAttributes() {
+    std::size_t used = dkt::FileRecordLayout::Used::Get(this->record);
+    if (used > this->record.size()) {
+        used = this->record.size();
+    }
+    // Attributes running into a lost sector are cut off there
+    std::size_t readable = used;
+    for (std::size_t i = 0; i < 64 && i * FILE_RECORD_FIXUP_STRIDE < used;
+         ++i) {
+        if (this->unreadable >> i & 1) {
+            readable = i * FILE_RECORD_FIXUP_STRIDE;
+            break;
+        }
+    }
+    int nameNamespace = -1;
+
+    std::size_t offset = dkt::FileRecordLayout::AttrOffset::Get(this->record);
+    while (offset + dkt::AttributeLayout::Length::END <= readable) {
+        const unsigned char *attr = &this->record[offset];
+        std::uint32_t type = dkt::AttributeLayout::Type::Get(attr);
+        if (type == ATTR_END) {
+            break;
+        }
+        std::size_t length = dkt::AttributeLayout::Length::Get(attr);
+        if (length < dkt::ResidentAttributeLayout::SIZE ||
+            offset + length > used) {
+            throw std::invalid_argument("Malformed attribute length");
+        }
+        if (offset + length > readable) {
+            break;
+        }
+        bool nonResident = dkt::AttributeLayout::NonResident::Get(attr) != 0;
+        bool named = dkt::AttributeLayout::NameLength::Get(attr) != 0;
+        std::uint16_t flags = dkt::AttributeLayout::Flags::Get(attr);
+
+        if (!nonResident) {
+            // Resident attribute: value lives in the record
+            std::size_t valueLength =
+                dkt::ResidentAttributeLayout::ValueLength::Get(attr);
+            std::size_t value =
+                offset + dkt::ResidentAttributeLayout::ValueOffset::Get(attr);
+            if (value + valueLength > offset + length) {
+                throw std::invalid_argument("Malformed resident attribute");
+            }
+
+            typedef dkt::StandardInformationLayout SI;
+            typedef dkt::FileNameLayout FN;
+            if (type == ATTR_STANDARD_INFORMATION &&
+                valueLength >= SI::Accessed::END) {
+                this->created = SI::Created::Get(this->record, value);
+                this->modified = SI::Modified::Get(this->record, value);
+                this->changed = SI::Changed::Get(this->record, value);
+                this->accessed = SI::Accessed::Get(this->record, value);
+            } else if (type == ATTR_FILE_NAME && valueLength >= FN::SIZE) {
+                std::size_t chars = FN::NameLength::Get(this->record, value);
+                int ns = FN::Namespace::Get(this->record, value);
+                if (FN::SIZE + 2 * chars > valueLength) {
+                    throw std::invalid_argument("Malformed $FILE_NAME");
+                }
+                // Prefer a long name over the 8.3 DOS alias
+                if (!this->hasName ||
+                    (nameNamespace == FILE_NAME_NAMESPACE_DOS &&
+                     ns != FILE_NAME_NAMESPACE_DOS)) {
+                    this->hasName = true;
+                    nameNamespace = ns;
+                    this->parent = FN::Parent::Get(this->record, value);
+                    this->name.resize(chars);
+                    const unsigned char *utf16 =
+                        &this->record[0] + value + FN::SIZE;
+                    for (std::size_t i = 0; i < chars; ++i) {
+                        this->name[i] =
+                            dkt::LoadLE<std::uint16_t>(utf16 + 2 * i);
+                    }
+                }
+            } else if (type == ATTR_DATA && !named) {
+                this->hasData = true;
+                this->dataResident = true;
+                this->dataFlags = flags;
+                this->dataSize = valueLength;
+                this->allocatedSize = valueLength;
+                this->initialized = valueLength;
+                this->residentData.assign(
+                    this->record.begin() + value,
+                    this->record.begin() + value + valueLength);
+            } else if (type == ATTR_ATTRIBUTE_LIST) {
+                this->hasAttributeList = true;
+                this->attributeListResident = true;
+                this->attributeList =
+                    ParseAttributeList(&this->record[value], valueLength);
+            }
+        } else {
+            // Non-resident attribute: value lives in clusters. All of them
+            // are kept for the cluster map, but only a malformed $DATA or
+            // $ATTRIBUTE_LIST spoils the record
+            typedef dkt::NonResidentAttributeLayout NR;
+            bool data = type == ATTR_DATA && !named;
+            AttributeRuns runs;
+            try {
+                runs = DecodeAttribute(attr, length);
+            } catch (std::invalid_argument &e) {
+                if (data || type == ATTR_ATTRIBUTE_LIST) {
+                    throw;
+                }
+                offset += length;
+                continue;
+            }
+            this->attributeRuns.push_back(runs);
+
+            if (type == ATTR_ATTRIBUTE_LIST) {
+                this->hasAttributeList = true;
+                this->attributeListResident = false;
+                this->attributeListSize = NR::DataSize::Get(attr);
+                this->attributeListExtents = runs.Extents;
+            } else if (data) {
+                if (NR::StartVCN::Get(attr) == 0) {
+                    // Sizes are only valid in the first fragment
+                    this->allocatedSize = NR::AllocatedSize::Get(attr);
+                    this->dataSize = NR::DataSize::Get(attr);
+                    this->initialized = NR::InitializedSize::Get(attr);
+                    this->dataFlags = flags;
+                }
+                this->hasData = true;
+                this->dataResident = false;
+                this->extents.insert(this->extents.end(),
+                                     runs.Extents.begin(), runs.Extents.end());
+            }
+        }
+
+        offset += length;
+    }
+}
+
+// Name and runs of a non-resident attribute `length` bytes long
+// THROWS:
+//  - std::invalid_argument("Malformed ..."): if the header, name or runlist
+//  overflows the attribute
+AttributeRuns FileRecord::DecodeAttribute(const unsigned char *attr,
+                                          std::size_t length) {
+    typedef dkt::AttributeLayout A;
+    typedef dkt::NonResidentAttributeLayout NR;
+    if (length < NR::SIZE) {
+        throw std::invalid_argument("Malformed non-resident attribute");
+    }
+    std::size_t runlist = NR::RunlistOffset::Get(attr);
+    if (runlist > length) {
+        throw std::invalid_argument("Malformed runlist offset");
+    }
+    std::size_t nameOffset = A::NameOffset::Get(attr);
+    std::size_t nameLength = A::NameLength::Get(attr);
+    if (nameOffset + 2 * nameLength > length) {
+        throw std::invalid_argument("Malformed attribute name");
+    }
+
+    AttributeRuns runs;
+    runs.Type = A::Type::Get(attr);
+    runs.Name.resize(nameLength);
+    for (std::size_t i = 0; i < nameLength; ++i) {
+        runs.Name[i] = dkt::LoadLE<std::uint16_t>(attr + nameOffset + 2 * i);
+    }
+    runs.Extents =
+        DecodeRunlist(attr + runlist, attr + length, NR::StartVCN::Get(attr));
+    return runs;
+}
+
+// Runlist decoder. Each run starts with a header byte whose low nibble is the
+// size of the length field and high nibble the size of the (signed, relative)
+// LCN offset field. An offset size of 0 marks a sparse run.
+// THROWS:
+//  - std::invalid_argument("Malformed runlist"): if a run overflows the
+//  attribute
+dkt::ExtentVector FileRecord::DecodeRunlist(const unsigned char *begin,
+                                            const unsigned char *end,
+                                            std::uint64_t startVCN) {
+    dkt::ExtentVector result;
+    std::uint64_t vcn = startVCN;
+    std::uint64_t lcn = 0;
+
+    const unsigned char *p = begin;
+    while (p < end && *p != 0) {
+        int lengthSize = *p & 0x0F;
+        int offsetSize = *p >> 4;
+        ++p;
+        if (lengthSize == 0 || lengthSize > 8 || offsetSize > 8 ||
+            end - p < lengthSize + offsetSize) {
+            throw std::invalid_argument("Malformed runlist");
+        }
+
+        Extent extent;
+        extent.VCN = vcn;
+        extent.Length = readLEN(p, lengthSize);
+        p += lengthSize;
+        if (offsetSize == 0) {
+            extent.LCN = 0;
+            extent.Sparse = true;
+        } else {
+            std::uint64_t delta = readLEN(p, offsetSize);
+            // Sign-extend the relative offset
+            if (offsetSize < 8 && (delta >> (8 * offsetSize - 1)) & 1) {
+                delta |= ~static_cast<std::uint64_t>(0) << (8 * offsetSize);
+            }
+            lcn += delta;
+            extent.LCN = lcn;
+            extent.Sparse = false;
+        }
+        p += offsetSize;
+
+        result.push_back(extent);
+        vcn += extent.Length;
+    }
+
+    return result;
+}
+
+dkt::AttributeListVector
+FileRecord::ParseAttributeList(const unsigned char *list, std::size_t size) {
+    typedef dkt::AttributeListEntryLayout AL;
+    dkt::AttributeListVector entries;
+    for (std::size_t offset = 0; offset + AL::SIZE <= size;) {
+        const unsigned char *entry = list + offset;
+        std::size_t length = AL::Length::Get(entry);
+        std::size_t nameEnd =
+            AL::NameOffset::Get(entry) + 2 * AL::NameLength::Get(entry);
+        if (length < AL::SIZE || offset + length > size || nameEnd > length) {
+            throw std::invalid_argument("Malformed $ATTRIBUTE_LIST");
+        }
+        AttributeListEntry parsed;
+        parsed.Type = AL::Type::Get(entry);
+        parsed.Name.resize(AL::NameLength::Get(entry));
+        for (std::size_t i = 0; i < parsed.Name.size(); ++i) {
+            parsed.Name[i] = dkt::LoadLE<std::uint16_t>(
+                entry + AL::NameOffset::Get(entry) + 2 * i);
+        }
+        parsed.StartVCN = AL::StartVCN::Get(entry);
+        parsed.Reference = AL::Reference::Get(entry);
+        entries.push_back(parsed);
+        offset += length;
+    }
+    return entries;
+}
+
+// Record getter (fixups applied)
+dkt::UString FileRecord::GetRecord() const { return this->record; }
+
+std::uint64_t FileRecord::GetRecordNumber() const { return this->number; }
+
+std::uint16_t FileRecord::GetSequenceNumber() const {
+    return dkt::FileRecordLayout::Sequence::Get(this->record);
+}
+
+std::uint16_t FileRecord::GetLinkCount() const {
+    return dkt::FileRecordLayout::LinkCount::Get(this->record);
+}
+
+std::uint16_t FileRecord::GetFlags() const {
+    return dkt::FileRecordLayout::Flags::Get(this->record);
+}
+
+bool FileRecord::IsInUse() const {
+    return this->GetFlags() & FILE_RECORD_FLAG_IN_USE;
+}
+
+bool FileRecord::IsDirectory() const {
+    return this->GetFlags() & FILE_RECORD_FLAG_DIRECTORY;
+}
+
+std::uint32_t FileRecord::GetBytesInUse() const {
+    return dkt::FileRecordLayout::Used::Get(this->record);
+}
+
+std::uint32_t FileRecord::GetBytesAllocated() const {
+    return dkt::FileRecordLayout::Allocated::Get(this->record);
+}
+
+std::uint64_t FileRecord::GetBaseReference() const {
+    return dkt::FileRecordLayout::Base::Get(this->record);
+}
+
+bool FileRecord::IsBaseRecord() const { return this->GetBaseReference() == 0; }
+
+std::uint64_t FileRecord::GetUnreadableSectors() const {
+    return this->unreadable;
+}
+
+std::uint64_t FileRecord::GetCreationTime() const { return this->created; }
+
+std::uint64_t FileRecord::GetModificationTime() const { return this->modified; }
+
+std::uint64_t FileRecord::GetChangeTime() const { return this->changed; }
+
+std::uint64_t FileRecord::GetAccessTime() const { return this->accessed; }
+
+bool FileRecord::HasFileName() const { return this->hasName; }
+
+std::u16string FileRecord::GetFileName() const { return this->name; }
+
+std::string FileRecord::GetFileNameUTF8() const {
+    return UTF16ToUTF8(this->name);
+}
+
+std::uint64_t FileRecord::GetParentReference() const { return this->parent; }
+
+bool FileRecord::HasData() const { return this->hasData; }
+
+bool FileRecord::IsDataResident() const { return this->dataResident; }
+
+std::uint16_t FileRecord::GetDataFlags() const { return this->dataFlags; }
+
+bool FileRecord::IsCompressed() const {
+    return this->dataFlags & ATTR_FLAG_COMPRESSED;
+}
+
+bool FileRecord::IsEncrypted() const {
+    return this->dataFlags & ATTR_FLAG_ENCRYPTED;
+}
+
+bool FileRecord::IsSparse() const { return this->dataFlags & ATTR_FLAG_SPARSE; }
+
+std::uint64_t FileRecord::GetDataSize() const { return this->dataSize; }
+
+std::uint64_t FileRecord::GetDataAllocatedSize() const {
+    return this->allocatedSize;
+}
+
+dkt::UString FileRecord::GetResidentData() const { return this->residentData; }
+
+dkt::ExtentVector FileRecord::GetExtents() const { return this->extents; }
+
+std::uint64_t FileRecord::GetDataInitializedSize() const {
+    return this->initialized;
+}
+
+bool FileRecord::HasAttributeList() const { return this->hasAttributeList; }
+
+bool FileRecord::IsAttributeListResident() const {
+    return this->attributeListResident;
+}
+
+dkt::AttributeListVector FileRecord::GetAttributeList() const {
+    return this->attributeList;
+}
+
+dkt::ExtentVector FileRecord::GetAttributeListExtents() const {
+    return this->attributeListExtents;
+}
+
+std::uint64_t FileRecord::GetAttributeListSize() const {
+    return this->attributeListSize;
+}
+
+dkt::AttributeRunsVector FileRecord::GetAttributeRuns() const {
+    return this->attributeRuns;
+}
+
+// `MFT` constructor. Reads record 0 ($MFT itself) to find where the rest of
+// the table lives. With `rescue`, all reads go through it, and a record 0
+// whose header can't be read is taken from $MFTMirr instead. A fragmented
+// $MFT may continue its runlist in extension records named by record 0's
+// $ATTRIBUTE_LIST; records past the runs that can be followed are left out
+// of `GetRecordCount` and counted by `GetUnmappedRecords`.
+// THROWS:
+//  - std::invalid_argument("Invalid cluster or file record size"): if the
+//  VBR gives no cluster size, or a record size that isn't a power of two
+//  from 256 bytes to 64 KiB in whole sectors
+//  - std::runtime_error("read: ..."): if record 0 cannot be read
+//  - std::invalid_argument(...): if record 0 is not a valid FILE record, or
+//  has no non-resident $DATA
+MFT::MFT(int fd, std::uint64_t volumeOffset, const NTFSVBR &vbr,
+         RescueReader *rescue)
+    : fd(fd), volumeOffset(volumeOffset), clusterSize(vbr.GetClusterSize()),
+      recordSize(vbr.GetFileRecordSize()), recordCount(1), unmapped(0),
+      rescue(rescue) {
+    // Checked before anything is sized by them
+    std::uint64_t size = this->recordSize;
+    if (this->clusterSize == 0 || size < FILE_RECORD_MIN_SIZE ||
+        size > FILE_RECORD_MAX_SIZE || (size & (size - 1)) != 0 ||
+        size % SECTOR_SIZE != 0 || size < FILE_RECORD_FIXUP_STRIDE) {
+        throw std::invalid_argument("Invalid cluster or file record size");
+    }
+
+    // Record 0 lives at the start of the $MFT, map it directly
+    Extent first;
+    first.VCN = 0;
+    first.LCN = vbr.GetMFTLCN();
+    first.Length = (this->recordSize + this->clusterSize - 1) /
+                   this->clusterSize;
+    first.Sparse = false;
+    this->extents.push_back(first);
+
+    dkt::UString buf(this->recordSize);
+    dkt::UString lost(this->recordSize / SECTOR_SIZE);
+    this->ReadRecords(0, 1, &buf[0], &lost[0]);
+    if (lost[0]) {
+        this->extents[0].LCN = vbr.GetMFTMirrLCN();
+        this->ReadRecords(0, 1, &buf[0], &lost[0]);
+    }
+    FileRecord self(buf, 0, this->UnreadableSectors(&lost[0]));
+    if (!self.HasData() || self.IsDataResident() ||
+        self.GetExtents().empty()) {
+        throw std::invalid_argument("$MFT has no non-resident $DATA");
+    }
+
+    this->extents = self.GetExtents();
+    if (self.HasAttributeList()) {
+        this->AddExtensionRuns(self);
+    }
+
+    // Only the runs that follow on from VCN 0 can be read
+    std::uint64_t mapped = 0;
+    for (std::size_t i = 0; i < this->extents.size(); ++i) {
+        if (this->extents[i].VCN != mapped) {
+            break;
+        }
+        mapped += this->extents[i].Length;
+    }
+    std::uint64_t total = self.GetDataSize() / this->recordSize;
+    this->recordCount = mapped * this->clusterSize / this->recordSize;
+    if (this->recordCount > total) {
+        this->recordCount = total;
+    }
+    this->unmapped = total - this->recordCount;
+}
+
+// Gather the $MFT's $DATA fragments from the extension records listed in
+// record 0's $ATTRIBUTE_LIST, in VCN order. Each extension record must lie
+// in the runs found so far; the first one that doesn't, or can't be read
+// or parsed, ends the runlist there
+void MFT::AddExtensionRuns(const FileRecord &self) {
+    try {
+        this->ForEachDataExtension(self, [this](const FileRecord &extension) {
+            dkt::ExtentVector runs = extension.GetExtents();
+            this->extents.insert(this->extents.end(), runs.begin(), runs.end());
+            std::sort(this->extents.begin(), this->extents.end(),
+                      [](const Extent &a, const Extent &b) {
+                          return a.VCN < b.VCN;
+                      });
+        });
+    } catch (std::exception &) {
+        // Cut off here; the constructor counts what's left out
+    }
+}
+
+// Call `visit` for each extension record holding a fragment of `base`'s
+// unnamed $DATA, as listed in its $ATTRIBUTE_LIST, in VCN order. A
+// non-resident list is read from disk first
+// THROWS:
+//  - std::runtime_error("read: ..."): if the list or a record can't be read
+//  - std::out_of_range("Record outside $MFT runlist"): if a record isn't
+//  mapped
+//  - std::invalid_argument(...): if the list or a record is malformed, or a
+//  record belongs to another file
+void MFT::ForEachDataExtension(
+    const FileRecord &base,
+    const std::function<void(const FileRecord &)> &visit) const {
+    dkt::AttributeListVector entries = base.GetAttributeList();
+    if (!base.IsAttributeListResident()) {
+        dkt::UString list(base.GetAttributeListSize());
+        dkt::ExtentVector runs = base.GetAttributeListExtents();
+        std::uint64_t done = 0;
+        for (std::size_t i = 0; i < runs.size() && done < list.size(); ++i) {
+            std::uint64_t n = runs[i].Length * this->clusterSize;
+            if (n > list.size() - done) {
+                n = list.size() - done;
+            }
+            if (!runs[i].Sparse) {
+                this->ReadAt(&list[done], n,
+                             this->volumeOffset +
+                                 runs[i].LCN * this->clusterSize,
+                             NULL, false);
+            }
+            done += n;
+        }
+        entries = FileRecord::ParseAttributeList(list.data(), done);
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const AttributeListEntry &a,
+                        const AttributeListEntry &b) {
+                         return a.StartVCN < b.StartVCN;
+                     });
+
+    dkt::UString buf(this->recordSize);
+    dkt::UString lost(this->recordSize / SECTOR_SIZE);
+    std::vector<std::uint64_t> read; // one record may hold two fragments
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        std::uint64_t number = entries[i].Reference & MFT_REFERENCE_MASK;
+        if (entries[i].Type != ATTR_DATA || !entries[i].Name.empty() ||
+            number == base.GetRecordNumber() ||
+            std::find(read.begin(), read.end(), number) != read.end()) {
+            continue;
+        }
+        read.push_back(number);
+        this->ReadRecords(number, 1, &buf[0], &lost[0]);
+        FileRecord extension(buf, number, this->UnreadableSectors(&lost[0]));
+        if ((extension.GetBaseReference() & MFT_REFERENCE_MASK) !=
+            base.GetRecordNumber()) {
+            throw std::invalid_argument("Extension record of another file");
+        }
+        visit(extension);
+    }
+}
+
+// Unnamed $DATA of the file with base record `base`, from the base record
+// and every extension record its $ATTRIBUTE_LIST names
+// THROWS:
+//  - as `ForEachDataExtension`
+DataAttribute MFT::ReadData(const FileRecord &base) const {
+    DataAttribute data;
+    data.Found = false;
+    data.Flags = 0;
+    data.DataSize = 0;
+    data.Initialized = 0;
+    data.Resident = false;
+    auto take = [&data](const FileRecord &record) {
+        if (!record.HasData()) {
+            return;
+        }
+        dkt::ExtentVector runs = record.GetExtents();
+        if (record.IsDataResident() ||
+            (!runs.empty() && runs.front().VCN == 0)) {
+            data.Flags = record.GetDataFlags();
+            data.DataSize = record.GetDataSize();
+            data.Initialized = record.GetDataInitializedSize();
+            data.Resident = record.IsDataResident();
+            data.ResidentData = record.GetResidentData();
+        }
+        data.Found = true;
+        data.Extents.insert(data.Extents.end(), runs.begin(), runs.end());
+    };
+    take(base);
+    if (base.HasAttributeList()) {
+        this->ForEachDataExtension(base, take);
+    }
+    std::sort(data.Extents.begin(), data.Extents.end(),
+              [](const Extent &a, const Extent &b) { return a.VCN < b.VCN; });
+    return data;
+}
+
+std::uint64_t MFT::GetVolumeOffset() const { return this->volumeOffset; }
+
+std::uint64_t MFT::GetClusterSize() const { return this->clusterSize; }
+
+std::uint64_t MFT::GetRecordSize() const { return this->recordSize; }
+
+std::uint64_t MFT::GetRecordCount() const { return this->recordCount; }
+
+std::uint64_t MFT::GetUnmappedRecords() const { return this->unmapped; }
+
+dkt::ExtentVector MFT::GetExtents() const { return this->extents; }
+
+// Run of the $MFT holding `vcn`
+// THROWS:
+//  - std::out_of_range("Record outside $MFT runlist"): if no run maps it
+const Extent &MFT::FindRun(std::uint64_t vcn) const {
+    for (std::size_t i = 0; i < this->extents.size(); ++i) {
+        if (this->extents[i].VCN <= vcn &&
+            vcn < this->extents[i].VCN + this->extents[i].Length) {
+            return this->extents[i];
+        }
+    }
+    throw std::out_of_range("Record outside $MFT runlist");
+}
+
+// Byte offset of a record on the device
+// THROWS:
+//  - std::out_of_range("Record outside $MFT runlist"): if no run maps it
+std::uint64_t MFT::GetRecordAddress(std::uint64_t record) const {
+    std::uint64_t position = record * this->recordSize;
+    std::uint64_t vcn = position / this->clusterSize;
+    const Extent &run = this->FindRun(vcn);
+    return this->volumeOffset + (run.LCN + vcn - run.VCN) * this->clusterSize +
+           position % this->clusterSize;
+}
+
+// Read `count` raw records starting at record `first` into `buf`, following
+// the $MFT's runlist. `buf` must hold `count` * record size bytes. When
+// rescuing, unreadable sectors are zero-filled and flagged in `unreadable`
+// (one flag per sector of `buf`, may be null), and `retry` goes back over
+// known-bad ones; otherwise `unreadable` is all zero.
+// THROWS:
+//  - std::out_of_range("Record outside $MFT runlist"): if a record isn't
+//  mapped by any run
+//  - std::runtime_error("read: ..."): on read failure or short read, unless
+//  rescuing
+void MFT::ReadRecords(std::uint64_t first, std::uint64_t count,
+                      unsigned char *buf, unsigned char *unreadable,
+                      bool retry) const {
+    std::uint64_t position = first * this->recordSize;
+    std::uint64_t left = count * this->recordSize;
+    if (unreadable != NULL) {
+        std::memset(unreadable, 0, left / SECTOR_SIZE);
+    }
+
+    while (left > 0) {
+        std::uint64_t vcn = position / this->clusterSize;
+        std::uint64_t inCluster = position % this->clusterSize;
+
+        const Extent &run = this->FindRun(vcn);
+
+        std::uint64_t runLeft =
+            (run.VCN + run.Length - vcn) * this->clusterSize - inCluster;
+        std::uint64_t n = left < runLeft ? left : runLeft;
+        off_t address = this->volumeOffset +
+                        (run.LCN + vcn - run.VCN) * this->clusterSize +
+                        inCluster;
+        if (run.Sparse) {
+            std::memset(buf, 0, n);
+        } else {
+            this->ReadAt(buf, n, address, unreadable, retry);
+        }
+
+        buf += n;
+        if (unreadable != NULL) {
+            unreadable += n / SECTOR_SIZE;
+        }
+        position += n;
+        left -= n;
+    }
+}
+
+// Read `length` bytes at device offset `address`, through the rescue
+// reader if there is one
+// THROWS:
+//  - std::runtime_error("read: ..."): on read failure or short read, unless
+//  rescuing
+void MFT::ReadAt(unsigned char *buf, std::uint64_t length,
+                 std::uint64_t address, unsigned char *unreadable,
+                 bool retry) const {
+    if (this->rescue != NULL) {
+        this->rescue->Read(buf, length, address, unreadable, retry);
+        return;
+    }
+    std::uint64_t done = 0;
+    while (done < length) {
+        ssize_t got =
+            devPread(this->fd, buf + done, length - done, address + done);
+        if (got < 0) {
+            throw std::runtime_error(std::string("read: ") +
+                                     std::strerror(errno));
+        }
+        if (got == 0) {
+            throw std::runtime_error("read: unexpected end of device");
+        }
+        done += got;
+    }
+}
+
+// Record-sized slice of `ReadRecords` sector flags as a bit mask
+std::uint64_t MFT::UnreadableSectors(const unsigned char *unreadable) const {
+    std::uint64_t mask = 0;
+    std::uint64_t sectors = this->recordSize / SECTOR_SIZE;
+    for (std::uint64_t i = 0; i < sectors && i < 64; ++i) {
+        mask |= static_cast<std::uint64_t>(unreadable[i] != 0) << i;
+    }
+    return mask;
+}
+
+// Parse one raw record and pass it to `visit`, unless it's empty or corrupt
+void MFT::VisitRecord(const std::function<void(const FileRecord &)> &visit,
+                      const unsigned char *begin, std::uint64_t number,
+                      std::uint64_t unreadable) const {
+    if (begin[0] != 'F' || begin[1] != 'I' || begin[2] != 'L' ||
+        begin[3] != 'E') {
+        return; // never-used or wiped record, or its header sector is lost
+    }
+    try {
+        METRICS_TIME_START(parseStart);
+        FileRecord record(dkt::UString(begin, begin + this->recordSize),
+                          number, unreadable);
+        METRICS_TIME_END(STAGE_PARSE, parseStart);
+        METRICS_ADD(METRIC_RECORDS_PARSED, 1);
+        if (unreadable != 0) {
+            METRICS_ADD(METRIC_RECORDS_PARTIAL, 1);
+        }
+        visit(record);
+    } catch (std::invalid_argument &e) {
+        // Corrupt record, skip
+        METRICS_ADD(METRIC_RECORDS_REJECTED, 1);
+    }
+}
+
+// Call `visit` for every record in [`first`, `last`) that parses as a valid
+// FILE record, reading the table in large chunks. Empty and corrupt records
+// are skipped. When rescuing, records with unreadable sectors are held back
+// until the rest of the range is in, then read again with retries, so they
+// come last and may still be missing sectors.
+void MFT::ForEachRecord(const std::function<void(const FileRecord &)> &visit,
+                        std::uint64_t first, std::uint64_t last) const {
+    std::uint64_t chunk = MFT_READ_SIZE / this->recordSize;
+    if (chunk == 0) {
+        chunk = 1;
+    }
+    if (last > this->recordCount) {
+        last = this->recordCount;
+    }
+    DeviceBuffer buf(chunk * this->recordSize);
+    std::uint64_t sectors = this->recordSize / SECTOR_SIZE;
+    dkt::UString lost(chunk * sectors);
+    std::vector<std::uint64_t> deferred; // records with unreadable sectors
+
+    for (; first < last; first += chunk) {
+        std::uint64_t count = last - first < chunk ? last - first : chunk;
+        this->ReadRecords(first, count, buf.Data(), &lost[0]);
+
+        for (std::uint64_t i = 0; i < count; ++i) {
+            if (this->UnreadableSectors(&lost[i * sectors]) != 0) {
+                deferred.push_back(first + i);
+                continue;
+            }
+            this->VisitRecord(visit, buf.Data() + i * this->recordSize,
+                              first + i, 0);
+        }
+    }
+
+    for (std::size_t i = 0; i < deferred.size(); ++i) {
+        this->ReadRecords(deferred[i], 1, buf.Data(), &lost[0], true);
+        this->VisitRecord(visit, buf.Data(), deferred[i],
+                          this->UnreadableSectors(&lost[0]));
+    }
+}
+
+// `DeviceBuffer` constructor.
+// THROWS:
+//  - std::bad_alloc: if the pool can't supply the buffer
+DeviceBuffer::DeviceBuffer(std::size_t size)
+    : data(static_cast<unsigned char *>(devBufferAlloc(size))), size(size) {
+    if (this->data == NULL) {
+        throw std::bad_alloc();
+    }
+}
+
+DeviceBuffer::~DeviceBuffer() { devBufferFree(this->data, this->size); }
+
+unsigned char *DeviceBuffer::Data() const { return this->data; }
+
+std::size_t DeviceBuffer::Size() const { return this->size; }
+
+// Convert UTF-16 (with surrogate pairs) to UTF-8. Unpaired surrogates are
+// replaced with U+FFFD.
+std::string UTF16ToUTF8(const std::u16string &in) {
+    std::string out;
+    out.reserve(in.size());
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        std::uint32_t c = in[i];
+        if (c >= 0xD800 && c <= 0xDBFF && i + 1 < in.size() &&
+            in[i + 1] >= 0xDC00 && in[i + 1] <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (in[i + 1] - 0xDC00);
+            ++i;
+        } else if (c >= 0xD800 && c <= 0xDFFF) {
+            c = 0xFFFD;
+        }
+
+        if (c < 0x80) {
+            out += static_cast<char>(c);
+        } else if (c < 0x800) {
+            out += static_cast<char>(0xC0 | c >> 6);
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += static_cast<char>(0xE0 | c >> 12);
+            out += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | c >> 18);
+            out += static_cast<char>(0x80 | (c >> 12 & 0x3F));
+            out += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+// Convert UTF-8 to UTF-16, with surrogate pairs past U+FFFF. Malformed
+// sequences are replaced with U+FFFD.
+std::u16string UTF8ToUTF16(const std::string &in) {
+    std::u16string out;
+    out.reserve(in.size());
+    for (std::size_t i = 0; i < in.size();) {
+        unsigned char lead = in[i];
+        std::size_t length = lead < 0x80   ? 1
+                             : lead < 0xC2 ? 0
+                             : lead < 0xE0 ? 2
+                             : lead < 0xF0 ? 3
+                             : lead < 0xF5 ? 4
+                                           : 0;
+        std::uint32_t c = length == 1   ? lead
+                          : length == 2 ? lead & 0x1F
+                          : length == 3 ? lead & 0x0F
+                                        : lead & 0x07;
+        std::size_t j = 1;
+        for (; j < length && i + j < in.size() &&
+               (static_cast<unsigned char>(in[i + j]) & 0xC0) == 0x80;
+             ++j) {
+            c = c << 6 | (static_cast<unsigned char>(in[i + j]) & 0x3F);
+        }
+        if (length == 0 || j < length || (length == 3 && c < 0x800) ||
+            (length == 4 && (c < 0x10000 || c > 0x10FFFF)) ||
+            (c >= 0xD800 && c <= 0xDFFF)) {
+            out += static_cast<char16_t>(0xFFFD);
+            i += j;
+            continue;
+        }
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            out += static_cast<char16_t>(0xD800 + (c >> 10));
+            out += static_cast<char16_t>(0xDC00 + (c & 0x3FF));
+        } else {
+            out += static_cast<char16_t>(c);
+        }
+        i += length;
+    }
+    return out;
+}
+
+// Name of an attribute type, as NTFS spells it; unknown types as hex
+std::string AttributeTypeName(std::uint32_t type) {
+    switch (type) {
+    case ATTR_STANDARD_INFORMATION:
+        return "$STANDARD_INFORMATION";
+    case ATTR_ATTRIBUTE_LIST:
+        return "$ATTRIBUTE_LIST";
+    case ATTR_FILE_NAME:
+        return "$FILE_NAME";
+    case ATTR_OBJECT_ID:
+        return "$OBJECT_ID";
+    case ATTR_SECURITY_DESCRIPTOR:
+        return "$SECURITY_DESCRIPTOR";
+    case ATTR_VOLUME_NAME:
+        return "$VOLUME_NAME";
+    case ATTR_VOLUME_INFORMATION:
+        return "$VOLUME_INFORMATION";
+    case ATTR_DATA:
+        return "$DATA";
+    case ATTR_INDEX_ROOT:
+        return "$INDEX_ROOT";
+    case ATTR_INDEX_ALLOCATION:
+        return "$INDEX_ALLOCATION";
+    case ATTR_BITMAP:
+        return "$BITMAP";
+    case ATTR_REPARSE_POINT:
+        return "$REPARSE_POINT";
+    case ATTR_EA_INFORMATION:
+        return "$EA_INFORMATION";
+    case ATTR_EA:
+        return "$EA";
+    case ATTR_LOGGED_UTILITY_STREAM:
+        return "$LOGGED_UTILITY_STREAM";
+    }
+    std::stringstream ss;
+    ss << "0x" << std::hex << type;
+    return ss.str();
+}
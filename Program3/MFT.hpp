@@ -0,0 +1,256 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_MFT_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_MFT_HPP_
+
+// Standard library
+#include <cstddef>    // std::size_t
+#include <cstdint>    // for standard types
+#include <functional> // std::function
+#include <string>     // std::string, std::u16string
+#include <vector>     // std::vector
+
+// Self-defined
+#include "Constants.hpp"
+#include "Rescue.hpp"
+#include "utility.hpp"
+
+// Class declarations
+class FileRecord;
+class MFT;
+class DeviceBuffer;
+
+// Run of clusters belonging to a non-resident attribute
+struct Extent {
+    std::uint64_t VCN;    // first virtual cluster number of the run
+    std::uint64_t LCN;    // first logical cluster number (0 if sparse)
+    std::uint64_t Length; // run length, in clusters
+    bool Sparse;          // run has no clusters allocated on disk
+};
+
+// Entry of an $ATTRIBUTE_LIST: the record holding an attribute, or one
+// fragment of a non-resident attribute
+struct AttributeListEntry {
+    std::uint32_t Type;
+    std::u16string Name;
+    std::uint64_t StartVCN;  // first VCN of the fragment
+    std::uint64_t Reference; // holding record, with sequence number
+};
+
+// Type aliases
+namespace dkt {
+typedef std::vector<Extent> ExtentVector;     // vector of `Extent`s
+typedef std::vector<AttributeListEntry> AttributeListVector;
+} // namespace dkt
+
+// Runs of one non-resident attribute, or of the fragment of it held in one
+// record
+struct AttributeRuns {
+    std::uint32_t Type;
+    std::u16string Name;       // empty for the unnamed attribute
+    dkt::ExtentVector Extents; // from the fragment's first VCN
+};
+
+// Unnamed $DATA of a file, put back together from every record holding a
+// fragment of it. Sizes and flags come from the fragment at VCN 0
+struct DataAttribute {
+    bool Found;                // some record holds a fragment
+    std::uint16_t Flags;       // compressed, encrypted, sparse
+    std::uint64_t DataSize;    // bytes of content
+    std::uint64_t Initialized; // bytes written
+    bool Resident;             // content is `ResidentData`
+    dkt::UString ResidentData; // resident content
+    dkt::ExtentVector Extents; // every fragment's runs, in VCN order
+};
+
+namespace dkt {
+typedef std::vector<AttributeRuns> AttributeRunsVector;
+typedef std::vector<FileRecord> RecordVector; // vector of `FileRecord`s
+} // namespace dkt
+
+// Class definitions
+
+// $MFT file record ("FILE" record)
+class FileRecord {
+  protected:
+    // Data fields
+    dkt::UString record;      // stored record, fixups applied
+    std::uint64_t number;     // record number in $MFT
+    std::uint64_t unreadable; // bit n: sector n couldn't be read
+
+    // $STANDARD_INFORMATION timestamps (Windows FILETIME)
+    std::uint64_t created;
+    std::uint64_t modified;
+    std::uint64_t changed;
+    std::uint64_t accessed;
+
+    // $FILE_NAME
+    bool hasName;
+    std::u16string name;  // UTF-16 name, long namespace preferred
+    std::uint64_t parent; // parent directory reference
+
+    // Unnamed $DATA
+    bool hasData;
+    bool dataResident;
+    std::uint16_t dataFlags;     // compressed/encrypted/sparse flags
+    std::uint64_t dataSize;      // real size of the stream
+    std::uint64_t allocatedSize; // allocated size of the stream
+    std::uint64_t initialized;   // bytes written; the rest reads as zeros
+    dkt::UString residentData;   // resident stream contents
+    dkt::ExtentVector extents;   // non-resident stream runs
+
+    // $ATTRIBUTE_LIST: entries if resident, else where they are
+    bool hasAttributeList;
+    bool attributeListResident;
+    dkt::AttributeListVector attributeList;
+    dkt::ExtentVector attributeListExtents;
+    std::uint64_t attributeListSize;
+
+    // Every non-resident attribute in this record, in record order
+    dkt::AttributeRunsVector attributeRuns;
+
+    // Methods
+    void ApplyFixups();
+    void ParseAttributes();
+    static AttributeRuns DecodeAttribute(const unsigned char *,
+                                         std::size_t); // header, length
+
+  public:
+    // Constructors
+    FileRecord(const dkt::UString &, std::uint64_t,
+               std::uint64_t unreadable = 0); // record, record number,
+                                              // zero-filled sectors
+
+    // Methods
+    dkt::UString GetRecord() const;
+    std::uint64_t GetRecordNumber() const;
+    std::uint16_t GetSequenceNumber() const;
+    std::uint16_t GetLinkCount() const;
+    std::uint16_t GetFlags() const;
+    bool IsInUse() const;
+    bool IsDirectory() const;
+    std::uint32_t GetBytesInUse() const;
+    std::uint32_t GetBytesAllocated() const;
+    std::uint64_t GetBaseReference() const;
+    bool IsBaseRecord() const; // not an extension of another record
+    std::uint64_t GetUnreadableSectors() const; // bit n: sector n lost
+
+    std::uint64_t GetCreationTime() const;
+    std::uint64_t GetModificationTime() const;
+    std::uint64_t GetChangeTime() const;
+    std::uint64_t GetAccessTime() const;
+
+    bool HasFileName() const;
+    std::u16string GetFileName() const;
+    std::string GetFileNameUTF8() const;
+    std::uint64_t GetParentReference() const;
+
+    bool HasData() const;
+    bool IsDataResident() const;
+    std::uint16_t GetDataFlags() const;
+    bool IsCompressed() const;
+    bool IsEncrypted() const;
+    bool IsSparse() const;
+    std::uint64_t GetDataSize() const;
+    std::uint64_t GetDataAllocatedSize() const;
+    std::uint64_t GetDataInitializedSize() const;
+    dkt::UString GetResidentData() const;
+    dkt::ExtentVector GetExtents() const;
+
+    // Attributes kept in extension records are listed in $ATTRIBUTE_LIST.
+    // Its entries are only at hand when it is resident
+    bool HasAttributeList() const;
+    bool IsAttributeListResident() const;
+    dkt::AttributeListVector GetAttributeList() const;
+    dkt::ExtentVector GetAttributeListExtents() const;
+    std::uint64_t GetAttributeListSize() const;
+
+    // Runs of every non-resident attribute: $DATA streams, named or not,
+    // $INDEX_ALLOCATION, $BITMAP, a non-resident $ATTRIBUTE_LIST, ...
+    dkt::AttributeRunsVector GetAttributeRuns() const;
+
+    // Runlist decoder. Decodes the mapping pairs in [begin, end) into
+    // extents starting at `startVCN`
+    static dkt::ExtentVector DecodeRunlist(const unsigned char *begin,
+                                           const unsigned char *end,
+                                           std::uint64_t startVCN);
+
+    // $ATTRIBUTE_LIST decoder
+    // THROWS:
+    //  - std::invalid_argument("Malformed $ATTRIBUTE_LIST"): if an entry
+    //  overflows the list
+    static dkt::AttributeListVector
+    ParseAttributeList(const unsigned char *, std::size_t);
+};
+
+// $MFT of an NTFS volume
+class MFT {
+  protected:
+    // Data fields
+    int fd;                     // opened device
+    std::uint64_t volumeOffset; // byte offset of the volume on the device
+    std::uint64_t clusterSize;  // cluster size, in bytes
+    std::uint64_t recordSize;   // FILE record size, in bytes
+    std::uint64_t recordCount;  // number of records in $MFT
+    std::uint64_t unmapped;     // records past the runlist we could follow
+    dkt::ExtentVector extents;  // runs of the $MFT's own $DATA
+    RescueReader *rescue;       // bad-sector tolerant reads, if rescuing
+
+    const Extent &FindRun(std::uint64_t) const; // run holding a VCN
+    void ReadAt(unsigned char *, std::uint64_t, std::uint64_t,
+                unsigned char *, bool) const; // buffer, length, offset
+    void AddExtensionRuns(const FileRecord &);
+    void ForEachDataExtension(const FileRecord &,
+                              const std::function<void(const FileRecord &)> &)
+        const; // base record, visitor
+    std::uint64_t UnreadableSectors(const unsigned char *) const;
+    void VisitRecord(const std::function<void(const FileRecord &)> &,
+                     const unsigned char *, std::uint64_t,
+                     std::uint64_t) const; // raw record, number, lost sectors
+
+  public:
+    // Constructors
+    MFT(int, std::uint64_t, const NTFSVBR &,
+        RescueReader *rescue = NULL); // device, volume offset, VBR
+
+    // Methods
+    std::uint64_t GetVolumeOffset() const;
+    std::uint64_t GetClusterSize() const;
+    std::uint64_t GetRecordSize() const;
+    std::uint64_t GetRecordCount() const;
+    std::uint64_t GetUnmappedRecords() const; // cut off, see constructor
+    dkt::ExtentVector GetExtents() const;
+    std::uint64_t GetRecordAddress(std::uint64_t) const; // device offset
+    void ReadRecords(std::uint64_t, std::uint64_t, unsigned char *,
+                     unsigned char *unreadable = NULL,
+                     bool retry = false) const;
+    void ForEachRecord(const std::function<void(const FileRecord &)> &,
+                       std::uint64_t first = 0,
+                       std::uint64_t last = UINT64_MAX) const;
+    DataAttribute ReadData(const FileRecord &) const; // base record
+};
+
+// Buffer from the device I/O pool, aligned so direct reads land in it
+// without a bounce copy
+class DeviceBuffer {
+  protected:
+    // Data fields
+    unsigned char *data;
+    std::size_t size;
+
+  public:
+    // Constructors
+    explicit DeviceBuffer(std::size_t); // size, in bytes
+    ~DeviceBuffer();
+    DeviceBuffer(const DeviceBuffer &) = delete;
+    DeviceBuffer &operator=(const DeviceBuffer &) = delete;
+
+    // Methods
+    unsigned char *Data() const;
+    std::size_t Size() const;
+};
+
+// Function prototypes
+std::string UTF16ToUTF8(const std::u16string &);
+std::u16string UTF8ToUTF16(const std::string &);
+std::string AttributeTypeName(std::uint32_t); // "$DATA", ...
+
+#endif
@@ -0,0 +1,246 @@
+// UTD Summer 2020 Project - NTFS Filesystem
+// Program 3 - Synthetic MBR + NTFS image generator
+//
+// Written by Dien Tran. Compile with a C++11 compiler.
+//
+// Writes a reproducible disk image for scale and performance testing: an MBR
+// with one NTFS partition, a $MFT with the requested number of records, and
+// file contents laid out behind it. The image is read back through the same
+// MBR, NTFSVBR and MFT classes Program3 uses before the tool reports success.
+
+#ifndef __linux
+#error This program can only be compiled on Linux systems.
+#endif
+
+#if __cplusplus < 201103L
+#error This program requires a C++11 or newer compiler.
+#endif
+
+#define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
+
+// Standard headers
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdexcept>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Self-defined headers
+#include "../Common/devio.h"
+#include "../Common/outbuf.h"
+#include "Constants.hpp"
+#include "ImageBuilder.hpp"
+#include "MFT.hpp"
+#include "utility.hpp"
+
+// Read the image back and run it through the parsers
+// THROWS:
+//  - std::invalid_argument(...): if the MBR or VBR is rejected
+//  - std::runtime_error(...): if the layout read back isn't what was written
+void verifyImage(int fd, const ImageOptions &opts,
+                 const ImageSummary &summary) {
+    dkt::UString mbrStr(SECTOR_SIZE);
+    dkt::UString vbrStr(SECTOR_SIZE);
+    if (devPread(fd, &mbrStr[0], SECTOR_SIZE, 0) != SECTOR_SIZE ||
+        devPread(fd, &vbrStr[0], SECTOR_SIZE, summary.VolumeOffset) !=
+            SECTOR_SIZE) {
+        throw std::runtime_error("Short read on the written image");
+    }
+
+    MBR mbr(mbrStr);
+    dkt::EntryVector entries = mbr.ParseEntries();
+    if (entries.empty() ||
+        entries[0].GetStartingSector() * SECTOR_SIZE != summary.VolumeOffset) {
+        throw std::runtime_error("Partition entry doesn't match the volume");
+    }
+    NTFSPartitionEntry entry(entries[0].GetEntry());
+    NTFSVBR vbr(vbrStr);
+    if (vbr.GetClusterSize() != opts.ClusterSize ||
+        vbr.GetMFTLCN() != summary.MFTLCN) {
+        throw std::runtime_error("VBR geometry doesn't match the volume");
+    }
+    MFT mft(fd, summary.VolumeOffset, vbr);
+    if (mft.GetRecordCount() != opts.Records) {
+        throw std::runtime_error("$MFT size doesn't match the record count");
+    }
+}
+
+// Warn about every share that came out under half of what was asked for:
+// files too small to split or leave sparse, or too few records for the odds
+void checkShares(const ImageOptions &opts, const ImageSummary &summary) {
+    const struct {
+        const char *Name;
+        double Asked;
+        std::uint64_t Got;
+    } shares[] = {{"fragmented", opts.Fragmentation, summary.Fragmented},
+                  {"compressed", opts.Compressed, summary.Compressed},
+                  {"sparse", opts.Sparse, summary.Sparse}};
+    for (std::size_t i = 0; i < sizeof(shares) / sizeof(shares[0]); ++i) {
+        double got = summary.Files != 0
+                         ? static_cast<double>(shares[i].Got) / summary.Files
+                         : 0;
+        if (shares[i].Asked > 0 && got < shares[i].Asked / 2) {
+            std::fprintf(stderr,
+                         "Warning: %.2f%% of files are %s, against %.2f%% "
+                         "asked; raise --max-file-size or --records\n",
+                         100 * got, shares[i].Name, 100 * shares[i].Asked);
+        }
+    }
+}
+
+void displaySummary(const char *path, const ImageOptions &opts,
+                    const ImageSummary &summary, OutBuf *out) {
+    outBufPuts(out, path);
+    outBufPuts(out, ": ");
+    outBufU64(out, summary.ImageSize);
+    outBufPuts(out, " bytes\n\nNTFS volume at sector ");
+    outBufU64(out, summary.VolumeOffset / SECTOR_SIZE);
+    outBufPuts(out, ", ");
+    outBufU64(out, summary.TotalClusters);
+    outBufPuts(out, " clusters of ");
+    outBufU64(out, opts.ClusterSize);
+    outBufPuts(out, " bytes\n$MFT address: 0x");
+    outBufHex(out,
+              summary.VolumeOffset + summary.MFTLCN * opts.ClusterSize, 0,
+              true);
+    outBufPuts(out, ", ");
+    outBufU64(out, opts.Records);
+    outBufPuts(out, " records\n\n");
+
+    const struct {
+        const char *Name;
+        std::uint64_t Value;
+    } rows[] = {{"files", summary.Files},
+                {"directories", summary.Directories},
+                {"deleted", summary.Deleted},
+                {"resident", summary.Resident},
+                {"fragmented", summary.Fragmented},
+                {"compressed", summary.Compressed},
+                {"sparse", summary.Sparse},
+                {"content bytes", summary.DataBytes}};
+    for (std::size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); ++i) {
+        outBufPuts(out, rows[i].Name);
+        outBufPuts(out, ": ");
+        outBufU64(out, rows[i].Value);
+        outBufPutc(out, '\n');
+    }
+    outBufPuts(out, "\nMBR, NTFS VBR and $MFT checks passed\n");
+}
+
+int main(int argc, char **argv) {
+    ImageOptions opts;
+    opts.ClusterSize = 4096;
+    opts.Records = 100000;
+    opts.Fragmentation = 0.1;
+    opts.Deleted = 0.05;
+    opts.Compressed = 0;
+    opts.Sparse = 0;
+    opts.MaxFileSize = 65536;
+    opts.Seed = 1;
+    opts.WriteData = true;
+
+    const struct option longOptions[] = {
+        {"cluster-size", required_argument, NULL, 'c'},
+        {"records", required_argument, NULL, 'r'},
+        {"fragmentation", required_argument, NULL, 'f'},
+        {"deleted", required_argument, NULL, 'd'},
+        {"compressed", required_argument, NULL, 'z'},
+        {"sparse", required_argument, NULL, 's'},
+        {"max-file-size", required_argument, NULL, 'm'},
+        {"seed", required_argument, NULL, 'S'},
+        {"no-data", no_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}};
+    bool badOption = false;
+    int c;
+    while ((c = getopt_long(argc, argv, "c:r:f:d:z:s:m:S:n", longOptions,
+                            NULL)) != -1) {
+        switch (c) {
+        case 'c':
+            opts.ClusterSize = std::strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            opts.Records = std::strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            opts.Fragmentation = std::strtod(optarg, NULL);
+            break;
+        case 'd':
+            opts.Deleted = std::strtod(optarg, NULL);
+            break;
+        case 'z':
+            opts.Compressed = std::strtod(optarg, NULL);
+            break;
+        case 's':
+            opts.Sparse = std::strtod(optarg, NULL);
+            break;
+        case 'm':
+            opts.MaxFileSize = std::strtoull(optarg, NULL, 10);
+            break;
+        case 'S':
+            opts.Seed = std::strtoull(optarg, NULL, 10);
+            break;
+        case 'n':
+            opts.WriteData = false;
+            break;
+        default:
+            badOption = true;
+            break;
+        }
+    }
+    if (badOption || optind != argc - 1) {
+        std::fprintf(stderr,
+                     "Usage: %s [--cluster-size BYTES] [--records N] "
+                     "[--fragmentation P] [--deleted P] [--compressed P] "
+                     "[--sparse P] [--max-file-size BYTES] [--seed N] "
+                     "[--no-data] OUTPUT\n",
+                     argv[0]);
+        return ARGUMENT_EXPECTED;
+    }
+    const char *path = argv[optind];
+
+    ImageBuilder *builder;
+    try {
+        builder = new ImageBuilder(opts);
+    } catch (std::invalid_argument &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return ARGUMENT_EXPECTED;
+    }
+
+    // Generate
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        delete builder;
+        return OPEN_ERROR;
+    }
+    ImageSummary summary;
+    try {
+        summary = builder->Write(fd);
+    } catch (std::runtime_error &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        close(fd);
+        delete builder;
+        return WRITE_ERROR;
+    }
+    delete builder;
+
+    // Check it reads back
+    try {
+        verifyImage(fd, opts, summary);
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "Generated image failed checks: %s\n", e.what());
+        close(fd);
+        return MFT_ERROR;
+    }
+    close(fd);
+    checkShares(opts, summary);
+
+    OutBuf out;
+    outBufInit(&out, STDOUT_FILENO, OUTBUF_DEFAULT_CAPACITY);
+    displaySummary(path, opts, summary, &out);
+    outBufFree(&out);
+    return SUCCESS;
+}
@@ -0,0 +1,569 @@
+#include "NameIndex.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Common/outbuf.h"
+
+namespace {
+const std::uint64_t LIVE = 1ULL << 63; // row flag in the record table
+const char INDEX_MAGIC[8] = {'n', 't', 'f', 's', 'n', 'i', 'x', '1'};
+const std::uint64_t INDEX_ORDER = 0x0102030405060708ULL; // byte order check
+
+// Index file header. The tables follow in native byte order, each starting
+// on an 8-byte boundary: records, starts, directory, names, postings
+struct IndexHeader {
+    char Magic[8];
+    std::uint64_t Order;
+    std::uint64_t VolumeOffset;
+    std::uint64_t Serial;
+    std::uint64_t RecordCount;
+    std::uint64_t Rows;
+    std::uint64_t NameUnits;
+    std::uint64_t Trigrams;
+    std::uint64_t PostingBytes;
+};
+
+std::uint64_t align8(std::uint64_t bytes) { return (bytes + 7) / 8 * 8; }
+
+// Byte offsets of the tables an index file with `header` holds, and its
+// total size
+struct IndexLayout {
+    std::uint64_t Records;
+    std::uint64_t Starts;
+    std::uint64_t Directory;
+    std::uint64_t Names;
+    std::uint64_t Postings;
+    std::uint64_t Size;
+};
+
+IndexLayout layout(const IndexHeader &header) {
+    IndexLayout at;
+    at.Records = sizeof(IndexHeader);
+    at.Starts = at.Records + 8 * header.Rows;
+    at.Directory = at.Starts + 8 * (header.Rows + 1);
+    at.Names = at.Directory + sizeof(PostingEntry) * header.Trigrams;
+    at.Postings = at.Names + align8(2 * header.NameUnits);
+    at.Size = at.Postings + header.PostingBytes;
+    return at;
+}
+
+std::uint64_t trigram(const char16_t *units) {
+    return static_cast<std::uint64_t>(units[0]) << 32 |
+           static_cast<std::uint64_t>(units[1]) << 16 | units[2];
+}
+
+// Distinct trigrams of `text`, sorted
+std::vector<std::uint64_t> trigrams(const std::u16string &text) {
+    std::vector<std::uint64_t> keys;
+    for (std::size_t i = 0; i + 3 <= text.size(); ++i) {
+        keys.push_back(trigram(&text[i]));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// Case-folded copy, with `padStart` and `padEnd` null units around it
+std::u16string fold(const std::u16string &text, std::size_t padStart,
+                    std::size_t padEnd) {
+    std::u16string folded(padStart, u'\0');
+    folded.reserve(padStart + text.size() + padEnd);
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        folded += NameIndex::Fold(text[i]);
+    }
+    folded.append(padEnd, u'\0');
+    return folded;
+}
+
+void putVarint(dkt::UString &out, std::uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+std::uint32_t getVarint(const unsigned char *&in) {
+    std::uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char byte = *in++;
+        value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+bool byKey(const PostingEntry &a, const PostingEntry &b) {
+    return a.Key < b.Key;
+}
+
+// Pairs of upper and lower case letters a unit apart, upper first when
+// `evenUpper`
+char16_t foldPair(char16_t c, bool evenUpper) {
+    return (c % 2 == 0) == evenUpper ? c : c - 1;
+}
+
+bool byCount(const PostingEntry *a, const PostingEntry *b) {
+    return a->Count < b->Count;
+}
+
+char16_t foldUnit(char16_t c) {
+    if (c < 0x80) {
+        return c >= u'a' && c <= u'z' ? c - 0x20 : c;
+    }
+    if (c == 0xB5) {
+        return 0x39C; // micro sign
+    }
+    if (c >= 0xE0 && c <= 0xFE && c != 0xF7) {
+        return c - 0x20;
+    }
+    if (c == 0xFF) {
+        return 0x178;
+    }
+    if ((c >= 0x100 && c <= 0x12F) || (c >= 0x132 && c <= 0x137) ||
+        (c >= 0x14A && c <= 0x177)) {
+        return foldPair(c, true);
+    }
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) {
+        return foldPair(c, false);
+    }
+    if (c == 0x3AC) {
+        return 0x386;
+    }
+    if (c >= 0x3AD && c <= 0x3AF) {
+        return c - 0x25;
+    }
+    if (c == 0x3C2) {
+        return 0x3A3; // final sigma
+    }
+    if (c >= 0x3B1 && c <= 0x3CB) {
+        return c - 0x20;
+    }
+    if (c == 0x3CC) {
+        return 0x38C;
+    }
+    if (c == 0x3CD || c == 0x3CE) {
+        return c - 0x3F;
+    }
+    if (c >= 0x430 && c <= 0x44F) {
+        return c - 0x20;
+    }
+    if (c >= 0x450 && c <= 0x45F) {
+        return c - 0x50;
+    }
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) ||
+        (c >= 0x4D0 && c <= 0x52F)) {
+        return foldPair(c, true);
+    }
+    if (c >= 0x4C1 && c <= 0x4CE) {
+        return foldPair(c, false);
+    }
+    if (c >= 0x561 && c <= 0x586) {
+        return c - 0x30;
+    }
+    if ((c >= 0x1E00 && c <= 0x1E95) || (c >= 0x1EA0 && c <= 0x1EFF)) {
+        return foldPair(c, true);
+    }
+    if (c >= 0xFF41 && c <= 0xFF5A) {
+        return c - 0x20; // full width
+    }
+    return c;
+}
+
+// Fold of every UTF-16 unit, laid out as NTFS lays out $UpCase
+std::vector<char16_t> makeUpcase() {
+    std::vector<char16_t> table(0x10000);
+    for (std::size_t c = 0; c < table.size(); ++c) {
+        table[c] = foldUnit(static_cast<char16_t>(c));
+    }
+    return table;
+}
+
+const char16_t *upcase() {
+    static const std::vector<char16_t> table = makeUpcase();
+    return &table[0];
+}
+} // namespace
+
+// `NameIndex` constructor. Empty until built or loaded
+NameIndex::NameIndex()
+    : starts(1, 0), buildingBytes(0), mapped(NULL), mappedSize(0) {
+    std::memset(&this->tables, 0, sizeof(Tables));
+    this->tables.Starts = &this->starts[0];
+}
+
+NameIndex::~NameIndex() {
+    if (this->mapped != NULL) {
+        munmap(this->mapped, this->mappedSize);
+    }
+}
+
+void NameIndex::Add(const FileRecord &record) {
+    if (!record.IsBaseRecord() || !record.HasFileName()) {
+        return;
+    }
+    std::uint32_t row = this->records.size();
+    std::u16string name = record.GetFileName();
+    this->records.push_back(record.GetRecordNumber() |
+                            (record.IsInUse() ? LIVE : 0));
+    this->names += name;
+    this->starts.push_back(this->names.size());
+
+    std::vector<std::uint64_t> keys = trigrams(fold(name, 1, 2));
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        Building &list = this->building[keys[i]];
+        this->buildingBytes -= list.Bytes.capacity();
+        putVarint(list.Bytes, list.Count == 0 ? row : row - list.Last);
+        this->buildingBytes += list.Bytes.capacity();
+        list.Last = row;
+        ++list.Count;
+    }
+}
+
+void NameIndex::Build() {
+    this->directory.clear();
+    this->directory.reserve(this->building.size());
+    std::size_t total = 0;
+    for (auto it = this->building.begin(); it != this->building.end(); ++it) {
+        PostingEntry entry = {it->first, 0, it->second.Count};
+        this->directory.push_back(entry);
+        total += it->second.Bytes.size();
+    }
+    std::sort(this->directory.begin(), this->directory.end(), byKey);
+
+    this->postings.clear();
+    this->postings.reserve(total);
+    for (std::size_t i = 0; i < this->directory.size(); ++i) {
+        PostingEntry &entry = this->directory[i];
+        dkt::UString &bytes = this->building[entry.Key].Bytes;
+        entry.Offset = this->postings.size();
+        this->postings.insert(this->postings.end(), bytes.begin(), bytes.end());
+        dkt::UString().swap(bytes);
+    }
+    // Release the build tables, which outweigh the lists themselves
+    std::unordered_map<std::uint64_t, Building>().swap(this->building);
+    this->buildingBytes = 0;
+
+    this->tables.Records = this->records.data();
+    this->tables.Starts = this->starts.data();
+    this->tables.Names = this->names.data();
+    this->tables.Directory = this->directory.data();
+    this->tables.Postings = this->postings.data();
+    this->tables.Rows = this->records.size();
+    this->tables.NameUnits = this->names.size();
+    this->tables.Trigrams = this->directory.size();
+    this->tables.PostingBytes = this->postings.size();
+}
+
+bool NameIndex::Load(const std::string &path, const NameIndexKey &key) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    IndexHeader header;
+    bool ok = fstat(fd, &st) == 0 &&
+              static_cast<std::uint64_t>(st.st_size) >= sizeof(header) &&
+              pread(fd, &header, sizeof(header), 0) ==
+                  static_cast<ssize_t>(sizeof(header)) &&
+              std::memcmp(header.Magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) ==
+                  0 &&
+              header.Order == INDEX_ORDER &&
+              header.VolumeOffset == key.VolumeOffset &&
+              header.Serial == key.Serial &&
+              header.RecordCount == key.RecordCount &&
+              layout(header).Size == static_cast<std::uint64_t>(st.st_size);
+    void *mapped = MAP_FAILED;
+    if (ok) {
+        mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    const unsigned char *base = static_cast<const unsigned char *>(mapped);
+    IndexLayout at = layout(header);
+    Tables tables;
+    tables.Records = reinterpret_cast<const std::uint64_t *>(base + at.Records);
+    tables.Starts = reinterpret_cast<const std::uint64_t *>(base + at.Starts);
+    tables.Names = reinterpret_cast<const char16_t *>(base + at.Names);
+    tables.Directory =
+        reinterpret_cast<const PostingEntry *>(base + at.Directory);
+    tables.Postings = base + at.Postings;
+    tables.Rows = header.Rows;
+    tables.NameUnits = header.NameUnits;
+    tables.Trigrams = header.Trigrams;
+    tables.PostingBytes = header.PostingBytes;
+    if (tables.Starts[0] != 0 ||
+        tables.Starts[tables.Rows] != header.NameUnits) {
+        munmap(mapped, st.st_size);
+        return false;
+    }
+
+    if (this->mapped != NULL) {
+        munmap(this->mapped, this->mappedSize);
+    }
+    this->mapped = mapped;
+    this->mappedSize = st.st_size;
+    this->tables = tables;
+    return true;
+}
+
+bool NameIndex::Save(const std::string &path, const NameIndexKey &key) const {
+    IndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.Magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.Order = INDEX_ORDER;
+    header.VolumeOffset = key.VolumeOffset;
+    header.Serial = key.Serial;
+    header.RecordCount = key.RecordCount;
+    header.Rows = this->tables.Rows;
+    header.NameUnits = this->tables.NameUnits;
+    header.Trigrams = this->tables.Trigrams;
+    header.PostingBytes = this->tables.PostingBytes;
+
+    std::string temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const char padding[8] = {0};
+    OutBuf out;
+    outBufInit(&out, fd, OUTBUF_DEFAULT_CAPACITY);
+    outBufWrite(&out, &header, sizeof(header));
+    outBufWrite(&out, this->tables.Records, 8 * header.Rows);
+    outBufWrite(&out, this->tables.Starts, 8 * (header.Rows + 1));
+    outBufWrite(&out, this->tables.Directory,
+                sizeof(PostingEntry) * header.Trigrams);
+    outBufWrite(&out, this->tables.Names, 2 * header.NameUnits);
+    outBufWrite(&out, padding,
+                align8(2 * header.NameUnits) - 2 * header.NameUnits);
+    outBufWrite(&out, this->tables.Postings, header.PostingBytes);
+    bool ok = outBufFlush(&out) && fsync(fd) == 0;
+    outBufFree(&out);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        saved = errno;
+        unlink(temp.c_str());
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+const PostingEntry *NameIndex::FindPosting(std::uint64_t key) const {
+    const PostingEntry *end =
+        this->tables.Directory + this->tables.Trigrams;
+    PostingEntry probe = {key, 0, 0};
+    const PostingEntry *found =
+        std::lower_bound(this->tables.Directory, end, probe, byKey);
+    if (found == end || found->Key != key) {
+        return NULL;
+    }
+    return found;
+}
+
+void NameIndex::Decode(const PostingEntry &entry, dkt::RowVector &rows) const {
+    const unsigned char *in = this->tables.Postings + entry.Offset;
+    std::uint32_t row = 0;
+    for (std::uint32_t i = 0; i < entry.Count; ++i) {
+        row += getVarint(in);
+        rows.push_back(row);
+    }
+}
+
+// Keep the rows that are also in `entry`'s list. Both are ascending, so
+// one merge pass does, stopping once `rows` runs out
+void NameIndex::Intersect(const PostingEntry &entry,
+                          dkt::RowVector &rows) const {
+    const unsigned char *in = this->tables.Postings + entry.Offset;
+    std::uint32_t row = 0;
+    std::size_t kept = 0;
+    std::size_t next = 0;
+    for (std::uint32_t i = 0; i < entry.Count && next < rows.size(); ++i) {
+        row += getVarint(in);
+        while (next < rows.size() && rows[next] < row) {
+            ++next;
+        }
+        if (next < rows.size() && rows[next] == row) {
+            rows[kept++] = row;
+            ++next;
+        }
+    }
+    rows.resize(kept);
+}
+
+// Rows in any list with a key in [first, end). The lists overlap, so rows
+// are marked in a bitmap rather than merged
+void NameIndex::Union(std::uint64_t first, std::uint64_t end,
+                      dkt::RowVector &rows) const {
+    std::vector<std::uint64_t> seen((this->tables.Rows + 63) / 64);
+    const PostingEntry *last = this->tables.Directory + this->tables.Trigrams;
+    PostingEntry probe = {first, 0, 0};
+    const PostingEntry *it =
+        std::lower_bound(this->tables.Directory, last, probe, byKey);
+    for (; it != last && it->Key < end; ++it) {
+        const unsigned char *in = this->tables.Postings + it->Offset;
+        std::uint32_t row = 0;
+        for (std::uint32_t i = 0; i < it->Count; ++i) {
+            row += getVarint(in);
+            seen[row / 64] |= 1ULL << row % 64;
+        }
+    }
+    for (std::size_t i = 0; i < seen.size(); ++i) {
+        for (std::uint64_t bits = seen[i]; bits != 0; bits &= bits - 1) {
+            rows.push_back(i * 64 + __builtin_ctzll(bits));
+        }
+    }
+}
+
+bool NameIndex::Matches(std::uint32_t row, const NameQuery &query,
+                        const std::u16string &folded) const {
+    const char16_t *name = this->tables.Names + this->tables.Starts[row];
+    std::size_t length =
+        this->tables.Starts[row + 1] - this->tables.Starts[row];
+    const std::u16string &text = query.MatchCase ? query.Text : folded;
+    if (text.size() > length ||
+        (query.AnchorStart && query.AnchorEnd && text.size() != length)) {
+        return false;
+    }
+
+    const char16_t *table = upcase();
+    std::size_t first = query.AnchorEnd ? length - text.size() : 0;
+    std::size_t last = query.AnchorStart ? 0 : length - text.size();
+    for (std::size_t at = first; at <= last; ++at) {
+        std::size_t i = 0;
+        while (i < text.size() &&
+               (query.MatchCase ? name[at + i] : table[name[at + i]]) ==
+                   text[i]) {
+            ++i;
+        }
+        if (i == text.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+dkt::RowVector NameIndex::Search(const NameQuery &query) const {
+    std::u16string folded = fold(query.Text, 0, 0);
+    std::u16string padded =
+        fold(query.Text, query.AnchorStart, query.AnchorEnd);
+
+    // Candidates: rows holding every trigram of the query, or, for one or
+    // two units, rows with any trigram starting with them. Names carry two
+    // null units at the end, so every unit of theirs starts a trigram
+    dkt::RowVector rows;
+    if (padded.size() >= 3) {
+        std::vector<std::uint64_t> keys = trigrams(padded);
+        std::vector<const PostingEntry *> lists;
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            const PostingEntry *entry = this->FindPosting(keys[i]);
+            if (entry == NULL) {
+                return rows;
+            }
+            lists.push_back(entry);
+        }
+        std::sort(lists.begin(), lists.end(), byCount);
+        rows.reserve(lists[0]->Count);
+        this->Decode(*lists[0], rows);
+        for (std::size_t i = 1; i < lists.size() && !rows.empty(); ++i) {
+            this->Intersect(*lists[i], rows);
+        }
+    } else if (!padded.empty()) {
+        std::u16string prefix = padded;
+        prefix.resize(3, u'\0');
+        std::uint64_t first = trigram(prefix.c_str());
+        this->Union(first, first + (1ULL << 16 * (3 - padded.size())), rows);
+    } else {
+        rows.resize(this->tables.Rows);
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            rows[i] = i;
+        }
+    }
+
+    // Up to a trigram, the index has the answer; past that, or for an exact
+    // case match, check the names
+    if (padded.size() <= 3 && !query.MatchCase) {
+        return rows;
+    }
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        if (this->Matches(rows[i], query, folded)) {
+            rows[kept++] = rows[i];
+        }
+    }
+    rows.resize(kept);
+    return rows;
+}
+
+std::size_t NameIndex::GetRowCount() const { return this->tables.Rows; }
+
+std::uint64_t NameIndex::GetRecordNumber(std::uint32_t row) const {
+    return this->tables.Records[row] & ~LIVE;
+}
+
+bool NameIndex::IsLive(std::uint32_t row) const {
+    return (this->tables.Records[row] & LIVE) != 0;
+}
+
+std::u16string NameIndex::GetName(std::uint32_t row) const {
+    const std::uint64_t *starts = this->tables.Starts;
+    return std::u16string(this->tables.Names + starts[row],
+                          starts[row + 1] - starts[row]);
+}
+
+std::size_t NameIndex::GetTrigramCount() const {
+    return this->tables.Trigrams;
+}
+
+std::size_t NameIndex::GetPostingBytes() const {
+    return this->tables.PostingBytes;
+}
+
+std::size_t NameIndex::GetMemoryUsage() const {
+    // Hash map nodes carry a next pointer and the cached hash
+    std::size_t node = sizeof(std::pair<const std::uint64_t, Building>) +
+                       2 * sizeof(void *);
+    std::size_t lists = this->building.size();
+    return this->records.capacity() * sizeof(std::uint64_t) +
+           this->starts.capacity() * sizeof(std::uint64_t) +
+           this->names.capacity() * sizeof(char16_t) + lists * node +
+           this->building.bucket_count() * sizeof(void *) +
+           this->buildingBytes +
+           lists * sizeof(PostingEntry) + // `directory`
+           this->buildingBytes;           // `postings`, at most
+}
+
+char16_t NameIndex::Fold(char16_t c) { return upcase()[c]; }
+
+NameQuery NameIndex::ParseQuery(const std::string &pattern, bool matchCase) {
+    std::string text = pattern;
+    NameQuery query;
+    query.AnchorStart = text.empty() || text[0] != '*';
+    if (!query.AnchorStart) {
+        text.erase(0, 1);
+    }
+    query.AnchorEnd = text.empty() || text[text.size() - 1] != '*';
+    if (!query.AnchorEnd) {
+        text.erase(text.size() - 1);
+    }
+    if (text.find('*') != std::string::npos) {
+        throw std::invalid_argument("Invalid name pattern " + pattern);
+    }
+    query.Text = UTF8ToUTF16(text);
+    query.MatchCase = matchCase;
+    return query;
+}
@@ -0,0 +1,148 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_NAMEINDEX_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_NAMEINDEX_HPP_
+
+// Standard library
+#include <cstddef>       // std::size_t
+#include <cstdint>       // for standard types
+#include <string>        // std::string, std::u16string
+#include <unordered_map> // std::unordered_map
+#include <vector>        // std::vector
+
+// Self-defined
+#include "MFT.hpp"
+
+// Name search: `Text` anywhere in a name, or anchored at its start and/or
+// end, compared case-folded unless `MatchCase`
+struct NameQuery {
+    std::u16string Text;
+    bool AnchorStart; // the name starts with `Text`
+    bool AnchorEnd;   // the name ends with `Text`
+    bool MatchCase;   // compare exactly, rather than case-folded
+};
+
+// Posting list of one trigram, in the built index
+struct PostingEntry {
+    std::uint64_t Key;    // three folded UTF-16 units
+    std::uint64_t Offset; // into the posting bytes
+    std::uint32_t Count;  // rows in the list
+};
+
+// Volume an index file was built from. A file for another volume, or for
+// this one with a different $MFT size, isn't used
+struct NameIndexKey {
+    std::uint64_t VolumeOffset; // bytes into the device
+    std::uint64_t Serial;       // volume serial number
+    std::uint64_t RecordCount;  // $MFT records
+};
+
+// Type aliases
+namespace dkt {
+typedef std::vector<std::uint32_t> RowVector; // name table rows, ascending
+typedef std::vector<PostingEntry> PostingVector;
+} // namespace dkt
+
+// Class definitions
+
+// Trigram index over the $FILE_NAME names of a volume. Names sit in a
+// record table (record number, in-use flag, UTF-16 name); next to it, each
+// trigram of the case-folded names has a posting list of table rows, stored
+// as varint-coded gaps in one byte pool. Names are padded with null units,
+// which no NTFS name contains, one before and two after, so prefix and
+// suffix queries get trigrams of their own and every unit starts one. A
+// query intersects the lists of its trigrams, shortest first, and checks
+// only the rows that survive against the names; queries of one or two units
+// take the union of the lists they prefix. A built index can be saved and
+// later mapped back in, so repeated searches of a volume skip the $MFT scan.
+class NameIndex {
+  protected:
+    // Record table
+    std::vector<std::uint64_t> records; // record number of each row, with
+                                        // the top bit set if it's in use
+    std::vector<std::uint64_t> starts;  // row's name in `names`, and past it
+    std::u16string names;               // names back to back
+
+    // Postings
+    struct Building {
+        dkt::UString Bytes;
+        std::uint32_t Last; // last row added
+        std::uint32_t Count;
+    };
+    std::unordered_map<std::uint64_t, Building> building; // until `Build`
+    std::size_t buildingBytes; // capacity of the lists being built
+    dkt::PostingVector directory; // by key
+    dkt::UString postings;        // every list, back to back
+
+    // Tables searched: the ones above once built, or a mapped index file
+    struct Tables {
+        const std::uint64_t *Records;
+        const std::uint64_t *Starts;
+        const char16_t *Names;
+        const PostingEntry *Directory;
+        const unsigned char *Postings;
+        std::size_t Rows;
+        std::size_t NameUnits;
+        std::size_t Trigrams;
+        std::size_t PostingBytes;
+    };
+    Tables tables;
+    void *mapped; // index file, if loaded
+    std::size_t mappedSize;
+
+    const PostingEntry *FindPosting(std::uint64_t) const;
+    void Decode(const PostingEntry &, dkt::RowVector &) const; // appends
+    void Intersect(const PostingEntry &, dkt::RowVector &) const;
+    void Union(std::uint64_t, std::uint64_t,
+               dkt::RowVector &) const; // lists with keys in [first, end)
+    bool Matches(std::uint32_t, const NameQuery &,
+                 const std::u16string &) const; // row, query, folded text
+
+  public:
+    // Constructors
+    NameIndex();
+    ~NameIndex();
+    NameIndex(const NameIndex &) = delete;
+    NameIndex &operator=(const NameIndex &) = delete;
+
+    // Methods
+    void Add(const FileRecord &); // base records with a name
+    void Build(); // lay out the posting lists; call once every record is in
+
+    // Map in an index saved for the volume `key` names, in place of `Add`
+    // and `Build`. Returns false if the file is missing, isn't an index
+    // file, or was built from another volume. The file is trusted past its
+    // header: it's only ever written by `Save`
+    bool Load(const std::string &, const NameIndexKey &); // path, volume
+
+    // Write the built index through a temp file and a rename. Returns false
+    // with errno set on failure
+    bool Save(const std::string &, const NameIndexKey &) const;
+
+    dkt::RowVector Search(const NameQuery &) const;
+
+    std::size_t GetRowCount() const;
+    std::uint64_t GetRecordNumber(std::uint32_t) const;
+    bool IsLive(std::uint32_t) const;
+    std::u16string GetName(std::uint32_t) const;
+    std::size_t GetTrigramCount() const;
+    std::size_t GetPostingBytes() const;
+
+    // Estimated bytes held at the peak of `Build`: the record table, the
+    // lists being built with their map, and the directory and posting pool
+    // they are laid out into
+    std::size_t GetMemoryUsage() const;
+
+    // Upper-case a UTF-16 unit, for the scripts whose case maps within the
+    // BMP one unit to one (Latin, Greek, Cyrillic, Armenian, full width).
+    // A table lookup, like NTFS's own $UpCase
+    static char16_t Fold(char16_t);
+
+    // Query from a pattern: a leading or trailing * leaves that end open,
+    // so "*.pst" is a suffix, "*invoice*" a substring and "report" a whole
+    // name
+    // THROWS:
+    //  - std::invalid_argument("Invalid name pattern ${pattern}"): if there's
+    //  a * anywhere else
+    static NameQuery ParseQuery(const std::string &, bool); // UTF-8, case
+};
+
+#endif
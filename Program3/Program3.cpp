@@ -14,39 +14,697 @@
 #define _FILE_OFFSET_BITS 64 // for 64-bit off_t's
 
 // Standard headers
+#include <algorithm>
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
-#include <iostream>
+#include <getopt.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 // Self-defined headers
+#include "../Common/devio.h"
+#include "../Common/fleet.h"
+#include "../Common/hexdump.h"
+#include "../Common/metrics.h"
+#include "../Common/outbuf.h"
+#include "Checkpoint.hpp"
+#include "ClusterIndex.hpp"
 #include "Constants.hpp"
+#include "Hash.hpp"
+#include "MFT.hpp"
+#include "NameIndex.hpp"
+#include "RecordWriter.hpp"
+#include "Rescue.hpp"
+#include "Slack.hpp"
+#include "Spill.hpp"
 #include "utility.hpp"
 
-void displayMFTProperties(const NTFSVBR &vbr) {
+// Command line options
+struct Options {
+    bool List;             // list every file record
+    bool Hash;             // hash the contents of every file
+    std::string KnownPath; // known-hash list to filter out, if any
+    unsigned Jobs;         // hashing threads
+    std::string Format;    // listing format: jsonl, csv or body
+    std::uint64_t Dump;    // $MFT records to hex dump
+    bool Slack;            // hex dump file and FILE record slack
+    dkt::ClusterRangeVector Owners;    // clusters to look up one by one
+    dkt::ClusterRangeVector OwnerHits; // clusters to annotate in bulk
+    std::vector<std::string> Names;    // name patterns to search for
+    bool MatchCase;                    // compare names exactly
+    std::string NameIndexPath;         // name indexes kept here, if any
+    int Stats;             // instrumentation at exit: 0 off, 1 text, 2 JSON
+    std::string Source;    // image path tagged onto listing rows, if any
+    bool Header;           // write the listing header
+    bool Direct;           // read around the page cache (O_DIRECT)
+    std::string CheckpointPath;    // scan state file, if checkpointing
+    std::uint64_t CheckpointEvery; // $MFT records between checkpoints
+    bool Resume;                   // continue from the checkpoint
+    bool Rescue;                   // read around bad sectors
+    unsigned RescueRetries;        // extra tries per bad sector
+    std::string BadMapPath;        // bad-range map written here, if any
+    std::uint64_t MemoryBudget;    // bytes of rows held back, 0: no limit
+};
+
+// Listings, dumps and owner lookups take standard output, leaving progress
+// to standard error
+bool ownsStdout(const Options &opts) {
+    return opts.List || opts.Hash || opts.Dump || opts.Slack ||
+           !opts.Owners.empty() || !opts.OwnerHits.empty() ||
+           !opts.Names.empty();
+}
+
+// Cluster range from "N" or "N-M" (inclusive)
+bool parseClusterRange(const char *text, ClusterRange &range) {
+    char *end;
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    errno = 0;
+    range.First = std::strtoull(text, &end, 10);
+    range.End = range.First + 1;
+    if (*end == '-') {
+        const char *last = end + 1;
+        if (*last < '0' || *last > '9') {
+            return false;
+        }
+        range.End = std::strtoull(last, &end, 10) + 1;
+    }
+    return errno == 0 && *end == '\0' && range.End > range.First;
+}
+
+// Cluster ranges from a file (- for standard input), one per line. Blank
+// lines and lines starting with # are skipped
+bool loadClusterRanges(const char *path, dkt::ClusterRangeVector &ranges) {
+    std::FILE *in = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "r");
+    if (in == NULL) {
+        return false;
+    }
+    char line[128];
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof line, in) != NULL) {
+        line[std::strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        ClusterRange range;
+        ok = parseClusterRange(line, range);
+        ranges.push_back(range);
+    }
+    if (!ok) {
+        errno = EINVAL;
+    }
+    if (in != stdin) {
+        std::fclose(in);
+    }
+    return ok;
+}
+
+void displayMFTProperties(const NTFSVBR &vbr, OutBuf *out) {
     // Find start address of $MFT
-    std::printf("$MFT address: 0x%llX\n",
-                vbr.GetMFTLCN() * CLUSTER_SIZE * SECTOR_SIZE);
+    outBufPuts(out, "$MFT address: 0x");
+    outBufHex(out, vbr.GetMFTLCN() * CLUSTER_SIZE * SECTOR_SIZE, 0, true);
+    outBufPutc(out, '\n');
 
     // Find start address of $MFTMirr
-    std::printf("$MFTMirr address: 0x%llX\n",
-                vbr.GetMFTMirrLCN() * CLUSTER_SIZE * SECTOR_SIZE);
+    outBufPuts(out, "$MFTMirr address: 0x");
+    outBufHex(out, vbr.GetMFTMirrLCN() * CLUSTER_SIZE * SECTOR_SIZE, 0, true);
+    outBufPutc(out, '\n');
+}
+
+// Save a checkpoint, if checkpointing. Returns false after reporting a
+// failure
+bool saveCheckpoint(const Checkpoint *checkpoint, ScanState &state,
+                    OutBuf *report) {
+    if (checkpoint == NULL || checkpoint->Save(state)) {
+        return true;
+    }
+    outBufFlush(report);
+    std::perror(checkpoint->GetPath().c_str());
+    return false;
+}
+
+// Whether a record's own $DATA runs start at VCN 0 and reach its data size.
+// If not, the rest are in extension records
+bool runsCoverData(const FileRecord &record, std::uint64_t clusterSize) {
+    if (record.IsDataResident()) {
+        return true;
+    }
+    dkt::ExtentVector runs = record.GetExtents();
+    if (!runs.empty() && runs.front().VCN != 0) {
+        return false;
+    }
+    std::uint64_t clusters = 0;
+    for (std::size_t i = 0; i < runs.size() && runs[i].VCN == clusters; ++i) {
+        clusters += runs[i].Length;
+    }
+    return clusters * clusterSize >= record.GetDataSize();
+}
+
+// Note records past the part of the $MFT runlist that could be followed
+void reportUnmapped(const MFT &mft, OutBuf *report) {
+    if (mft.GetUnmappedRecords() == 0) {
+        return;
+    }
+    outBufPuts(report, "$MFT runlist ends early: last ");
+    outBufU64(report, mft.GetUnmappedRecords());
+    outBufPuts(report, " records cut off\n");
+}
+
+// List and/or hash every file on an NTFS volume. Rows go to `writer`, the
+// summary to `report`. Files found in the known set are left out. The walk
+// starts at `state.NextRecord` and, with a checkpoint, saves `state` after
+// every interval's worth of records has been written out. `rescue`, if not
+// null, reads the $MFT around bad sectors.
+int listFiles(int fd, std::uint64_t volumeOffset, const NTFSVBR &vbr,
+              const Options &opts, const KnownHashSet *known,
+              RecordWriter *writer, const Checkpoint *checkpoint,
+              ScanState &state, RescueReader *rescue, OutBuf *report) {
+    try {
+        MFT mft(fd, volumeOffset, vbr, rescue);
+        reportUnmapped(mft, report);
+        std::uint64_t records = mft.GetRecordCount();
+        std::uint64_t interval =
+            checkpoint != NULL ? checkpoint->GetInterval() : records;
+
+        if (!opts.Hash) {
+            // Nothing to wait for: stream rows straight out
+            auto visit = [&](const FileRecord &record) {
+                if (record.IsBaseRecord()) {
+                    METRICS_TIME_START(emitStart);
+                    writer->Write(ListingRow(record));
+                    METRICS_TIME_END(STAGE_EMIT, emitStart);
+                    ++state.Listed;
+                }
+            };
+            while (state.NextRecord < records) {
+                std::uint64_t last = records - state.NextRecord > interval
+                                         ? state.NextRecord + interval
+                                         : records;
+                mft.ForEachRecord(visit, state.NextRecord, last);
+                state.NextRecord = last;
+                if (!saveCheckpoint(checkpoint, state, report)) {
+                    return CHECKPOINT_ERROR;
+                }
+            }
+            outBufU64(report, state.Listed);
+            outBufPuts(report, " records listed\n");
+            return SUCCESS;
+        }
+
+        // Walk $MFT and hand every regular file's extents to the pool. Rows
+        // are held back until their hashes are in, so each interval is
+        // drained before its rows go out. Past the memory budget, the rows
+        // so far are settled and spilled to a temp file, to be merged back
+        // in record order at the end of the interval
+        std::uint64_t clusterSize = mft.GetClusterSize();
+        HashPool pool(fd, volumeOffset, clusterSize, opts.Jobs, known);
+        std::vector<ListingRow> rows;
+        std::uint64_t held = 0; // bytes held back for `rows`
+        RowSpill spill;
+
+        // Wait for the rows' hashes and fill them in. Both sequences are in
+        // record order, so merge them; known files are dropped
+        auto settle = [&]() {
+            std::vector<HashResult> results = pool.Drain();
+            state.Hashed += results.size();
+            if (rescue != NULL) {
+                // Records read around bad sectors came last
+                std::stable_sort(rows.begin(), rows.end(),
+                                 [](const ListingRow &a, const ListingRow &b) {
+                                     return a.RecordNumber < b.RecordNumber;
+                                 });
+            }
+            std::size_t r = 0, kept = 0;
+            for (std::size_t i = 0; i < rows.size(); ++i) {
+                if (r < results.size() &&
+                    results[r].RecordNumber == rows[i].RecordNumber) {
+                    const HashResult &result = results[r++];
+                    if (result.Known) {
+                        ++state.Known;
+                        continue;
+                    }
+                    if (result.Failed) {
+                        ++state.Failed;
+                    } else {
+                        rows[i].Hashed = true;
+                        rows[i].XXH64Digest = result.XXH64Digest;
+                        rows[i].SHA256Digest = result.SHA256Digest;
+                    }
+                }
+                if (kept != i) {
+                    rows[kept] = std::move(rows[i]);
+                }
+                ++kept;
+            }
+            rows.erase(rows.begin() + kept, rows.end());
+            held = 0;
+        };
+        auto visit = [&](const FileRecord &record) {
+            if (!record.IsBaseRecord()) {
+                return;
+            }
+            bool regular = record.IsInUse() && !record.IsDirectory();
+            bool hashable = regular && record.HasData();
+            HashJob job;
+            job.RecordNumber = record.GetRecordNumber();
+            std::uint16_t flags = record.GetDataFlags();
+            if (regular && record.HasAttributeList() &&
+                (!record.HasData() || !runsCoverData(record, clusterSize))) {
+                // The rest of the runlist is in extension records named by
+                // the attribute list
+                try {
+                    DataAttribute data = mft.ReadData(record);
+                    hashable = data.Found;
+                    job.DataSize = data.DataSize;
+                    job.Initialized = data.Initialized;
+                    job.Resident = data.Resident;
+                    job.ResidentData = data.ResidentData;
+                    job.Extents = data.Extents;
+                    flags = data.Flags;
+                } catch (std::exception &e) {
+                    ++state.Failed;
+                    hashable = false;
+                }
+            } else if (hashable) {
+                job.DataSize = record.GetDataSize();
+                job.Initialized = record.GetDataInitializedSize();
+                job.Resident = record.IsDataResident();
+                job.ResidentData = record.GetResidentData();
+                job.Extents = record.GetExtents();
+            }
+            if (hashable &&
+                (flags & (ATTR_FLAG_COMPRESSED | ATTR_FLAG_ENCRYPTED))) {
+                // On-disk bytes aren't the file content
+                ++state.Skipped;
+                hashable = false;
+            }
+            if (!hashable && !opts.List) {
+                return;
+            }
+            rows.push_back(ListingRow(record));
+            held += sizeof(ListingRow) + rows.back().Name.capacity();
+            if (hashable) {
+                pool.Submit(job);
+                held += sizeof(HashResult);
+            }
+            if (opts.MemoryBudget != 0 && held > opts.MemoryBudget) {
+                settle();
+                spill.Spill(rows);
+            }
+        };
+        auto emit = [&](const ListingRow &row) {
+            METRICS_TIME_START(emitStart);
+            writer->Write(row);
+            METRICS_TIME_END(STAGE_EMIT, emitStart);
+            ++state.Listed;
+        };
+        while (state.NextRecord < records) {
+            std::uint64_t last = records - state.NextRecord > interval
+                                     ? state.NextRecord + interval
+                                     : records;
+            mft.ForEachRecord(visit, state.NextRecord, last);
+            settle();
+            spill.Merge(rows, emit);
+            state.NextRecord = last;
+            if (!saveCheckpoint(checkpoint, state, report)) {
+                return CHECKPOINT_ERROR;
+            }
+        }
+        pool.Finish();
+
+        outBufU64(report, state.Hashed);
+        outBufPuts(report, " files hashed, ");
+        outBufU64(report, state.Known);
+        outBufPuts(report, " known files filtered, ");
+        outBufU64(report, state.Failed);
+        outBufPuts(report, " unreadable, ");
+        outBufU64(report, state.Skipped);
+        outBufPuts(report, " compressed/encrypted skipped, ");
+        outBufU64(report, state.Listed);
+        outBufPuts(report, " rows written\n");
+        if (spill.GetSpilledRuns() != 0) {
+            outBufU64(report, spill.GetSpilledRows());
+            outBufPuts(report, " rows spilled to disk in ");
+            outBufU64(report, spill.GetSpilledRuns());
+            outBufPuts(report, " runs to stay within the memory budget\n");
+        }
+    } catch (std::exception &e) {
+        outBufFlush(report);
+        std::fprintf(stderr, "$MFT: %s\n", e.what());
+        return MFT_ERROR;
+    }
+
+    return SUCCESS;
+}
+
+// Hex dump the first `count` raw records of $MFT, annotating FILE headers
+int dumpRecords(int fd, std::uint64_t volumeOffset, const NTFSVBR &vbr,
+                std::uint64_t count, RescueReader *rescue, OutBuf *out,
+                OutBuf *report) {
+    try {
+        MFT mft(fd, volumeOffset, vbr, rescue);
+        reportUnmapped(mft, report);
+        if (count > mft.GetRecordCount()) {
+            count = mft.GetRecordCount();
+        }
+
+        // One read for the whole region
+        std::uint64_t size = mft.GetRecordSize();
+        dkt::UString buf(count * size);
+        mft.ReadRecords(0, count, &buf[0]);
+        METRICS_TIME_START(emitStart);
+        for (std::uint64_t i = 0; i < count; ++i) {
+            outBufPuts(out, "Record ");
+            outBufU64(out, i);
+            outBufPuts(out, ":\n");
+            hexDump(out, &buf[i * size], size, mft.GetRecordAddress(i),
+                    &DUMP_LAYOUT_FILE_RECORD);
+        }
+        METRICS_TIME_END(STAGE_EMIT, emitStart);
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "$MFT: %s\n", e.what());
+        return MFT_ERROR;
+    }
+
+    return SUCCESS;
+}
+
+// Hex dump the file slack and FILE record slack of every record that holds
+// anything but zeros
+int extractSlack(int fd, std::uint64_t volumeOffset, const NTFSVBR &vbr,
+                 RescueReader *rescue, OutBuf *out, OutBuf *report) {
+    try {
+        MFT mft(fd, volumeOffset, vbr, rescue);
+        reportUnmapped(mft, report);
+        SlackScanner scanner(fd, mft, out);
+        METRICS_TIME_START(emitStart);
+        mft.ForEachRecord(
+            [&](const FileRecord &record) { scanner.Add(record); });
+        scanner.Flush();
+        METRICS_TIME_END(STAGE_EMIT, emitStart);
+
+        outBufU64(report, scanner.GetScannedBytes());
+        outBufPuts(report, " bytes of slack scanned, ");
+        outBufU64(report, scanner.GetRegionCount());
+        outBufPuts(report, " regions with data, ");
+        outBufU64(report, scanner.GetUnreadableBytes());
+        outBufPuts(report, " bytes unreadable\n");
+    } catch (std::exception &e) {
+        outBufFlush(report);
+        std::fprintf(stderr, "$MFT: %s\n", e.what());
+        return MFT_ERROR;
+    }
+
+    return SUCCESS;
+}
+
+// One owner lookup result: partition, queried clusters, owning record,
+// live or deleted, first owned LCN in the query and its VCN, the attribute
+// mapping it, and name.
+// Clusters no file maps get "-"
+void writeOwner(OutBuf *out, std::size_t partition, const ClusterRange &query,
+                const ClusterExtent *extent, const ClusterIndex &index) {
+    outBufU64(out, partition);
+    outBufPutc(out, '\t');
+    outBufU64(out, query.First);
+    if (query.End - query.First > 1) {
+        outBufPutc(out, '-');
+        outBufU64(out, query.End - 1);
+    }
+    if (extent == NULL) {
+        outBufPuts(out, "\t-\n");
+        return;
+    }
+    std::uint64_t lcn = query.First > extent->LCN ? query.First : extent->LCN;
+    const ClusterOwner &owner = index.GetOwner(*extent);
+    outBufPutc(out, '\t');
+    outBufU64(out, owner.RecordNumber);
+    outBufPuts(out, extent->Live ? "\tlive\t" : "\tdeleted\t");
+    outBufU64(out, lcn);
+    outBufPutc(out, '\t');
+    outBufU64(out, extent->VCN + (lcn - extent->LCN));
+    outBufPutc(out, '\t');
+    const std::string &attribute = index.GetAttribute(*extent);
+    outBufWrite(out, attribute.data(), attribute.size());
+    outBufPutc(out, '\t');
+    outBufWrite(out, owner.Name.data(), owner.Name.size());
+    outBufPutc(out, '\n');
+}
+
+// Stop building an index once it holds more than --memory-budget. Unlike
+// held-back listing rows, an index has to be whole before it answers a
+// query, so there's nothing to spill
+// THROWS:
+//  - std::length_error("${index} index needs over ${budget} bytes, ..."):
+//  if `held` is past the budget
+void checkBudget(std::size_t held, const char *index, const Options &opts) {
+    if (opts.MemoryBudget == 0 || held <= opts.MemoryBudget) {
+        return;
+    }
+    throw std::length_error(std::string(index) + " index needs over " +
+                            std::to_string(opts.MemoryBudget) +
+                            " bytes; raise --memory-budget, or pass 0 for "
+                            "no limit");
+}
+
+// Index the runlists of every record on an NTFS volume and report which
+// files own (or owned) the queried clusters
+int findOwners(int fd, std::uint64_t volumeOffset, const NTFSVBR &vbr,
+               std::size_t partition, const Options &opts,
+               RescueReader *rescue, OutBuf *out, OutBuf *report) {
+    try {
+        MFT mft(fd, volumeOffset, vbr, rescue);
+        reportUnmapped(mft, report);
+        ClusterIndex index;
+        METRICS_TIME_START(parseStart);
+        mft.ForEachRecord([&](const FileRecord &record) {
+            index.Add(record);
+            checkBudget(index.GetMemoryUsage(), "Cluster", opts);
+        });
+        index.Build();
+        METRICS_TIME_END(STAGE_PARSE, parseStart);
+        outBufU64(report, index.GetExtentCount());
+        outBufPuts(report, " extents of ");
+        outBufU64(report, index.GetOwnerCount());
+        outBufPuts(report, " files indexed\n");
+
+        METRICS_TIME_START(emitStart);
+        auto emit = [&](const ClusterRange &query,
+                        const ClusterExtent *extent) {
+            writeOwner(out, partition, query, extent, index);
+        };
+        for (std::size_t i = 0; i < opts.Owners.size(); ++i) {
+            dkt::ClusterExtentVector found = index.Find(opts.Owners[i]);
+            if (found.empty()) {
+                emit(opts.Owners[i], NULL);
+            }
+            for (std::size_t j = 0; j < found.size(); ++j) {
+                emit(opts.Owners[i], &found[j]);
+            }
+        }
+        if (!opts.OwnerHits.empty()) {
+            dkt::ClusterRangeVector hits = opts.OwnerHits;
+            index.Annotate(hits, emit);
+        }
+        METRICS_TIME_END(STAGE_EMIT, emitStart);
+    } catch (std::length_error &e) {
+        outBufFlush(report);
+        std::fprintf(stderr, "%s\n", e.what());
+        return MEMORY_ERROR;
+    } catch (std::exception &e) {
+        outBufFlush(report);
+        std::fprintf(stderr, "$MFT: %s\n", e.what());
+        return MFT_ERROR;
+    }
+
+    return SUCCESS;
+}
+
+// Index the names on an NTFS volume and write the records matching each
+// pattern: partition, pattern, record, live or deleted, and name. With
+// --name-index, the index is mapped from its file if one was saved for this
+// volume, and saved there otherwise
+int findNames(int fd, std::uint64_t volumeOffset, const NTFSVBR &vbr,
+              std::size_t partition, const Options &opts,
+              RescueReader *rescue, OutBuf *out, OutBuf *report) {
+    try {
+        MFT mft(fd, volumeOffset, vbr, rescue);
+        reportUnmapped(mft, report);
+        NameIndex index;
+        NameIndexKey key = {volumeOffset, vbr.GetSerialNumber(),
+                            mft.GetRecordCount()};
+        std::string path;
+        if (!opts.NameIndexPath.empty()) {
+            path = opts.NameIndexPath + "." + std::to_string(partition);
+        }
+        METRICS_TIME_START(parseStart);
+        bool loaded = !path.empty() && index.Load(path, key);
+        if (!loaded) {
+            mft.ForEachRecord([&](const FileRecord &record) {
+                index.Add(record);
+                checkBudget(index.GetMemoryUsage(), "Name", opts);
+            });
+            index.Build();
+        }
+        METRICS_TIME_END(STAGE_PARSE, parseStart);
+        outBufU64(report, index.GetRowCount());
+        outBufPuts(report, loaded ? " names loaded, " : " names indexed, ");
+        outBufU64(report, index.GetTrigramCount());
+        outBufPuts(report, " trigrams in ");
+        outBufU64(report, index.GetPostingBytes());
+        outBufPuts(report, " bytes of postings\n");
+        if (!loaded && !path.empty()) {
+            if (!index.Save(path, key)) {
+                outBufFlush(report);
+                std::perror(path.c_str());
+                return WRITE_ERROR;
+            }
+            outBufPuts(report, "Name index saved to ");
+            outBufPuts(report, path.c_str());
+            outBufPutc(report, '\n');
+        }
+
+        for (std::size_t i = 0; i < opts.Names.size(); ++i) {
+            dkt::RowVector rows = index.Search(
+                NameIndex::ParseQuery(opts.Names[i], opts.MatchCase));
+            METRICS_TIME_START(emitStart);
+            for (std::size_t j = 0; j < rows.size(); ++j) {
+                outBufU64(out, partition);
+                outBufPutc(out, '\t');
+                outBufPuts(out, opts.Names[i].c_str());
+                outBufPutc(out, '\t');
+                outBufU64(out, index.GetRecordNumber(rows[j]));
+                outBufPuts(out, index.IsLive(rows[j]) ? "\tlive\t"
+                                                      : "\tdeleted\t");
+                std::string name = UTF16ToUTF8(index.GetName(rows[j]));
+                outBufWrite(out, name.data(), name.size());
+                outBufPutc(out, '\n');
+            }
+            METRICS_TIME_END(STAGE_EMIT, emitStart);
+        }
+    } catch (std::length_error &e) {
+        outBufFlush(report);
+        std::fprintf(stderr, "%s\n", e.what());
+        return MEMORY_ERROR;
+    } catch (std::exception &e) {
+        outBufFlush(report);
+        std::fprintf(stderr, "$MFT: %s\n", e.what());
+        return MFT_ERROR;
+    }
+
+    return SUCCESS;
+}
+
+// Summarise a rescue and write its bad-range map, if asked for
+int reportRescue(const RescueReader &rescue, const Options &opts,
+                 OutBuf *report) {
+    outBufPuts(report, "Rescue: ");
+    outBufU64(report, rescue.GetBadBytes());
+    outBufPuts(report, " bytes unreadable in ");
+    outBufU64(report, rescue.GetBadRanges().size());
+    outBufPuts(report, " ranges, ");
+    outBufU64(report, rescue.GetRecoveredBytes());
+    outBufPuts(report, " bytes recovered by retries\n\n");
+    if (opts.BadMapPath.empty()) {
+        return SUCCESS;
+    }
+
+    int fd = open(opts.BadMapPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        outBufFlush(report);
+        std::perror(opts.BadMapPath.c_str());
+        return WRITE_ERROR;
+    }
+    OutBuf map;
+    outBufInit(&map, fd, OUTBUF_DEFAULT_CAPACITY);
+    rescue.WriteMap(&map);
+    bool ok = outBufFlush(&map);
+    outBufFree(&map);
+    if (close(fd) != 0 || !ok) {
+        outBufFlush(report);
+        std::perror(opts.BadMapPath.c_str());
+        return WRITE_ERROR;
+    }
+    return SUCCESS;
+}
+
+// Replace `entries` with the used entries of the disk's GPT
+int readGPTEntries(int fd, dkt::EntryVector &entries, OutBuf *report) {
+    GPT gpt;
+    METRICS_TIME_START(gptStart);
+    int gptStatus = gptRead(fd, &gpt);
+    if (gptStatus == GPT_READ_ERROR) {
+        perror("read");
+        return READ_ERROR;
+    }
+    if (gptStatus != GPT_OK) {
+        // Both copies are damaged. Terminate the program gracefully
+        outBufPuts(report, "This disk is in GPT format, but both GPT headers "
+                           "are corrupt.\n");
+        return GPT_FORMATTED;
+    }
+    entries = ParseGPTEntries(gpt);
+    METRICS_TIME_END(STAGE_PARSE, gptStart);
+    outBufPuts(report,
+               gpt.UsedBackup
+                   ? "GPT disk (primary copy corrupt, using backup)\n"
+                   : "GPT disk\n");
+    gptFree(&gpt);
+    return SUCCESS;
 }
 
-// work function.
-int work(int fd) {
+// Append the logical partitions of every extended partition in `entries`
+int readLogicalEntries(int fd, dkt::EntryVector &entries, OutBuf *report) {
+    dkt::EntryVector logical;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (!ebrIsExtendedType(entries[i].GetPartitionType())) {
+            continue;
+        }
+        EBRChain chain;
+        METRICS_TIME_START(ebrStart);
+        if (ebrWalk(fd, entries[i].GetStartingSector(), &chain) != EBR_OK) {
+            perror("read");
+            return READ_ERROR;
+        }
+        dkt::EntryVector found = ParseEBREntries(chain);
+        METRICS_TIME_END(STAGE_PARSE, ebrStart);
+        logical.insert(logical.end(), found.begin(), found.end());
+        if (chain.End != EBR_END_CHAIN) {
+            outBufPuts(report, "Extended partition chain cut short: ");
+            outBufPuts(report, ebrEndMessage(chain.End));
+            outBufPutc(report, '\n');
+        }
+        ebrFree(&chain);
+    }
+    entries.insert(entries.end(), logical.begin(), logical.end());
+    return SUCCESS;
+}
+
+// work function. Human-readable progress goes to `report`, listings to `out`.
+// Listing starts from `state` and is checkpointed to `checkpoint`, if any;
+// hashed files found in `known`, if any, are left out
+int work(int fd, const Options &opts, const KnownHashSet *known, OutBuf *out,
+         OutBuf *report, const Checkpoint *checkpoint, ScanState &state) {
     // Read MBR
     unsigned char mbrArr[SECTOR_SIZE + 1];
-    if (read(fd, mbrArr, SECTOR_SIZE + 1) < 0) {
+    if (devRead(fd, mbrArr, SECTOR_SIZE + 1) < 0) {
         perror("read");
         return READ_ERROR;
     }
 
     // Create MBR object
+    METRICS_TIME_START(parseStart);
     dkt::UString mbrStr(SECTOR_SIZE);
     for (size_t i = 0; i < SECTOR_SIZE; ++i) {
         mbrStr[i] = mbrArr[i];
@@ -55,86 +713,610 @@ int work(int fd) {
 
     // Parse partition entries, and see which ones are NTFS
     dkt::EntryVector entries = mbr.ParseEntries();
-    // ...but first, check if the disk is in GPT
+    METRICS_TIME_END(STAGE_PARSE, parseStart);
+    // ...but first, check if the disk is in GPT, and take the GPT's entries
+    // instead of the protective MBR's if so
     if (entries.size() && entries[0].GetPartitionType() == 0xEE) {
-        // We do not deal with GPT disks. Terminate the program gracefully
-        std::cout << "This disk is in GPT format, which is unsupported."
-                  << '\n';
-        return GPT_FORMATTED;
+        int gptStatus = readGPTEntries(fd, entries, report);
+        if (gptStatus != SUCCESS) {
+            return gptStatus;
+        }
+    } else {
+        // Logical partitions inside extended partitions follow the primaries
+        int ebrStatus = readLogicalEntries(fd, entries, report);
+        if (ebrStatus != SUCCESS) {
+            return ebrStatus;
+        }
     }
     dkt::NTFSEntryVector NTFSEntries;
     NTFSEntries.reserve(4);
     for (size_t i = 0; i < entries.size(); ++i) {
-        std::cout << "Partition " << i + 1 << ": ";
+        outBufPuts(report, "Partition ");
+        outBufU64(report, i + 1);
         try {
             // Attempt to create an `NTFSPartitionEntry` object
             NTFSPartitionEntry e(entries[i].GetEntry());
             NTFSEntries.push_back(e); // and push it into the NTFS array
-            std::cout << "NTFS entry\n";
+            outBufPuts(report, ": NTFS entry\n");
         } catch (std::invalid_argument &e) {
-            std::cout << "Non-NTFS entry\n";
+            outBufPuts(report, ": Non-NTFS entry\n");
         }
     }
-    std::cout << "\n"
-              << NTFSEntries.size() << " NTFS partitions on opened device\n\n";
+    outBufPutc(report, '\n');
+    outBufU64(report, NTFSEntries.size());
+    outBufPuts(report, " NTFS partitions on opened device\n\n");
+
+    // Listing writer, shared by all partitions
+    RecordWriter *writer = NULL;
+    if (opts.List || opts.Hash) {
+        writer = RecordWriter::New(opts.Format, out);
+        writer->SetSource(opts.Source);
+        if (opts.Header) {
+            writer->Begin();
+        }
+    }
+
+    // When rescuing, a partition that can't be read doesn't stop the rest
+    RescueReader *rescue =
+        opts.Rescue ? new RescueReader(fd, opts.RescueRetries) : NULL;
+    int rescueStatus = SUCCESS;
 
     // Read VBR for each NTFS partition
+    int status = SUCCESS;
     dkt::VBRVector VBRs;
     VBRs.reserve(NTFSEntries.size());
-    for (size_t i = 0; i < NTFSEntries.size(); ++i) {
+    for (size_t i = 0; i < NTFSEntries.size() && status == SUCCESS; ++i) {
         // Read VBR
         std::uint64_t vbrAddr =
             NTFSEntries[i].GetStartingSector() * SECTOR_SIZE;
-        if (lseek(fd, vbrAddr, SEEK_SET) < 0) {
-            perror("lseek");
-            return LSEEK_ERROR;
-        }
         unsigned char vbr[SECTOR_SIZE + 1];
-        if (read(fd, vbr, SECTOR_SIZE + 1) < 0) {
-            perror("read");
-            return READ_ERROR;
+        if (rescue != NULL) {
+            if (rescue->Read(vbr, SECTOR_SIZE, vbrAddr, NULL, true) != 0) {
+                outBufPuts(report, "Partition ");
+                outBufU64(report, i + 1);
+                outBufPuts(report, ": unreadable VBR\n");
+                continue;
+            }
+        } else {
+            if (devSeek(fd, vbrAddr, SEEK_SET) < 0) {
+                perror("lseek");
+                status = LSEEK_ERROR;
+                break;
+            }
+            if (devRead(fd, vbr, SECTOR_SIZE + 1) < 0) {
+                perror("read");
+                status = READ_ERROR;
+                break;
+            }
         }
         dkt::UString vbrStr(SECTOR_SIZE);
         for (size_t j = 0; j < SECTOR_SIZE; ++j) {
             vbrStr[j] = vbr[j];
         }
-        std::cout << "Partition " << i + 1 << ": ";
+        outBufPuts(report, "Partition ");
+        outBufU64(report, i + 1);
         try {
             // Attempt to create VBR from NTFS partition
+            METRICS_TIME_START(vbrParseStart);
             VBRs.push_back(NTFSVBR(vbrStr));
-            std::cout << "valid VBR\n";
-            displayMFTProperties(VBRs[i]);
-            std::cout << '\n';
+            METRICS_TIME_END(STAGE_PARSE, vbrParseStart);
+            outBufPuts(report, ": valid VBR\n");
+            displayMFTProperties(VBRs.back(), report);
+            outBufPutc(report, '\n');
         } catch (std::invalid_argument &e) {
-            std::cout << "invalid VBR\n";
+            outBufPuts(report, ": invalid VBR\n");
+            continue;
+        }
+
+        if (opts.Dump > 0) {
+            status = dumpRecords(fd, vbrAddr, VBRs.back(), opts.Dump, rescue,
+                                 out, report);
+        }
+        if (opts.Slack && status == SUCCESS) {
+            status = extractSlack(fd, vbrAddr, VBRs.back(), rescue, out,
+                                  report);
+            outBufPutc(report, '\n');
+        }
+        if ((!opts.Owners.empty() || !opts.OwnerHits.empty()) &&
+            status == SUCCESS) {
+            status = findOwners(fd, vbrAddr, VBRs.back(), i + 1, opts, rescue,
+                                out, report);
+            outBufPutc(report, '\n');
+        }
+        if (!opts.Names.empty() && status == SUCCESS) {
+            status = findNames(fd, vbrAddr, VBRs.back(), i + 1, opts, rescue,
+                               out, report);
+            outBufPutc(report, '\n');
+        }
+        if (writer != NULL && status == SUCCESS) {
+            std::uint64_t serial = VBRs.back().GetSerialNumber();
+            if (i < state.Partition) {
+                outBufPuts(report, "Already listed before the checkpoint\n\n");
+                continue;
+            }
+            if (i > state.Partition || state.NextRecord == 0) {
+                state.StartPartition(i, serial);
+            } else if (serial != state.Serial) {
+                outBufFlush(report);
+                std::fprintf(stderr, "Checkpoint is for another volume\n");
+                status = CHECKPOINT_ERROR;
+                break;
+            }
+            status = listFiles(fd, vbrAddr, VBRs.back(), opts, known, writer,
+                               checkpoint, state, rescue, report);
+            outBufPutc(report, '\n');
+            if (status == SUCCESS) {
+                state.StartPartition(i + 1, 0);
+                if (!saveCheckpoint(checkpoint, state, report)) {
+                    status = CHECKPOINT_ERROR;
+                }
+            }
+        }
+        if (rescue != NULL && status == MFT_ERROR) {
+            rescueStatus = status;
+            status = SUCCESS;
+        }
+    }
+    if (rescue != NULL) {
+        if (status == SUCCESS) {
+            status = reportRescue(*rescue, opts, report);
+        }
+        if (status == SUCCESS) {
+            status = rescueStatus;
+        }
+        delete rescue;
+    }
+
+    if (writer != NULL) {
+        writer->End();
+        delete writer;
+    }
+    return status;
+}
+
+// Report an opened device, noting when --direct couldn't be honoured
+void reportOpened(const char *device, int fd, const Options &opts,
+                  OutBuf *report) {
+    outBufPuts(report, device);
+    outBufPuts(report, " opened successfully");
+    if (opts.Direct && !devIsDirect(fd)) {
+        outBufPuts(report, " (no direct I/O here, reading through the page "
+                           "cache)");
+    }
+    outBufPuts(report, "\n\n");
+}
+
+// Pick up a checkpointed scan of `state.Device`, taken with the listing
+// options in `state`. The listing in `out` is cut back to what the checkpoint
+// counted, so rows of the interval that was in progress aren't written twice.
+// No checkpoint means a fresh start
+int resumeScan(const Checkpoint &checkpoint, ScanState &state, OutBuf *out,
+               OutBuf *report) {
+    outBufFlush(report); // ahead of any error below
+    ScanState saved;
+    try {
+        if (!checkpoint.Load(saved)) {
+            outBufPuts(report, "No checkpoint, starting from scratch\n\n");
+            return SUCCESS;
+        }
+    } catch (std::runtime_error &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return CHECKPOINT_ERROR;
+    }
+    if (saved.Device != state.Device) {
+        std::fprintf(stderr, "%s is a checkpoint for %s\n",
+                     checkpoint.GetPath().c_str(), saved.Device.c_str());
+        return CHECKPOINT_ERROR;
+    }
+    if (!saved.SameListing(state)) {
+        std::fprintf(stderr, "%s was taken with other --list, --hash, "
+                             "--format or --known options\n",
+                     checkpoint.GetPath().c_str());
+        return CHECKPOINT_ERROR;
+    }
+
+    // A listing redirected to a file must still hold everything counted
+    struct stat st;
+    if (saved.OutputBytes >= 0 && fstat(out->FD, &st) == 0 &&
+        S_ISREG(st.st_mode)) {
+        if (st.st_size < saved.OutputBytes) {
+            std::fprintf(stderr, "Listing is shorter than at the checkpoint; "
+                                 "append to it with >> to resume\n");
+            return CHECKPOINT_ERROR;
+        }
+        if (ftruncate(out->FD, saved.OutputBytes) != 0 ||
+            lseek(out->FD, 0, SEEK_END) < 0) {
+            std::perror("ftruncate");
+            return WRITE_ERROR;
         }
     }
 
-    return 0;
+    state = saved;
+    outBufPuts(report, "Resuming NTFS partition ");
+    outBufU64(report, state.Partition + 1);
+    outBufPuts(report, " at record ");
+    outBufU64(report, state.NextRecord);
+    outBufPuts(report, "\n\n");
+    return SUCCESS;
+}
+
+// What every fleet image shares: the options and the known-file set, both
+// read-only once the fleet starts
+struct FleetContext {
+    const Options *Opts;
+    const KnownHashSet *Known; // NULL without --known
+};
+
+// Fleet callback: open one image and work it. `outs` holds this image's
+// share of standard output and standard error
+int workImage(const char *device, OutBuf *outs, void *context) {
+    const FleetContext *fleet = static_cast<const FleetContext *>(context);
+    Options opts = *fleet->Opts;
+    opts.Source = device;
+    OutBuf *report =
+        ownsStdout(opts) ? &outs[1] : &outs[0];
+    int fd = devOpen(device, opts.Direct);
+    if (fd < 0) {
+        outBufPuts(report, device);
+        outBufPuts(report, ": open: ");
+        outBufPuts(report, std::strerror(errno));
+        outBufPuts(report, "\n\n");
+        return OPEN_ERROR;
+    }
+    reportOpened(device, fd, opts, report);
+    ScanState state;
+    int workResult =
+        work(fd, opts, fleet->Known, &outs[0], report, NULL, state);
+    devClose(fd);
+    return workResult;
 }
 
 // main function
 int main(int argc, char **argv) {
-    // Require 2 arguments
-    if (argc != 2) {
-        std::fprintf(stderr, "Expected 2 arguments, got %d\n", argc);
+    // Parse options
+    Options opts;
+    opts.List = false;
+    opts.Hash = false;
+    opts.Format = "jsonl";
+    opts.Dump = 0;
+    opts.Slack = false;
+    opts.MatchCase = false;
+    opts.Stats = 0;
+    opts.Header = true;
+    opts.Direct = false;
+    opts.CheckpointEvery = CHECKPOINT_INTERVAL;
+    opts.Resume = false;
+    opts.Rescue = false;
+    opts.RescueRetries = RESCUE_RETRIES;
+    opts.MemoryBudget = MEMORY_BUDGET;
+    opts.Jobs = std::thread::hardware_concurrency();
+    if (opts.Jobs == 0) {
+        opts.Jobs = 4;
+    }
+    FleetOptions fleetOpts;
+    fleetOpts.Workers = opts.Jobs;
+    fleetOpts.PerDevice = FLEET_DEFAULT_PER_DEVICE;
+    FleetPaths devices = {NULL, 0, 0};
+    bool imageList = false;
+    DevThrottle throttle = {0, 0, DEV_PRIORITY_NORMAL};
+    const char *controlPath = NULL;
+    const struct option longOptions[] = {
+        {"list", no_argument, NULL, 'l'},
+        {"format", required_argument, NULL, 'f'},
+        {"hash", no_argument, NULL, 'H'},
+        {"known", required_argument, NULL, 'k'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"dump-mft", required_argument, NULL, 'd'},
+        {"stats", optional_argument, NULL, 's'},
+        {"workers", required_argument, NULL, 'w'},
+        {"per-device", required_argument, NULL, 'p'},
+        {"images", required_argument, NULL, 'i'},
+        {"direct", no_argument, NULL, 'D'},
+        {"checkpoint", required_argument, NULL, 'c'},
+        {"checkpoint-every", required_argument, NULL, 'e'},
+        {"resume", no_argument, NULL, 'r'},
+        {"rate", required_argument, NULL, 'R'},
+        {"iops", required_argument, NULL, 'O'},
+        {"idle", no_argument, NULL, 'I'},
+        {"control", required_argument, NULL, 'C'},
+        {"rescue", optional_argument, NULL, 'S'},
+        {"bad-map", required_argument, NULL, 'B'},
+        {"memory-budget", required_argument, NULL, 'M'},
+        {"slack", no_argument, NULL, 'Z'},
+        {"owner", required_argument, NULL, 'o'},
+        {"owners", required_argument, NULL, 'W'},
+        {"find-name", required_argument, NULL, 'n'},
+        {"match-case", no_argument, NULL, 'a'},
+        {"name-index", required_argument, NULL, 'X'},
+        {NULL, 0, NULL, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "lf:Hk:j:d:", longOptions, NULL)) !=
+           -1) {
+        switch (c) {
+        case 'l':
+            opts.List = true;
+            break;
+        case 'f':
+            opts.List = true;
+            opts.Format = optarg;
+            if (opts.Format != "jsonl" && opts.Format != "csv" &&
+                opts.Format != "body") {
+                std::fprintf(stderr, "Unknown format %s\n", optarg);
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            break;
+        case 'H':
+            opts.Hash = true;
+            break;
+        case 'k':
+            opts.Hash = true;
+            opts.KnownPath = optarg;
+            break;
+        case 'j':
+            opts.Jobs = std::strtoul(optarg, NULL, 10);
+            if (opts.Jobs == 0) {
+                opts.Jobs = 1;
+            }
+            break;
+        case 'd':
+            opts.Dump = std::strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            opts.Stats =
+                optarg != NULL && std::strcmp(optarg, "json") == 0 ? 2 : 1;
+            break;
+        case 'w':
+            fleetOpts.Workers = std::strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            fleetOpts.PerDevice = std::strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            opts.Direct = true;
+            break;
+        case 'c':
+            opts.CheckpointPath = optarg;
+            break;
+        case 'e':
+            opts.CheckpointEvery = std::strtoull(optarg, NULL, 10);
+            if (opts.CheckpointEvery == 0) {
+                opts.CheckpointEvery = 1;
+            }
+            break;
+        case 'r':
+            opts.Resume = true;
+            break;
+        case 'i':
+            imageList = true;
+            if (!fleetAddList(&devices, optarg)) {
+                std::perror(optarg);
+                std::exit(OPEN_ERROR);
+            }
+            break;
+        case 'R':
+        case 'O':
+            if (!devParseThrottle(&throttle, c == 'R' ? "rate" : "iops",
+                                  optarg)) {
+                std::fprintf(stderr, "Invalid limit %s\n", optarg);
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            break;
+        case 'I':
+            throttle.Priority = DEV_PRIORITY_IDLE;
+            break;
+        case 'C':
+            controlPath = optarg;
+            break;
+        case 'S':
+            opts.Rescue = true;
+            if (optarg != NULL) {
+                opts.RescueRetries = std::strtoul(optarg, NULL, 10);
+            }
+            break;
+        case 'B':
+            opts.Rescue = true;
+            opts.BadMapPath = optarg;
+            break;
+        case 'Z':
+            opts.Slack = true;
+            break;
+        case 'o': {
+            ClusterRange range;
+            if (!parseClusterRange(optarg, range)) {
+                std::fprintf(stderr, "Invalid cluster range %s\n", optarg);
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            opts.Owners.push_back(range);
+            break;
+        }
+        case 'W':
+            if (!loadClusterRanges(optarg, opts.OwnerHits)) {
+                std::perror(optarg);
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            break;
+        case 'n':
+            try {
+                NameIndex::ParseQuery(optarg, false);
+            } catch (std::invalid_argument &e) {
+                std::fprintf(stderr, "%s\n", e.what());
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            opts.Names.push_back(optarg);
+            break;
+        case 'a':
+            opts.MatchCase = true;
+            break;
+        case 'X':
+            opts.NameIndexPath = optarg;
+            break;
+        case 'M':
+            if (!devParseSize(optarg, &opts.MemoryBudget)) {
+                std::fprintf(stderr, "Invalid budget %s\n", optarg);
+                std::exit(ARGUMENT_EXPECTED);
+            }
+            break;
+        default:
+            std::exit(ARGUMENT_EXPECTED);
+        }
+    }
+    if (fleetOpts.PerDevice == 0) {
+        fleetOpts.PerDevice = 1;
+    }
+    devSetThrottle(&throttle);
+    if (controlPath != NULL && !devWatchThrottle(controlPath)) {
+        std::fprintf(stderr, "Malformed control file %s\n", controlPath);
         std::exit(ARGUMENT_EXPECTED);
     }
 
-    // Open device
-    int fd = open(argv[1], O_RDONLY);
-    if (fd < 0) {
-        std::perror("open");
-        std::exit(OPEN_ERROR);
+    // Require at least one device. Several devices, globs or an image list
+    // run in fleet mode
+    for (int i = optind; i < argc; ++i) {
+        fleetAddPattern(&devices, argv[i]);
+    }
+    if (devices.Count == 0) {
+        std::fprintf(stderr,
+                     "Usage: %s [--list] [--format jsonl|csv|body] [--hash] "
+                     "[--known FILE] [--jobs N] [--dump-mft COUNT] "
+                     "[--stats[=json]] [--workers N] [--per-device N] "
+                     "[--images FILE] [--direct] [--checkpoint FILE "
+                     "[--checkpoint-every N] [--resume]] [--rate BYTES] "
+                     "[--iops N] [--idle] [--control FILE] "
+                     "[--rescue[=RETRIES]] [--bad-map FILE] "
+                     "[--memory-budget BYTES] [--slack] "
+                     "[--owner LCN[-LCN]] [--owners FILE] "
+                     "[--find-name PATTERN [--match-case] "
+                     "[--name-index FILE]] DEVICE...\n",
+                     argv[0]);
+        std::exit(ARGUMENT_EXPECTED);
     }
-    std::cout << argv[1] << " opened successfully\n\n";
 
-    // Do work
-    int workResult = work(fd);
+    // Checkpoints follow one device's listing
+    if (opts.Resume && opts.CheckpointPath.empty()) {
+        std::fprintf(stderr, "--resume needs --checkpoint FILE\n");
+        std::exit(ARGUMENT_EXPECTED);
+    }
+    if (!opts.CheckpointPath.empty() &&
+        (devices.Count != 1 || imageList || !(opts.List || opts.Hash) ||
+         opts.Dump > 0 || opts.Slack || !opts.Owners.empty() ||
+         !opts.OwnerHits.empty() || !opts.Names.empty())) {
+        std::fprintf(stderr, "--checkpoint needs --list or --hash on a single "
+                             "device, without --dump-mft, --slack, "
+                             "--owner(s) or --find-name\n");
+        std::exit(ARGUMENT_EXPECTED);
+    }
 
-    // Close device
-    close(fd);
+    if (!opts.BadMapPath.empty() && (devices.Count != 1 || imageList)) {
+        std::fprintf(stderr, "--bad-map needs a single device\n");
+        std::exit(ARGUMENT_EXPECTED);
+    }
+
+    // A name index file belongs to one device's volumes
+    if (!opts.NameIndexPath.empty() &&
+        (devices.Count != 1 || imageList || opts.Names.empty())) {
+        std::fprintf(stderr, "--name-index needs --find-name on a single "
+                             "device\n");
+        std::exit(ARGUMENT_EXPECTED);
+    }
+
+    // Listings and dumps own stdout, so progress moves to stderr
+    OutBuf streams[2];
+    OutBuf &out = streams[0], &err = streams[1];
+    outBufInit(&out, STDOUT_FILENO, OUTBUF_DEFAULT_CAPACITY);
+    outBufInit(&err, STDERR_FILENO, OUTBUF_DEFAULT_CAPACITY);
+    OutBuf *report = ownsStdout(opts) ? &err : &out;
+
+    // Load the known-file set once, up front; fleet images share it
+    KnownHashSet *known = NULL;
+    if (!opts.KnownPath.empty()) {
+        try {
+            known = new KnownHashSet(KnownHashSet::FromFile(opts.KnownPath));
+        } catch (std::runtime_error &e) {
+            std::fprintf(stderr, "%s\n", e.what());
+            std::exit(OPEN_ERROR);
+        }
+        outBufU64(report, known->Size());
+        outBufPuts(report, " known hashes loaded\n\n");
+    }
+
+    int workResult;
+    if (devices.Count == 1 && !imageList) {
+        // Open device
+        const char *device = devices.Paths[0];
+        int fd = devOpen(device, opts.Direct);
+        if (fd < 0) {
+            std::perror("open");
+            std::exit(OPEN_ERROR);
+        }
+        reportOpened(device, fd, opts, report);
+
+        // Do work, picking up from the checkpoint if resuming
+        ScanState state;
+        state.Device = device;
+        state.Format = opts.Format;
+        state.List = opts.List;
+        state.Hash = opts.Hash;
+        state.KnownPath = opts.KnownPath;
+        Checkpoint checkpoint(opts.CheckpointPath, opts.CheckpointEvery, &out);
+        bool checkpointing = !opts.CheckpointPath.empty();
+        workResult = SUCCESS;
+        if (opts.Resume) {
+            workResult = resumeScan(checkpoint, state, &out, report);
+            // The header went out with the first run
+            opts.Header = state.NextRecord == 0 && state.Partition == 0;
+        }
+        // Note where the listing starts before any of it is written, so a
+        // crash ahead of the first interval's checkpoint can still be
+        // resumed without listing rows twice
+        if (workResult == SUCCESS && checkpointing &&
+            state.NextRecord == 0 && state.Partition == 0 &&
+            !saveCheckpoint(&checkpoint, state, report)) {
+            workResult = CHECKPOINT_ERROR;
+        }
+        if (workResult == SUCCESS) {
+            workResult = work(fd, opts, known, &out, report,
+                              checkpointing ? &checkpoint : NULL, state);
+        }
+        if (checkpointing && workResult == SUCCESS) {
+            checkpoint.Remove();
+        }
+
+        // Close device
+        devClose(fd);
+    } else {
+        // Rows are tagged with their image, under one shared header
+        if (opts.List || opts.Hash) {
+            RecordWriter *writer = RecordWriter::New(opts.Format, &out);
+            writer->SetSource("-");
+            writer->Begin();
+            delete writer;
+        }
+        opts.Header = false;
+
+        // --jobs counts hashing threads for the whole run, so the images
+        // hashed at once split them rather than each starting that many
+        size_t workers = fleetOpts.Workers > 0 ? fleetOpts.Workers : 1;
+        if (workers > devices.Count) {
+            workers = devices.Count;
+        }
+        opts.Jobs = opts.Jobs / workers > 0 ? opts.Jobs / workers : 1;
+
+        FleetContext context = {&opts, known};
+        workResult =
+            fleetRun(&devices, &fleetOpts, workImage, &context, streams, 2);
+    }
+    fleetFreePaths(&devices);
+    delete known;
+
+    // Flush output. Instrumentation goes to stderr
+    outBufFree(&out);
+    if (opts.Stats == 2) {
+        metricsPrintJSON(&err);
+    } else if (opts.Stats == 1) {
+        metricsPrint(&err);
+    }
+    outBufFree(&err);
 
     // Exit with work's return code
     std::exit(workResult);
-}
\ No newline at end of file
+}
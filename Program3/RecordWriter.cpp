@@ -0,0 +1,197 @@
+#include "RecordWriter.hpp"
+#include <stdexcept>
+
+namespace {
+// Writes `"key":` (after a comma unless first)
+void jsonKey(OutBuf *out, const char *key, bool first = false) {
+    if (!first) {
+        outBufPutc(out, ',');
+    }
+    outBufPutc(out, '"');
+    outBufPuts(out, key);
+    outBufWrite(out, "\":", 2);
+}
+
+// FILETIME as a JSON string, or null if unset
+void jsonTime(OutBuf *out, std::uint64_t filetime) {
+    if (filetime == 0) {
+        outBufWrite(out, "null", 4);
+        return;
+    }
+    outBufPutc(out, '"');
+    outBufTimestamp(out, filetime);
+    outBufPutc(out, '"');
+}
+} // namespace
+
+// Blank row, filled in later (as when read back from a spill)
+ListingRow::ListingRow()
+    : RecordNumber(0), SequenceNumber(0), InUse(false), Directory(false),
+      Parent(0), Size(0), Allocated(0), Created(0), Modified(0), Changed(0),
+      Accessed(0), Hashed(false), XXH64Digest(0), SHA256Digest() {}
+
+// Row from a parsed record. Hash fields are left unset
+ListingRow::ListingRow(const FileRecord &record)
+    : RecordNumber(record.GetRecordNumber()),
+      SequenceNumber(record.GetSequenceNumber()), InUse(record.IsInUse()),
+      Directory(record.IsDirectory()), Parent(record.GetParentReference()),
+      Size(record.GetDataSize()), Allocated(record.GetDataAllocatedSize()),
+      Created(record.GetCreationTime()),
+      Modified(record.GetModificationTime()), Changed(record.GetChangeTime()),
+      Accessed(record.GetAccessTime()), Name(record.GetFileNameUTF8()),
+      Hashed(false), XXH64Digest(0), SHA256Digest() {}
+
+// `RecordWriter` constructor
+RecordWriter::RecordWriter(OutBuf *out) : out(out) {}
+
+RecordWriter::~RecordWriter() {}
+
+// Rows written after this carry the image path, for listings that merge
+// several images
+void RecordWriter::SetSource(const std::string &source) {
+    this->source = source;
+}
+
+void RecordWriter::Begin() {}
+
+void RecordWriter::End() { outBufFlush(this->out); }
+
+RecordWriter *RecordWriter::New(const std::string &format, OutBuf *out) {
+    if (format == "jsonl") {
+        return new JSONLWriter(out);
+    }
+    if (format == "csv") {
+        return new CSVWriter(out);
+    }
+    if (format == "body") {
+        return new BodyfileWriter(out);
+    }
+    throw std::invalid_argument("Unknown output format " + format);
+}
+
+// `JSONLWriter` constructor
+JSONLWriter::JSONLWriter(OutBuf *out) : RecordWriter(out) {}
+
+void JSONLWriter::Write(const ListingRow &row) {
+    outBufPutc(this->out, '{');
+    if (!this->source.empty()) {
+        jsonKey(this->out, "image", true);
+        outBufJSONString(this->out, this->source.data(), this->source.size());
+    }
+    jsonKey(this->out, "record", this->source.empty());
+    outBufU64(this->out, row.RecordNumber);
+    jsonKey(this->out, "sequence");
+    outBufU64(this->out, row.SequenceNumber);
+    jsonKey(this->out, "deleted");
+    outBufPuts(this->out, row.InUse ? "false" : "true");
+    jsonKey(this->out, "directory");
+    outBufPuts(this->out, row.Directory ? "true" : "false");
+    jsonKey(this->out, "parent");
+    outBufU64(this->out, row.Parent & MFT_REFERENCE_MASK);
+    jsonKey(this->out, "size");
+    outBufU64(this->out, row.Size);
+    jsonKey(this->out, "allocated");
+    outBufU64(this->out, row.Allocated);
+    jsonKey(this->out, "created");
+    jsonTime(this->out, row.Created);
+    jsonKey(this->out, "modified");
+    jsonTime(this->out, row.Modified);
+    jsonKey(this->out, "changed");
+    jsonTime(this->out, row.Changed);
+    jsonKey(this->out, "accessed");
+    jsonTime(this->out, row.Accessed);
+    jsonKey(this->out, "name");
+    outBufJSONString(this->out, row.Name.data(), row.Name.size());
+    if (row.Hashed) {
+        jsonKey(this->out, "xxh64");
+        outBufPutc(this->out, '"');
+        outBufHex(this->out, row.XXH64Digest, 16, false);
+        outBufPutc(this->out, '"');
+        jsonKey(this->out, "sha256");
+        outBufPutc(this->out, '"');
+        outBufHexBytes(this->out, row.SHA256Digest.data(),
+                       row.SHA256Digest.size(), false);
+        outBufPutc(this->out, '"');
+    }
+    outBufWrite(this->out, "}\n", 2);
+}
+
+// `CSVWriter` constructor
+CSVWriter::CSVWriter(OutBuf *out) : RecordWriter(out) {}
+
+void CSVWriter::Begin() {
+    if (!this->source.empty()) {
+        outBufPuts(this->out, "image,");
+    }
+    outBufPuts(this->out, "record,sequence,deleted,directory,parent,size,"
+                          "allocated,created,modified,changed,accessed,name,"
+                          "xxh64,sha256\n");
+}
+
+void CSVWriter::Write(const ListingRow &row) {
+    if (!this->source.empty()) {
+        outBufCSVField(this->out, this->source.data(), this->source.size());
+        outBufPutc(this->out, ',');
+    }
+    outBufU64(this->out, row.RecordNumber);
+    outBufPutc(this->out, ',');
+    outBufU64(this->out, row.SequenceNumber);
+    outBufPutc(this->out, ',');
+    outBufPutc(this->out, row.InUse ? '0' : '1');
+    outBufPutc(this->out, ',');
+    outBufPutc(this->out, row.Directory ? '1' : '0');
+    outBufPutc(this->out, ',');
+    outBufU64(this->out, row.Parent & MFT_REFERENCE_MASK);
+    outBufPutc(this->out, ',');
+    outBufU64(this->out, row.Size);
+    outBufPutc(this->out, ',');
+    outBufU64(this->out, row.Allocated);
+    const std::uint64_t times[4] = {row.Created, row.Modified, row.Changed,
+                                    row.Accessed};
+    for (int i = 0; i < 4; ++i) {
+        outBufPutc(this->out, ',');
+        if (times[i] != 0) {
+            outBufTimestamp(this->out, times[i]);
+        }
+    }
+    outBufPutc(this->out, ',');
+    outBufCSVField(this->out, row.Name.data(), row.Name.size());
+    outBufPutc(this->out, ',');
+    if (row.Hashed) {
+        outBufHex(this->out, row.XXH64Digest, 16, false);
+        outBufPutc(this->out, ',');
+        outBufHexBytes(this->out, row.SHA256Digest.data(),
+                       row.SHA256Digest.size(), false);
+    } else {
+        outBufPutc(this->out, ',');
+    }
+    outBufPutc(this->out, '\n');
+}
+
+// `BodyfileWriter` constructor
+BodyfileWriter::BodyfileWriter(OutBuf *out) : RecordWriter(out) {}
+
+void BodyfileWriter::Write(const ListingRow &row) {
+    // No MD5 is computed, so the field is 0 as TSK does
+    outBufWrite(this->out, "0|", 2);
+    if (!this->source.empty()) {
+        outBufWrite(this->out, this->source.data(), this->source.size());
+        outBufPutc(this->out, ':');
+    }
+    outBufWrite(this->out, row.Name.data(), row.Name.size());
+    if (!row.InUse) {
+        outBufPuts(this->out, " (deleted)");
+    }
+    outBufPutc(this->out, '|');
+    outBufU64(this->out, row.RecordNumber);
+    outBufPuts(this->out, row.Directory ? "|d/drwxrwxrwx|0|0|"
+                                        : "|r/rrwxrwxrwx|0|0|");
+    outBufU64(this->out, row.Size);
+    const std::uint64_t times[4] = {row.Accessed, row.Modified, row.Changed,
+                                    row.Created};
+    for (int i = 0; i < 4; ++i) {
+        outBufPutc(this->out, '|');
+        outBufI64(this->out, times[i] != 0 ? fileTimeToUnix(times[i]) : 0);
+    }
+    outBufPutc(this->out, '\n');
+}
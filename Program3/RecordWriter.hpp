@@ -0,0 +1,84 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_RECORDWRITER_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_RECORDWRITER_HPP_
+
+// Standard library
+#include <cstdint> // for standard types
+#include <string>  // std::string
+
+// Self-defined
+#include "../Common/outbuf.h"
+#include "Hash.hpp"
+#include "MFT.hpp"
+
+// One line of a file listing
+struct ListingRow {
+    std::uint64_t RecordNumber;
+    std::uint16_t SequenceNumber;
+    bool InUse;     // false for deleted records
+    bool Directory; // record describes a directory
+    std::uint64_t Parent;    // parent directory reference
+    std::uint64_t Size;      // data size
+    std::uint64_t Allocated; // allocated size
+    std::uint64_t Created;   // $STANDARD_INFORMATION timestamps (FILETIME)
+    std::uint64_t Modified;
+    std::uint64_t Changed;
+    std::uint64_t Accessed;
+    std::string Name; // UTF-8
+    bool Hashed;      // hash fields below are set
+    std::uint64_t XXH64Digest;
+    dkt::Digest SHA256Digest;
+
+    ListingRow();
+    ListingRow(const FileRecord &);
+};
+
+// Class definitions
+
+// Structured listing writer. Subclasses render `ListingRow`s in one format
+// into an `OutBuf`
+class RecordWriter {
+  protected:
+    OutBuf *out;        // destination, not owned
+    std::string source; // image the rows come from, if tagged
+
+  public:
+    // Constructors
+    RecordWriter(OutBuf *);
+    virtual ~RecordWriter();
+
+    // Methods
+    void SetSource(const std::string &); // tag rows with an image path
+    virtual void Begin();                        // header, if any
+    virtual void Write(const ListingRow &) = 0; // one row
+    virtual void End();                          // trailer, if any
+
+    // Factory. Format is one of "jsonl", "csv" or "body".
+    // THROWS:
+    //  - std::invalid_argument("Unknown output format ${format}")
+    static RecordWriter *New(const std::string &, OutBuf *);
+};
+
+// JSON Lines: one object per row
+class JSONLWriter : public RecordWriter {
+  public:
+    JSONLWriter(OutBuf *);
+    void Write(const ListingRow &);
+};
+
+// CSV with a header row
+class CSVWriter : public RecordWriter {
+  public:
+    CSVWriter(OutBuf *);
+    void Begin();
+    void Write(const ListingRow &);
+};
+
+// The Sleuth Kit body file (mactime input):
+// MD5|name|inode|mode|UID|GID|size|atime|mtime|ctime|crtime
+class BodyfileWriter : public RecordWriter {
+  public:
+    BodyfileWriter(OutBuf *);
+    void Write(const ListingRow &);
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "Rescue.hpp"
+#include <cstring>
+#include <iterator>
+#include <unistd.h>
+
+#include "../Common/devio.h"
+#include "Constants.hpp"
+
+namespace {
+// Zero-fill `length` lost bytes at device offset `offset`, in the buffer of
+// a request that started at `origin`, and flag the sectors they touch
+void markLost(unsigned char *buf, std::uint64_t length, std::uint64_t offset,
+              unsigned char *unreadable, std::uint64_t origin) {
+    std::memset(buf, 0, length);
+    if (unreadable == NULL) {
+        return;
+    }
+    std::uint64_t first = (offset - origin) / SECTOR_SIZE;
+    std::uint64_t last = (offset + length - 1 - origin) / SECTOR_SIZE;
+    for (std::uint64_t i = first; i <= last; ++i) {
+        unreadable[i] = 1;
+    }
+}
+} // namespace
+
+// `RescueReader` constructor. Each bad sector gets `retries` more tries on
+// a retry read
+RescueReader::RescueReader(int fd, unsigned retries)
+    : fd(fd), retries(retries), recovered(0) {}
+
+// Add [offset, offset + length) to the bad-range map, merging it with the
+// ranges it touches
+void RescueReader::MarkBad(std::uint64_t offset, std::uint64_t length) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::uint64_t start = offset, end = offset + length;
+    auto it = this->bad.upper_bound(start);
+    if (it != this->bad.begin() && std::prev(it)->second >= start) {
+        --it;
+    }
+    while (it != this->bad.end() && it->first <= end) {
+        start = it->first < start ? it->first : start;
+        end = it->second > end ? it->second : end;
+        it = this->bad.erase(it);
+    }
+    this->bad[start] = end;
+}
+
+// Take [offset, offset + length) out of the bad-range map
+void RescueReader::MarkGood(std::uint64_t offset, std::uint64_t length) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::uint64_t start = offset, end = offset + length;
+    auto it = this->bad.upper_bound(start);
+    if (it != this->bad.begin() && std::prev(it)->second > start) {
+        --it;
+    }
+    while (it != this->bad.end() && it->first < end) {
+        std::uint64_t rangeStart = it->first, rangeEnd = it->second;
+        it = this->bad.erase(it);
+        if (rangeStart < start) {
+            this->bad[rangeStart] = start;
+        }
+        if (rangeEnd > end) {
+            this->bad[end] = rangeEnd;
+        }
+    }
+}
+
+// Read a span with no known-bad sectors in it. Whatever fails is split in
+// two at a sector boundary and each half read on its own, down to single
+// sectors, which are given up on. Returns the number of bytes lost
+std::uint64_t RescueReader::ReadSpan(unsigned char *buf, std::uint64_t length,
+                                     std::uint64_t offset,
+                                     unsigned char *unreadable,
+                                     std::uint64_t origin) {
+    // Reads that fail part way still return the bytes before the error
+    std::uint64_t done = 0;
+    while (done < length) {
+        ssize_t got =
+            devPread(this->fd, buf + done, length - done, offset + done);
+        if (got <= 0) {
+            break;
+        }
+        done += got;
+    }
+    if (done == length) {
+        return 0;
+    }
+
+    std::uint64_t start = offset + done, left = length - done;
+    unsigned char *rest = buf + done;
+    std::uint64_t sectorEnd = (start / SECTOR_SIZE + 1) * SECTOR_SIZE;
+    if (start + left <= sectorEnd) {
+        markLost(rest, left, start, unreadable, origin);
+        this->MarkBad(start, left);
+        return left;
+    }
+    std::uint64_t middle = (start + left / 2) / SECTOR_SIZE * SECTOR_SIZE;
+    if (middle <= start) {
+        middle = sectorEnd;
+    }
+    return this->ReadSpan(rest, middle - start, start, unreadable, origin) +
+           this->ReadSpan(rest + (middle - start), start + left - middle,
+                          middle, unreadable, origin);
+}
+
+// Read one sector (or part of one), trying up to `tries` times
+bool RescueReader::ReadSector(unsigned char *buf, std::uint64_t length,
+                              std::uint64_t offset, unsigned tries) const {
+    for (unsigned i = 0; i < tries; ++i) {
+        if (devPread(this->fd, buf, length, offset) ==
+            static_cast<ssize_t>(length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint64_t RescueReader::Read(unsigned char *buf, std::uint64_t length,
+                                 std::uint64_t offset,
+                                 unsigned char *unreadable, bool retry) {
+    if (unreadable != NULL) {
+        std::memset(unreadable, 0, (length + SECTOR_SIZE - 1) / SECTOR_SIZE);
+    }
+
+    // Known-bad ranges in the request, copied so the reads run unlocked
+    std::uint64_t end = offset + length;
+    dkt::BadRangeVector known;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        auto it = this->bad.upper_bound(offset);
+        if (it != this->bad.begin() && std::prev(it)->second > offset) {
+            --it;
+        }
+        for (; it != this->bad.end() && it->first < end; ++it) {
+            BadRange range = {it->first, it->second - it->first};
+            known.push_back(range);
+        }
+    }
+
+    std::uint64_t lost = 0, position = offset;
+    for (std::size_t i = 0; i < known.size(); ++i) {
+        std::uint64_t badStart =
+            known[i].Offset > position ? known[i].Offset : position;
+        std::uint64_t badEnd = known[i].Offset + known[i].Length < end
+                                   ? known[i].Offset + known[i].Length
+                                   : end;
+        if (position < badStart) {
+            lost += this->ReadSpan(buf + (position - offset),
+                                   badStart - position, position, unreadable,
+                                   offset);
+        }
+
+        // Skipped on a first pass; sector by sector on a retry
+        for (position = badStart; position < badEnd;) {
+            std::uint64_t sectorEnd =
+                (position / SECTOR_SIZE + 1) * SECTOR_SIZE;
+            std::uint64_t n =
+                (sectorEnd < badEnd ? sectorEnd : badEnd) - position;
+            unsigned char *at = buf + (position - offset);
+            if (retry && this->ReadSector(at, n, position, this->retries)) {
+                this->MarkGood(position, n);
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->recovered += n;
+            } else {
+                markLost(at, n, position, unreadable, offset);
+                lost += n;
+            }
+            position += n;
+        }
+    }
+    if (position < end) {
+        lost += this->ReadSpan(buf + (position - offset), end - position,
+                               position, unreadable, offset);
+    }
+    return lost;
+}
+
+dkt::BadRangeVector RescueReader::GetBadRanges() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    dkt::BadRangeVector ranges;
+    for (auto it = this->bad.begin(); it != this->bad.end(); ++it) {
+        BadRange range = {it->first, it->second - it->first};
+        ranges.push_back(range);
+    }
+    return ranges;
+}
+
+std::uint64_t RescueReader::GetBadBytes() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::uint64_t total = 0;
+    for (auto it = this->bad.begin(); it != this->bad.end(); ++it) {
+        total += it->second - it->first;
+    }
+    return total;
+}
+
+std::uint64_t RescueReader::GetRecoveredBytes() const {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->recovered;
+}
+
+void RescueReader::WriteMap(OutBuf *out) const {
+    dkt::BadRangeVector ranges = this->GetBadRanges();
+    outBufPuts(out, "# Unreadable device ranges: offset length\n");
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+        outBufPuts(out, "0x");
+        outBufHex(out, ranges[i].Offset, 0, true);
+        outBufPuts(out, " 0x");
+        outBufHex(out, ranges[i].Length, 0, true);
+        outBufPutc(out, '\n');
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_RESCUE_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_RESCUE_HPP_
+
+// Standard library
+#include <cstdint> // for standard types
+#include <map>     // std::map
+#include <mutex>   // std::mutex
+#include <vector>  // std::vector
+
+// Self-defined
+#include "../Common/outbuf.h"
+
+// Byte range of the device that couldn't be read
+struct BadRange {
+    std::uint64_t Offset;
+    std::uint64_t Length;
+};
+
+// Type aliases
+namespace dkt {
+typedef std::vector<BadRange> BadRangeVector; // vector of `BadRange`s
+} // namespace dkt
+
+// Class definitions
+
+// Device reader for failing disks, in the spirit of ddrescue. Requests are
+// read in one piece; when that fails, the failed part is bisected down to
+// single sectors, so every sector that can be read still comes back.
+// Unreadable sectors are zero-filled, flagged to the caller and recorded in
+// a bad-range map shared by all threads. Later reads skip known-bad sectors
+// instead of grinding on them again, so the readable bulk of the disk comes
+// off first; a retry read then goes back over them.
+class RescueReader {
+  protected:
+    // Data fields
+    int fd;                                     // opened device
+    unsigned retries;                           // extra tries per bad sector
+    std::map<std::uint64_t, std::uint64_t> bad; // start -> end, merged
+    std::uint64_t recovered;                    // bytes recovered by retries
+    mutable std::mutex lock;
+
+    void MarkBad(std::uint64_t, std::uint64_t);   // offset, length
+    void MarkGood(std::uint64_t, std::uint64_t);  // offset, length
+    std::uint64_t ReadSpan(unsigned char *, std::uint64_t, std::uint64_t,
+                           unsigned char *, std::uint64_t); // bisecting read
+    bool ReadSector(unsigned char *, std::uint64_t, std::uint64_t,
+                    unsigned) const; // length, offset, tries
+
+  public:
+    // Constructors
+    RescueReader(int, unsigned); // device, retries
+
+    // Methods
+
+    // Read `length` bytes at device offset `offset` into `buf`. Unreadable
+    // sectors are zero-filled and set to 1 in `unreadable`, which holds one
+    // flag per SECTOR_SIZE bytes of `buf` (and may be null). With `retry`,
+    // known-bad sectors are tried again instead of skipped. Returns the
+    // number of bytes that couldn't be read
+    std::uint64_t Read(unsigned char *, std::uint64_t, std::uint64_t,
+                       unsigned char *, bool);
+
+    dkt::BadRangeVector GetBadRanges() const;
+    std::uint64_t GetBadBytes() const;
+    std::uint64_t GetRecoveredBytes() const;
+
+    // Write the bad-range map, one "0xOFFSET 0xLENGTH" line per range
+    void WriteMap(OutBuf *) const;
+};
+
+#endif
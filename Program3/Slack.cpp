@@ -0,0 +1,214 @@
+#include "Slack.hpp"
+#include <algorithm>
+#include <cstddef>
+
+#include "../Common/devio.h"
+#include "../Common/hexdump.h"
+#include "../Common/zeroscan.h"
+#include "Constants.hpp"
+
+namespace {
+// Neighbouring file slack regions read as one
+struct SlackRead {
+    std::uint64_t Start; // device offset
+    std::uint64_t End;
+    std::size_t First; // regions, as indices into the sorted order
+    std::size_t Last;
+};
+
+bool byRecord(const SlackRegion &a, const SlackRegion &b) {
+    if (a.RecordNumber != b.RecordNumber) {
+        return a.RecordNumber < b.RecordNumber;
+    }
+    if (a.FileSlack != b.FileSlack) {
+        return !a.FileSlack;
+    }
+    return a.Address < b.Address;
+}
+} // namespace
+
+// `SlackScanner` constructor
+SlackScanner::SlackScanner(int fd, const MFT &mft, OutBuf *out)
+    : fd(fd), mft(mft), out(out), pendingRead(0), scanned(0), found(0),
+      unreadable(0) {}
+
+void SlackScanner::Add(const FileRecord &record) {
+    // FILE record slack, past the bytes in use
+    dkt::UString raw = record.GetRecord();
+    std::uint64_t used = record.GetBytesInUse();
+    std::uint64_t allocated = record.GetBytesAllocated();
+    if (allocated > raw.size()) {
+        allocated = raw.size();
+    }
+    if (used < allocated) {
+        SlackRegion region;
+        region.RecordNumber = record.GetRecordNumber();
+        region.FileSlack = false;
+        region.Address =
+            this->mft.GetRecordAddress(record.GetRecordNumber()) + used;
+        region.Length = allocated - used;
+        region.Data.assign(raw.begin() + used, raw.begin() + allocated);
+        region.Unreadable = false;
+        this->pending.push_back(region);
+    }
+
+    // File slack, past the data size. A deleted file's clusters may belong
+    // to another file by now, and compressed data has no slack of its own
+    if (record.IsInUse() && record.HasData() && !record.IsDataResident() &&
+        !record.IsCompressed()) {
+        std::uint64_t clusterSize = this->mft.GetClusterSize();
+        std::uint64_t begin = record.GetDataSize();
+        std::uint64_t end = record.GetDataAllocatedSize();
+        dkt::ExtentVector extents = record.GetExtents();
+        for (std::size_t i = 0; i < extents.size() && begin < end; ++i) {
+            const Extent &run = extents[i];
+            std::uint64_t runStart = run.VCN * clusterSize;
+            std::uint64_t runEnd = runStart + run.Length * clusterSize;
+            std::uint64_t from = begin > runStart ? begin : runStart;
+            std::uint64_t to = end < runEnd ? end : runEnd;
+            if (run.Sparse || from >= to) {
+                continue;
+            }
+            for (; from < to; from += SLACK_READ_SIZE) {
+                SlackRegion region;
+                region.RecordNumber = record.GetRecordNumber();
+                region.FileSlack = true;
+                region.Address = this->mft.GetVolumeOffset() +
+                                 run.LCN * clusterSize + (from - runStart);
+                region.Length = to - from < SLACK_READ_SIZE
+                                    ? to - from
+                                    : SLACK_READ_SIZE;
+                region.Unreadable = false;
+                this->pending.push_back(region);
+                this->pendingRead += region.Length;
+            }
+        }
+    }
+
+    if (this->pendingRead >= SLACK_BATCH_SIZE ||
+        this->pending.size() >= SLACK_BATCH_REGIONS) {
+        this->Flush();
+    }
+}
+
+// Read the queued file slack in device order, joining regions less than
+// SLACK_JOIN_GAP apart, DEV_BATCH_DEPTH reads at a time
+void SlackScanner::ReadPending() {
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < this->pending.size(); ++i) {
+        if (this->pending[i].FileSlack) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(),
+              [this](std::size_t a, std::size_t b) {
+                  return this->pending[a].Address < this->pending[b].Address;
+              });
+
+    std::vector<SlackRead> joined;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const SlackRegion &region = this->pending[order[i]];
+        std::uint64_t end = region.Address + region.Length;
+        if (!joined.empty() &&
+            region.Address <= joined.back().End + SLACK_JOIN_GAP &&
+            end - joined.back().Start <= SLACK_READ_SIZE) {
+            if (end > joined.back().End) {
+                joined.back().End = end;
+            }
+            joined.back().Last = i;
+            continue;
+        }
+        SlackRead read = {region.Address, end, i, i};
+        joined.push_back(read);
+    }
+
+    for (std::size_t first = 0; first < joined.size();
+         first += DEV_BATCH_DEPTH) {
+        std::size_t count = joined.size() - first < DEV_BATCH_DEPTH
+                                ? joined.size() - first
+                                : DEV_BATCH_DEPTH;
+        std::vector<std::size_t> at(count);
+        std::size_t total = 0;
+        for (std::size_t j = 0; j < count; ++j) {
+            at[j] = total;
+            total += joined[first + j].End - joined[first + j].Start;
+        }
+        dkt::UString buf(total);
+        std::vector<DevRead> reads(count);
+        for (std::size_t j = 0; j < count; ++j) {
+            const SlackRead &read = joined[first + j];
+            reads[j].Buffer = &buf[at[j]];
+            reads[j].Length = read.End - read.Start;
+            reads[j].Offset = read.Start;
+        }
+        devPreadBatch(this->fd, &reads[0], count);
+
+        for (std::size_t j = 0; j < count; ++j) {
+            const SlackRead &read = joined[first + j];
+            for (std::size_t k = read.First; k <= read.Last; ++k) {
+                SlackRegion &region = this->pending[order[k]];
+                std::uint64_t offset = region.Address - read.Start;
+                if (reads[j].Result < 0 ||
+                    static_cast<std::uint64_t>(reads[j].Result) <
+                        offset + region.Length) {
+                    region.Unreadable = true;
+                    continue;
+                }
+                region.Data.assign(buf.begin() + at[j] + offset,
+                                   buf.begin() + at[j] + offset +
+                                       region.Length);
+            }
+        }
+    }
+}
+
+// Dump a region, unless it's all zero
+void SlackScanner::Emit(const SlackRegion &region) {
+    this->scanned += region.Length;
+    if (region.Unreadable) {
+        this->unreadable += region.Length;
+        return;
+    }
+    const unsigned char *data = &region.Data[0];
+    std::size_t first = zeroScanFirst(data, region.Length);
+    if (first == region.Length) {
+        return;
+    }
+    std::size_t end = zeroScanEnd(data, region.Length);
+    ++this->found;
+
+    // Whole dump rows around the data
+    first = first / 16 * 16;
+    end = (end + 15) / 16 * 16;
+    if (end > region.Length) {
+        end = region.Length;
+    }
+    outBufPuts(this->out, "Record ");
+    outBufU64(this->out, region.RecordNumber);
+    outBufPuts(this->out,
+               region.FileSlack ? " file slack, " : " record slack, ");
+    outBufU64(this->out, region.Length);
+    outBufPuts(this->out, " bytes at 0x");
+    outBufHex(this->out, region.Address, 0, true);
+    outBufPuts(this->out, ":\n");
+    hexDump(this->out, data + first, end - first, region.Address + first,
+            NULL);
+}
+
+void SlackScanner::Flush() {
+    this->ReadPending();
+    std::sort(this->pending.begin(), this->pending.end(), byRecord);
+    for (std::size_t i = 0; i < this->pending.size(); ++i) {
+        this->Emit(this->pending[i]);
+    }
+    this->pending.clear();
+    this->pendingRead = 0;
+}
+
+std::uint64_t SlackScanner::GetScannedBytes() const { return this->scanned; }
+
+std::uint64_t SlackScanner::GetRegionCount() const { return this->found; }
+
+std::uint64_t SlackScanner::GetUnreadableBytes() const {
+    return this->unreadable;
+}
@@ -0,0 +1,66 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_SLACK_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_SLACK_HPP_
+
+// Standard library
+#include <cstdint> // for standard types
+#include <vector>  // std::vector
+
+// Self-defined
+#include "../Common/outbuf.h"
+#include "MFT.hpp"
+
+// Slack of one record: the tail of its FILE record past the bytes in use,
+// or (in pieces, one per run) its unnamed $DATA between the data size and
+// the allocated size
+struct SlackRegion {
+    std::uint64_t RecordNumber; // owning record
+    bool FileSlack;             // $DATA slack, rather than FILE record slack
+    std::uint64_t Address;      // device offset
+    std::uint64_t Length;       // bytes
+    dkt::UString Data;          // contents, once read
+    bool Unreadable;            // the device read failed
+};
+
+// Type aliases
+namespace dkt {
+typedef std::vector<SlackRegion> SlackVector; // vector of `SlackRegion`s
+} // namespace dkt
+
+// Class definitions
+
+// Slack space extractor. FILE record slack is already in memory; file slack
+// is queued and read in batches, sorted by device offset and with nearby
+// regions joined into one read, rather than with a seek per file. Regions
+// that are all zero are passed over; the rest are hex dumped, trimmed to
+// the rows that hold data, under a line naming their owning record.
+class SlackScanner {
+  protected:
+    // Data fields
+    int fd;                    // opened device
+    const MFT &mft;            // table the records come from
+    OutBuf *out;               // dumps
+    dkt::SlackVector pending;  // regions waiting for `Flush`
+    std::uint64_t pendingRead; // bytes of file slack in `pending`
+    std::uint64_t scanned;     // slack bytes checked
+    std::uint64_t found;       // regions holding data
+    std::uint64_t unreadable;  // file slack bytes that couldn't be read
+
+    void ReadPending();
+    void Emit(const SlackRegion &);
+
+  public:
+    // Constructors
+    SlackScanner(int, const MFT &, OutBuf *); // device, $MFT, output
+
+    // Methods
+
+    // Queue the record's slack, flushing when a batch is full
+    void Add(const FileRecord &);
+    void Flush(); // read, check and dump everything queued
+
+    std::uint64_t GetScannedBytes() const;
+    std::uint64_t GetRegionCount() const;
+    std::uint64_t GetUnreadableBytes() const;
+};
+
+#endif
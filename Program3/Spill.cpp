@@ -0,0 +1,199 @@
+#include "Spill.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Constants.hpp"
+
+namespace {
+// Bytes of a spilled row before its name
+const std::size_t ROW_FIXED_SIZE = 113;
+
+std::runtime_error spillError() {
+    return std::runtime_error(std::string("spill: ") +
+                              (errno != 0 ? std::strerror(errno)
+                                          : "temp file cut short"));
+}
+
+template <typename T> void put(std::string &out, const T &value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+template <typename T> void get(const unsigned char *&in, T &value) {
+    std::memcpy(&value, in, sizeof value);
+    in += sizeof value;
+}
+
+bool byRecordNumber(const ListingRow &a, const ListingRow &b) {
+    return a.RecordNumber < b.RecordNumber;
+}
+
+// Append `row` to a run. Runs never leave the process, so fields are stored
+// in native byte order
+void writeRow(std::FILE *run, const ListingRow &row, std::string &scratch) {
+    scratch.clear();
+    put(scratch, row.RecordNumber);
+    put(scratch, row.SequenceNumber);
+    put(scratch, row.InUse);
+    put(scratch, row.Directory);
+    put(scratch, row.Parent);
+    put(scratch, row.Size);
+    put(scratch, row.Allocated);
+    put(scratch, row.Created);
+    put(scratch, row.Modified);
+    put(scratch, row.Changed);
+    put(scratch, row.Accessed);
+    put(scratch, row.Hashed);
+    put(scratch, row.XXH64Digest);
+    put(scratch, row.SHA256Digest);
+    put(scratch, static_cast<std::uint32_t>(row.Name.size()));
+    scratch += row.Name;
+    errno = 0;
+    if (std::fwrite(scratch.data(), 1, scratch.size(), run) !=
+        scratch.size()) {
+        throw spillError();
+    }
+}
+
+// Next row of a run. Returns false at its end
+bool readRow(std::FILE *run, ListingRow &row) {
+    unsigned char fixed[ROW_FIXED_SIZE];
+    errno = 0;
+    std::size_t got = std::fread(fixed, 1, ROW_FIXED_SIZE, run);
+    if (got == 0 && std::feof(run)) {
+        return false;
+    }
+    if (got != ROW_FIXED_SIZE) {
+        throw spillError();
+    }
+
+    const unsigned char *in = fixed;
+    std::uint32_t nameLength;
+    get(in, row.RecordNumber);
+    get(in, row.SequenceNumber);
+    get(in, row.InUse);
+    get(in, row.Directory);
+    get(in, row.Parent);
+    get(in, row.Size);
+    get(in, row.Allocated);
+    get(in, row.Created);
+    get(in, row.Modified);
+    get(in, row.Changed);
+    get(in, row.Accessed);
+    get(in, row.Hashed);
+    get(in, row.XXH64Digest);
+    get(in, row.SHA256Digest);
+    get(in, nameLength);
+    row.Name.resize(nameLength);
+    if (nameLength != 0 &&
+        std::fread(&row.Name[0], 1, nameLength, run) != nameLength) {
+        throw spillError();
+    }
+    return true;
+}
+} // namespace
+
+RowSpill::RowSpill() : spilledRows(0), spilledRuns(0) {}
+
+RowSpill::~RowSpill() { this->CloseRuns(); }
+
+// Anonymous temp file, gone once closed
+std::FILE *RowSpill::NewRun() const {
+    errno = 0;
+    std::FILE *run = std::tmpfile();
+    if (run == NULL) {
+        throw spillError();
+    }
+    std::setvbuf(run, NULL, _IOFBF, SPILL_BUFFER_SIZE);
+    return run;
+}
+
+void RowSpill::CloseRuns() {
+    for (std::size_t i = 0; i < this->runs.size(); ++i) {
+        std::fclose(this->runs[i]);
+    }
+    this->runs.clear();
+}
+
+// k-way merge of every run and the sorted `rows`, through a min-heap keyed
+// on each source's next record number
+void RowSpill::MergeRuns(std::vector<ListingRow> &rows,
+                         const std::function<void(const ListingRow &)> &emit) {
+    typedef std::pair<std::uint64_t, std::size_t> Key; // record, source
+    std::priority_queue<Key, std::vector<Key>, std::greater<Key>> heap;
+    std::vector<ListingRow> heads(this->runs.size());
+    for (std::size_t i = 0; i < this->runs.size(); ++i) {
+        if (std::fflush(this->runs[i]) != 0) {
+            throw spillError();
+        }
+        std::rewind(this->runs[i]);
+        if (readRow(this->runs[i], heads[i])) {
+            heap.push(Key(heads[i].RecordNumber, i));
+        }
+    }
+    const std::size_t tail = this->runs.size(); // source index of `rows`
+    std::size_t next = 0;
+    if (!rows.empty()) {
+        heap.push(Key(rows[0].RecordNumber, tail));
+    }
+
+    while (!heap.empty()) {
+        std::size_t source = heap.top().second;
+        heap.pop();
+        if (source == tail) {
+            emit(rows[next]);
+            if (++next < rows.size()) {
+                heap.push(Key(rows[next].RecordNumber, tail));
+            }
+        } else {
+            emit(heads[source]);
+            if (readRow(this->runs[source], heads[source])) {
+                heap.push(Key(heads[source].RecordNumber, source));
+            }
+        }
+    }
+
+    this->CloseRuns();
+    rows.clear();
+}
+
+void RowSpill::Spill(std::vector<ListingRow> &rows) {
+    std::string scratch;
+    if (this->runs.size() >= static_cast<std::size_t>(SPILL_MERGE_FAN_IN)) {
+        // Fold the runs so far into one before opening another
+        std::FILE *merged = this->NewRun();
+        std::vector<ListingRow> none;
+        try {
+            this->MergeRuns(none, [&](const ListingRow &row) {
+                writeRow(merged, row, scratch);
+            });
+        } catch (...) {
+            std::fclose(merged);
+            throw;
+        }
+        this->runs.push_back(merged);
+    }
+
+    std::sort(rows.begin(), rows.end(), byRecordNumber);
+    this->runs.push_back(this->NewRun());
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        writeRow(this->runs.back(), rows[i], scratch);
+    }
+    this->spilledRows += rows.size();
+    ++this->spilledRuns;
+    rows.clear();
+}
+
+void RowSpill::Merge(std::vector<ListingRow> &rows,
+                     const std::function<void(const ListingRow &)> &emit) {
+    std::sort(rows.begin(), rows.end(), byRecordNumber);
+    this->MergeRuns(rows, emit);
+}
+
+std::uint64_t RowSpill::GetSpilledRows() const { return this->spilledRows; }
+
+std::uint64_t RowSpill::GetSpilledRuns() const { return this->spilledRuns; }
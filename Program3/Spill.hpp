@@ -0,0 +1,60 @@
+#ifndef SUMMER_NTFS_PROJECT_PROGRAM3_SPILL_HPP_
+#define SUMMER_NTFS_PROJECT_PROGRAM3_SPILL_HPP_
+
+// Standard library
+#include <cstddef>    // std::size_t
+#include <cstdint>    // for standard types
+#include <cstdio>     // std::FILE
+#include <functional> // std::function
+#include <vector>     // std::vector
+
+// Self-defined
+#include "RecordWriter.hpp"
+
+// Class definitions
+
+// Listing rows held back past the memory budget. Each spill sorts the rows
+// by record number and writes them to a temp file as one run; `Merge` reads
+// every run back through a k-way merge, so rows come out in record order
+// while only one row per run is in memory. Once SPILL_MERGE_FAN_IN runs have
+// piled up they are merged into a single run, keeping the number of open
+// files bounded on huge volumes.
+class RowSpill {
+  protected:
+    // Data fields
+    std::vector<std::FILE *> runs; // spilled runs, deleted when closed
+    std::uint64_t spilledRows;     // rows written to runs, in total
+    std::uint64_t spilledRuns;     // runs written, in total
+
+    std::FILE *NewRun() const;
+    void CloseRuns();
+    void MergeRuns(std::vector<ListingRow> &,
+                   const std::function<void(const ListingRow &)> &);
+
+  public:
+    // Constructors
+    RowSpill();
+    ~RowSpill();
+    RowSpill(const RowSpill &) = delete;
+    RowSpill &operator=(const RowSpill &) = delete;
+
+    // Methods
+
+    // Sort `rows` and write them out as a new run, leaving `rows` empty.
+    // THROWS:
+    //  - std::runtime_error("spill: ..."): if the temp file can't be
+    //  created or written
+    void Spill(std::vector<ListingRow> &);
+
+    // Pass every spilled row and every row of `rows` to `emit` in record
+    // order, then drop the runs and empty `rows`.
+    // THROWS:
+    //  - std::runtime_error("spill: ..."): if a run can't be read back
+    void Merge(std::vector<ListingRow> &,
+               const std::function<void(const ListingRow &)> &);
+
+    std::uint64_t GetSpilledRows() const;
+    std::uint64_t GetSpilledRuns() const;
+};
+
+#endif
@@ -5,6 +5,10 @@
 #include <cstdint> // for standard types
 #include <vector>  // std::vector
 
+// Shared C modules
+#include "../Common/ebr.h"
+#include "../Common/gpt.h"
+
 // Self-defined
 #include "Constants.hpp"
 
@@ -25,7 +29,8 @@ typedef std::vector<NTFSVBR> VBRVector; // vector of `NTFSVBR`s
 
 // Class definitions
 
-// General partition entry
+// General partition entry: a 16-byte MBR entry or a 128-byte GPT entry. GPT
+// entries report the MBR type byte equivalent to their type GUID
 class PartitionEntry {
   protected:
     // Data fields
@@ -38,6 +43,7 @@ class PartitionEntry {
     // Methods
     dkt::UString GetEntry() const;
     void SetEntry(const dkt::UString &);
+    bool IsGPTEntry() const;
     bool GetBootIndicator() const;
     unsigned char GetPartitionType() const;
     std::uint64_t GetStartingSector() const;
@@ -87,8 +93,15 @@ class NTFSVBR : public MBR {
     std::uint64_t GetMFTLCN() const; // retrieve MFT sector from extended BPB
     std::uint64_t
     GetMFTMirrLCN() const; // retrieve MFTMirr sector from extended BPB
+    std::uint16_t GetBytesPerSector() const;  // BPB bytes per sector
+    std::uint8_t GetSectorsPerCluster() const; // BPB sectors per cluster
+    std::uint64_t GetClusterSize() const;      // cluster size, in bytes
+    std::uint64_t GetFileRecordSize() const;   // FILE record size, in bytes
+    std::uint64_t GetSerialNumber() const;     // volume serial number
 };
 
-// Function prototypes (none)
+// Function prototypes
+dkt::EntryVector ParseGPTEntries(const GPT &); // used entries of a GPT
+dkt::EntryVector ParseEBREntries(const EBRChain &); // logical partitions
 
 #endif
\ No newline at end of file